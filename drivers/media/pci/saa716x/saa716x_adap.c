@@ -1,6 +1,12 @@
 // SPDX-License-Identifier: GPL-2.0+
 
 #include <linux/bitops.h>
+#include <linux/debugfs.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/pm_runtime.h>
+#include <linux/seq_file.h>
+#include <linux/workqueue.h>
 
 #include <media/dmxdev.h>
 #include <media/dvbdev.h>
@@ -11,7 +17,13 @@
 
 #include "saa716x_mod.h"
 #include "saa716x_adap.h"
+#include "saa716x_bpf.h"
+#include "saa716x_festats.h"
 #include "saa716x_i2c.h"
+#include "saa716x_m2ts.h"
+#include "saa716x_pidstats.h"
+#include "saa716x_psi.h"
+#include "saa716x_streamer.h"
 #include "saa716x_priv.h"
 
 
@@ -20,7 +32,30 @@
 DVB_DEFINE_MOD_OPT_ADAPTER_NR(adapter_nr);
 
 
-void saa716x_dma_start(struct saa716x_dev *saa716x, u8 adapter)
+static unsigned int idle_stop_ms = 1000;
+module_param(idle_stop_ms, uint, 0644);
+MODULE_PARM_DESC(idle_stop_ms,
+	"keep the TS DMA running for this long after the last feed stopped (ms, 0=stop at once)");
+
+static unsigned int watchdog_ms = 1000;
+module_param(watchdog_ms, uint, 0644);
+MODULE_PARM_DESC(watchdog_ms,
+	"re-init a port that delivered no TS buffer for this long while locked (ms, 0=off)");
+
+static inline u32 saa716x_adap_fgpi(struct saa716x_adapter *saa716x_adap)
+{
+	struct saa716x_config *config = saa716x_adap->saa716x->config;
+
+	return config->adap_config[saa716x_adap->count].ts_fgpi;
+}
+
+static inline struct saa716x_fgpi_stream_port *
+saa716x_adap_port(struct saa716x_adapter *saa716x_adap)
+{
+	return &saa716x_adap->saa716x->fgpi[saa716x_adap_fgpi(saa716x_adap)];
+}
+
+static int saa716x_dma_start(struct saa716x_dev *saa716x, u8 adapter)
 {
 	struct fgpi_stream_params params;
 
@@ -35,12 +70,12 @@ void saa716x_dma_start(struct saa716x_dev *saa716x, u8 adapter)
 	params.stream_type	= FGPI_TRANSPORT_STREAM;
 	params.stream_flags	= 0;
 
-	saa716x_fgpi_start(saa716x,
-			   saa716x->config->adap_config[adapter].ts_fgpi,
-			   &params);
+	return saa716x_fgpi_start(saa716x,
+				  saa716x->config->adap_config[adapter].ts_fgpi,
+				  &params);
 }
 
-void saa716x_dma_stop(struct saa716x_dev *saa716x, u8 adapter)
+static void saa716x_dma_stop(struct saa716x_dev *saa716x, u8 adapter)
 {
 	pci_dbg(saa716x->pdev, "Stop DMA engine for Adapter:%d", adapter);
 
@@ -48,6 +83,267 @@ void saa716x_dma_stop(struct saa716x_dev *saa716x, u8 adapter)
 			  saa716x->config->adap_config[adapter].ts_fgpi);
 }
 
+/* a running DMA keeps the device out of runtime suspend */
+static int saa716x_dma_on(struct saa716x_adapter *saa716x_adap)
+{
+	struct saa716x_dev *saa716x = saa716x_adap->saa716x;
+	struct device *dev = &saa716x->pdev->dev;
+	int ret;
+
+	ret = pm_runtime_get_sync(dev);
+	if (ret < 0 && ret != -EACCES) {
+		pm_runtime_put_noidle(dev);
+		return ret;
+	}
+
+	ret = saa716x_dma_start(saa716x, saa716x_adap->count);
+	if (ret < 0) {
+		saa716x_fgpi_invalidate(saa716x,
+					saa716x_adap_fgpi(saa716x_adap));
+		pm_runtime_put_autosuspend(dev);
+		return ret;
+	}
+	saa716x_adap->dma_active = 1;
+	saa716x_adap->dma_dead = 0;
+
+	return 0;
+}
+
+static void saa716x_dma_off(struct saa716x_adapter *saa716x_adap)
+{
+	struct saa716x_dev *saa716x = saa716x_adap->saa716x;
+	struct device *dev = &saa716x->pdev->dev;
+
+	saa716x_dma_stop(saa716x, saa716x_adap->count);
+	saa716x_adap->dma_active = 0;
+
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
+}
+
+/*
+ * A channel change closes all feeds and opens new ones right after
+ * retuning. Keeping the DMA running for a grace period turns this into
+ * a hot restart without touching the hardware at all.
+ */
+static void saa716x_dma_idle_work(struct work_struct *work)
+{
+	struct saa716x_adapter *saa716x_adap = container_of(work,
+				struct saa716x_adapter, idle_work.work);
+	struct saa716x_dev *saa716x = saa716x_adap->saa716x;
+
+	mutex_lock(&saa716x_adap->demux.mutex);
+	if (!saa716x_adap->feeds && saa716x_adap->dma_active)
+		saa716x_dma_off(saa716x_adap);
+	mutex_unlock(&saa716x_adap->demux.mutex);
+}
+
+static void saa716x_wdog_kick(struct saa716x_adapter *saa716x_adap)
+{
+	if (!watchdog_ms)
+		return;
+
+	saa716x_adap->wdog_buffers =
+		READ_ONCE(saa716x_adap_port(saa716x_adap)->hot.buffers);
+	saa716x_adap->wdog_stamp = jiffies;
+	mod_delayed_work(system_wq, &saa716x_adap->wdog_work,
+			 msecs_to_jiffies(watchdog_ms / 2));
+}
+
+/*
+ * Only this port: stop, rebuild BAM/MMU setup and start cold. A port
+ * that does not start again is left off as by dma_off.
+ */
+static int saa716x_wdog_recover(struct saa716x_adapter *saa716x_adap)
+{
+	struct saa716x_dev *saa716x = saa716x_adap->saa716x;
+	struct device *dev = &saa716x->pdev->dev;
+	struct saa716x_wdog_stats *wdog = &saa716x_adap->wdog;
+	u32 port = saa716x_adap_fgpi(saa716x_adap);
+	ktime_t start = ktime_get();
+	u32 us;
+	int ret;
+
+	tasklet_disable(&saa716x->fgpi[port].tasklet);
+
+	saa716x_dma_stop(saa716x, saa716x_adap->count);
+	saa716x_fgpi_invalidate(saa716x, port);
+	ret = saa716x_dma_start(saa716x, saa716x_adap->count);
+
+	tasklet_enable(&saa716x->fgpi[port].tasklet);
+
+	if (ret < 0) {
+		pci_err(saa716x->pdev, "adapter %d: port %u re-init failed",
+			saa716x_adap->count, port);
+		saa716x_fgpi_invalidate(saa716x, port);
+		wdog->failed++;
+
+		saa716x_adap->dma_active = 0;
+		saa716x_adap->dma_dead = 1;
+		pm_runtime_mark_last_busy(dev);
+		pm_runtime_put_autosuspend(dev);
+		return ret;
+	}
+
+	us = ktime_us_delta(ktime_get(), start);
+	wdog->last_us = us;
+	if (us > wdog->max_us)
+		wdog->max_us = us;
+	wdog->recoveries++;
+	saa716x_timeline_add(saa716x, "wdog_recover", port, start);
+
+	return 0;
+}
+
+static void saa716x_wdog_work(struct work_struct *work)
+{
+	struct saa716x_adapter *saa716x_adap = container_of(work,
+				struct saa716x_adapter, wdog_work.work);
+	struct saa716x_dev *saa716x = saa716x_adap->saa716x;
+	struct dvb_frontend *fe = saa716x_adap->fe;
+	enum fe_status status = FE_HAS_LOCK;
+	unsigned long timeout = msecs_to_jiffies(watchdog_ms);
+	u32 buffers;
+
+	mutex_lock(&saa716x_adap->demux.mutex);
+	if (!watchdog_ms || !saa716x_adap->feeds ||
+	    !saa716x_adap->dma_active)
+		goto out;
+
+	buffers = READ_ONCE(saa716x_adap_port(saa716x_adap)->hot.buffers);
+	if (buffers != saa716x_adap->wdog_buffers) {
+		saa716x_adap->wdog_buffers = buffers;
+		saa716x_adap->wdog_stamp = jiffies;
+		goto resched;
+	}
+
+	if (time_before(jiffies, saa716x_adap->wdog_stamp + timeout))
+		goto resched;
+
+	/*
+	 * A port without lock has nothing to deliver. A frontend that does
+	 * not answer says nothing about the lock, the check waits a round.
+	 */
+	if (fe && fe->ops.read_status && fe->ops.read_status(fe, &status)) {
+		saa716x_adap->wdog_stamp = jiffies;
+		goto resched;
+	}
+
+	if (!(status & FE_HAS_LOCK)) {
+		saa716x_adap->wdog.no_lock++;
+	} else {
+		pci_err(saa716x->pdev, "adapter %d: DMA stalled for %u ms, re-init",
+			saa716x_adap->count, jiffies_to_msecs(jiffies -
+						saa716x_adap->wdog_stamp));
+		saa716x_adap->wdog.stalls++;
+		if (saa716x_wdog_recover(saa716x_adap) < 0)
+			goto out;
+	}
+	saa716x_adap->wdog_stamp = jiffies;
+
+resched:
+	schedule_delayed_work(&saa716x_adap->wdog_work, timeout / 2);
+out:
+	mutex_unlock(&saa716x_adap->demux.mutex);
+}
+
+/*
+ * The buffers the idle DMA filled before the zap are from the old mux,
+ * the new feeds start at the buffer being written now.
+ */
+static void saa716x_stream_skip(struct saa716x_adapter *saa716x_adap)
+{
+	struct saa716x_fgpi_stream_port *fgpi;
+	int write_index;
+
+	fgpi = saa716x_adap_port(saa716x_adap);
+	tasklet_disable(&fgpi->tasklet);
+	write_index = saa716x_fgpi_get_write_index(saa716x_adap->saa716x,
+					saa716x_adap_fgpi(saa716x_adap));
+	if (write_index >= 0) {
+		fgpi->hot.read_index = write_index;
+		fgpi->hot.last_time = 0;
+	}
+	tasklet_enable(&fgpi->tasklet);
+}
+
+/*
+ * The DMA runs as long as anybody consumes the stream: demux feeds or
+ * a reader of the timestamped output. Called with the demux mutex held.
+ */
+static int __saa716x_stream_get(struct saa716x_adapter *saa716x_adap)
+{
+	struct saa716x_dev *saa716x = saa716x_adap->saa716x;
+	int ret;
+
+	saa716x_adap->feeds++;
+	pci_dbg(saa716x->pdev, "start feed, feeds=%d",
+		saa716x_adap->feeds);
+
+	if (saa716x_adap->feeds == 1) {
+		/* demux mutex is held, a running idle work just finds feeds */
+		cancel_delayed_work(&saa716x_adap->idle_work);
+
+		saa716x_adap->zap_start = ktime_get();
+		saa716x_adap->zap_pending = 1;
+
+		if (saa716x_adap->dma_active) {
+			pci_dbg(saa716x->pdev, "start feed, dma still running");
+			saa716x_adap->zap.hot++;
+			saa716x_stream_skip(saa716x_adap);
+		} else {
+			pci_dbg(saa716x->pdev, "start feed & dma");
+			ret = saa716x_dma_on(saa716x_adap);
+			if (ret < 0) {
+				saa716x_adap->zap_pending = 0;
+				saa716x_adap->feeds--;
+				return ret;
+			}
+		}
+		saa716x_wdog_kick(saa716x_adap);
+	}
+
+	return saa716x_adap->feeds;
+}
+
+static void __saa716x_stream_put(struct saa716x_adapter *saa716x_adap)
+{
+	struct saa716x_dev *saa716x = saa716x_adap->saa716x;
+
+	saa716x_adap->feeds--;
+	if (saa716x_adap->feeds == 0) {
+		saa716x_adap->zap_pending = 0;
+		if (idle_stop_ms) {
+			pci_dbg(saa716x->pdev, "stop feed, dma idle");
+			schedule_delayed_work(&saa716x_adap->idle_work,
+					      msecs_to_jiffies(idle_stop_ms));
+		} else if (saa716x_adap->dma_active) {
+			pci_dbg(saa716x->pdev, "stop feed and dma");
+			saa716x_dma_off(saa716x_adap);
+		}
+	}
+}
+
+int saa716x_stream_get(struct saa716x_adapter *saa716x_adap)
+{
+	int ret;
+
+	mutex_lock(&saa716x_adap->demux.mutex);
+	ret = __saa716x_stream_get(saa716x_adap);
+	mutex_unlock(&saa716x_adap->demux.mutex);
+
+	return ret < 0 ? ret : 0;
+}
+EXPORT_SYMBOL_GPL(saa716x_stream_get);
+
+void saa716x_stream_put(struct saa716x_adapter *saa716x_adap)
+{
+	mutex_lock(&saa716x_adap->demux.mutex);
+	__saa716x_stream_put(saa716x_adap);
+	mutex_unlock(&saa716x_adap->demux.mutex);
+}
+EXPORT_SYMBOL_GPL(saa716x_stream_put);
+
 static int saa716x_dvb_start_feed(struct dvb_demux_feed *dvbdmxfeed)
 {
 	struct dvb_demux *dvbdmx		= dvbdmxfeed->demux;
@@ -59,16 +355,8 @@ static int saa716x_dvb_start_feed(struct dvb_demux_feed *dvbdmxfeed)
 		pci_dbg(saa716x->pdev, "no frontend ?");
 		return -EINVAL;
 	}
-	saa716x_adap->feeds++;
-	pci_dbg(saa716x->pdev, "start feed, feeds=%d",
-		saa716x_adap->feeds);
 
-	if (saa716x_adap->feeds == 1) {
-		pci_dbg(saa716x->pdev, "start feed & dma");
-		saa716x_dma_start(saa716x, saa716x_adap->count);
-	}
-
-	return saa716x_adap->feeds;
+	return __saa716x_stream_get(saa716x_adap);
 }
 
 static int saa716x_dvb_stop_feed(struct dvb_demux_feed *dvbdmxfeed)
@@ -82,72 +370,422 @@ static int saa716x_dvb_stop_feed(struct dvb_demux_feed *dvbdmxfeed)
 		pci_dbg(saa716x->pdev, "no frontend ?");
 		return -EINVAL;
 	}
-	saa716x_adap->feeds--;
-	if (saa716x_adap->feeds == 0) {
-		pci_dbg(saa716x->pdev, "stop feed and dma");
-		saa716x_dma_stop(saa716x, saa716x_adap->count);
-	}
+	__saa716x_stream_put(saa716x_adap);
 
 	return 0;
 }
 
+/* time from the first feed to the first TS buffer handed to the demux */
+static void saa716x_zap_done(struct saa716x_adapter *saa716x_adap)
+{
+	struct saa716x_zap_stats *zap = &saa716x_adap->zap;
+	u32 us;
+
+	us = ktime_us_delta(ktime_get(), saa716x_adap->zap_start);
+	saa716x_adap->zap_pending = 0;
+
+	zap->last_us = us;
+	if (!zap->count || us < zap->min_us)
+		zap->min_us = us;
+	if (us > zap->max_us)
+		zap->max_us = us;
+	zap->total_us += us;
+	zap->count++;
+}
+
 static void saa716x_demux_worker(unsigned long data)
 {
 	struct saa716x_fgpi_stream_port *fgpi_entry =
 				 (struct saa716x_fgpi_stream_port *)data;
 	struct saa716x_dev *saa716x = fgpi_entry->saa716x;
-	struct dvb_demux *demux;
-	u32 fgpi_index;
-	u32 i;
-	u32 write_index;
-
-	fgpi_index = fgpi_entry->dma_channel - 6;
-	demux = NULL;
-	for (i = 0; i < saa716x->config->adapters; i++) {
-		if (saa716x->config->adap_config[i].ts_fgpi == fgpi_index) {
-			demux = &saa716x->saa716x_adap[i].demux;
-			break;
-		}
-	}
-	if (demux == NULL) {
-		pci_err(saa716x->pdev, "%s: unexpected channel %u",
-		       __func__, fgpi_entry->dma_channel);
-		return;
-	}
+	struct saa716x_fgpi_hot *hot = &fgpi_entry->hot;
+	struct saa716x_adapter *saa716x_adap = hot->priv;
+	struct dvb_demux *demux = &saa716x_adap->demux;
+	ktime_t start, end;
+	int write_index;
+	int count;
+	u32 step;
 
-	write_index = saa716x_fgpi_get_write_index(saa716x, fgpi_index);
+	write_index = saa716x_fgpi_get_write_index(saa716x, hot->port);
 	if (write_index < 0)
 		return;
 
 	pci_dbg(saa716x->pdev, "dma buffer = %d", write_index);
 
-	if (write_index == fgpi_entry->read_index) {
+	if (cpu_to_node(smp_processor_id()) ==
+	    dev_to_node(&saa716x->pdev->dev))
+		hot->bh_local++;
+	else
+		hot->bh_remote++;
+
+	if (write_index == hot->read_index) {
 		pci_dbg(saa716x->pdev,
 			"%s: called but nothing to do", __func__);
 		return;
 	}
 
+	/*
+	 * Only the TAGACK of the newest buffer is timed, buffers completed
+	 * since the last run share the time since the previous one.
+	 */
+	count = (write_index - hot->read_index) & 7;
+	end = READ_ONCE(hot->tag_time);
+	start = hot->last_time;
+	if (!start || ktime_after(start, end))
+		start = ktime_sub_ns(end, (u64)hot->buf_ns * count);
+	step = min_t(u64, div_u64(ktime_to_ns(ktime_sub(end, start)), count),
+		     U32_MAX);
+	if (hot->last_time)
+		hot->buf_ns = hot->buf_ns ?
+			((u64)hot->buf_ns * 7 + step) / 8 : step;
+
 	do {
-		u8 *data =
-		 (u8 *)fgpi_entry->dma_buf[fgpi_entry->read_index].mem_virt;
+		u8 *data = (u8 *)hot->buf[hot->read_index].mem_virt;
 
 		pci_dma_sync_sg_for_cpu(saa716x->pdev,
-			fgpi_entry->dma_buf[fgpi_entry->read_index].sg_list,
-			fgpi_entry->dma_buf[fgpi_entry->read_index].list_len,
+			hot->buf[hot->read_index].sg_list,
+			hot->buf[hot->read_index].list_len,
+			PCI_DMA_FROMDEVICE);
+
+		saa716x_pidstats_feed(&saa716x_adap->pidstats, data, 348);
+		saa716x_psi_feed(&saa716x_adap->psi, data, 348);
+		saa716x_streamer_feed(READ_ONCE(saa716x_adap->streamer),
+				      data, 348, start,
+				      ktime_add_ns(start, step));
+		if (!saa716x_bpf_run(saa716x_adap, data, 348, start,
+				     ktime_add_ns(start, step))) {
+			dvb_dmx_swfilter(demux, data, 348 * 188);
+			saa716x_m2ts_feed(&saa716x_adap->m2ts, data, 348,
+					  start, ktime_add_ns(start, step));
+		}
+		start = ktime_add_ns(start, step);
+
+		/* XDP may have rewritten the packets, hand the buffer back */
+		pci_dma_sync_sg_for_device(saa716x->pdev,
+			hot->buf[hot->read_index].sg_list,
+			hot->buf[hot->read_index].list_len,
 			PCI_DMA_FROMDEVICE);
 
-		dvb_dmx_swfilter(demux, data, 348 * 188);
+		hot->read_index = (hot->read_index + 1) & 7;
+		hot->buffers++;
+		hot->bytes += 348 * 188;
+	} while (write_index != hot->read_index);
+	hot->last_time = end;
+
+	if (saa716x_adap->zap_pending)
+		saa716x_zap_done(saa716x_adap);
+
+	if (saa716x_adap->resume_pending) {
+		saa716x_adap->resume_pending = 0;
+		saa716x_adap->resume_us = ktime_us_delta(ktime_get(),
+						saa716x_adap->resume_start);
+		saa716x_timeline_add(saa716x, "resume_first_packet",
+				     saa716x_adap->count,
+				     saa716x_adap->resume_start);
+	}
+}
+
+static int saa716x_zap_show(struct seq_file *s, void *unused)
+{
+	struct saa716x_adapter *saa716x_adap = s->private;
+	struct saa716x_dev *saa716x = saa716x_adap->saa716x;
+	struct saa716x_zap_stats *zap = &saa716x_adap->zap;
+	struct saa716x_fgpi_stream_port *fgpi;
+
+	fgpi = &saa716x->fgpi[saa716x_adap_fgpi(saa716x_adap)];
+
+	seq_printf(s, "dma active:  %u\n", saa716x_adap->dma_active);
+	seq_printf(s, "cold starts: %u\n", fgpi->cold_starts);
+	seq_printf(s, "warm starts: %u\n", fgpi->warm_starts);
+	seq_printf(s, "hot starts:  %u\n", zap->hot);
+	seq_printf(s, "zaps:        %u\n", zap->count);
+	if (zap->count)
+		seq_printf(s, "zap [us]:    last %u min %u avg %llu max %u\n",
+			   zap->last_us, zap->min_us,
+			   div_u64(zap->total_us, zap->count), zap->max_us);
 
-		fgpi_entry->read_index = (fgpi_entry->read_index + 1) & 7;
-	} while (write_index != fgpi_entry->read_index);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(saa716x_zap);
+
+static int saa716x_wdog_show(struct seq_file *s, void *unused)
+{
+	struct saa716x_adapter *saa716x_adap = s->private;
+	struct saa716x_wdog_stats *wdog = &saa716x_adap->wdog;
+
+	seq_printf(s, "buffers:       %u\n",
+		   READ_ONCE(saa716x_adap_port(saa716x_adap)->hot.buffers));
+	seq_printf(s, "stalls:        %u\n", wdog->stalls);
+	seq_printf(s, "no lock:       %u\n", wdog->no_lock);
+	seq_printf(s, "recoveries:    %u\n", wdog->recoveries);
+	seq_printf(s, "failed:        %u\n", wdog->failed);
+	seq_printf(s, "port dead:     %u\n", saa716x_adap->dma_dead);
+	seq_printf(s, "recovery [us]: last %u max %u\n",
+		   wdog->last_us, wdog->max_us);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(saa716x_wdog);
+
+static int saa716x_m2ts_show(struct seq_file *s, void *unused)
+{
+	struct saa716x_adapter *saa716x_adap = s->private;
+	struct saa716x_m2ts *m2ts = &saa716x_adap->m2ts;
+
+	seq_printf(s, "device:      %s\n", m2ts->name);
+	seq_printf(s, "buffer [us]: %u\n",
+		   READ_ONCE(saa716x_adap_port(saa716x_adap)->hot.buf_ns) /
+		   NSEC_PER_USEC);
+	seq_printf(s, "packets:     %u\n", m2ts->packets);
+	seq_printf(s, "overflows:   %u\n", m2ts->overflows);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(saa716x_m2ts);
+
+/* an open frontend keeps the device out of runtime suspend */
+static int saa716x_fe_ts_bus_ctrl(struct dvb_frontend *fe, int acquire)
+{
+	struct saa716x_adapter *saa716x_adap = fe->dvb->priv;
+	struct device *dev = &saa716x_adap->saa716x->pdev->dev;
+	int ret;
+
+	if (!acquire) {
+		pm_runtime_mark_last_busy(dev);
+		pm_runtime_put_autosuspend(dev);
+		return 0;
+	}
+
+	ret = pm_runtime_get_sync(dev);
+	if (ret < 0 && ret != -EACCES) {
+		pm_runtime_put_noidle(dev);
+		return ret;
+	}
+
+	return 0;
+}
+
+/* firmware downloads keep the statistics refresh off the bus */
+static int saa716x_fe_init(struct dvb_frontend *fe)
+{
+	struct saa716x_adapter *saa716x_adap = fe->dvb->priv;
+	bool locked;
+	int ret;
+
+	saa716x_fe_stats_invalidate(&saa716x_adap->fe_stats);
+
+	locked = saa716x_fe_lock(&saa716x_adap->fe_stats);
+	ret = saa716x_adap->fe_ops.init(fe);
+	saa716x_fe_unlock(&saa716x_adap->fe_stats, locked);
+
+	return ret;
+}
+
+/*
+ * a retune makes everything cached about the old mux stale, and its
+ * I2C transfers, the tuner's included, go ahead of the others
+ */
+static int saa716x_fe_set_frontend(struct dvb_frontend *fe)
+{
+	struct saa716x_adapter *saa716x_adap = fe->dvb->priv;
+	bool locked;
+	int ret;
+
+	/* under the lock, a status read waits for the new tune */
+	locked = saa716x_fe_lock(&saa716x_adap->fe_stats);
+	saa716x_fe_stats_invalidate(&saa716x_adap->fe_stats);
+	saa716x_psi_invalidate(&saa716x_adap->psi);
+
+	WRITE_ONCE(saa716x_adap->tune_task, current);
+	ret = saa716x_adap->fe_ops.set_frontend(fe);
+	WRITE_ONCE(saa716x_adap->tune_task, NULL);
+	saa716x_fe_unlock(&saa716x_adap->fe_stats, locked);
+
+	return ret;
+}
+
+static int saa716x_fe_tune(struct dvb_frontend *fe, bool re_tune,
+			   unsigned int mode_flags, unsigned int *delay,
+			   enum fe_status *status)
+{
+	struct saa716x_adapter *saa716x_adap = fe->dvb->priv;
+	bool locked;
+	u32 epoch;
+	int ret;
+
+	locked = saa716x_fe_lock(&saa716x_adap->fe_stats);
+
+	/* without re_tune the frontend thread only polls the status */
+	if (!re_tune) {
+		epoch = saa716x_psi_epoch(&saa716x_adap->psi);
+		ret = saa716x_adap->fe_ops.tune(fe, re_tune, mode_flags,
+						delay, status);
+		goto out;
+	}
+
+	saa716x_fe_stats_invalidate(&saa716x_adap->fe_stats);
+	saa716x_psi_invalidate(&saa716x_adap->psi);
+	epoch = saa716x_psi_epoch(&saa716x_adap->psi);
+
+	WRITE_ONCE(saa716x_adap->tune_task, current);
+	ret = saa716x_adap->fe_ops.tune(fe, re_tune, mode_flags, delay,
+					status);
+	WRITE_ONCE(saa716x_adap->tune_task, NULL);
+out:
+	saa716x_fe_unlock(&saa716x_adap->fe_stats, locked);
+	if (!ret)
+		saa716x_psi_status(&saa716x_adap->psi, epoch, *status);
+
+	return ret;
+}
+
+/*
+ * dvb-core only calls fe->ops. The demod driver's ops are kept in a
+ * copy per adapter that the wrappers call, fe->ops gets them back
+ * before the frontend is detached.
+ */
+static void saa716x_fe_hook(struct saa716x_adapter *saa716x_adap)
+{
+	struct dvb_frontend_ops *ops = &saa716x_adap->fe->ops;
+
+	saa716x_adap->fe_ops = *ops;
+
+	if (!ops->ts_bus_ctrl)
+		ops->ts_bus_ctrl = saa716x_fe_ts_bus_ctrl;
+	if (ops->init)
+		ops->init = saa716x_fe_init;
+	if (ops->set_frontend)
+		ops->set_frontend = saa716x_fe_set_frontend;
+	if (ops->tune)
+		ops->tune = saa716x_fe_tune;
+
+	saa716x_fe_stats_hook(saa716x_adap);
+}
+
+static void saa716x_fe_unhook(struct saa716x_adapter *saa716x_adap)
+{
+	saa716x_adap->fe->ops = saa716x_adap->fe_ops;
+}
+
+struct saa716x_fe_attach {
+	struct work_struct	work;
+	struct saa716x_dev	*saa716x;
+	u32			i2c_bus;
+};
+
+static void saa716x_fe_attach_work(struct work_struct *work)
+{
+	struct saa716x_fe_attach *fa = container_of(work,
+					struct saa716x_fe_attach, work);
+	struct saa716x_dev *saa716x = fa->saa716x;
+	struct saa716x_config *config = saa716x->config;
+	ktime_t start;
+	int i;
+
+	for (i = 0; i < config->adapters; i++) {
+		if (config->adap_config[i].i2c_bus != fa->i2c_bus)
+			continue;
+
+		start = ktime_get();
+		if (config->frontend_attach(&saa716x->saa716x_adap[i], i) < 0)
+			pci_err(saa716x->pdev, "frontend %d attach failed", i);
+		saa716x_timeline_add(saa716x, "frontend_attach", i, start);
+	}
+}
+
+/*
+ * Frontends on different I2C buses do not share anything, so reset and
+ * firmware download run on one work item per bus. All of them have to
+ * finish before the frontends get registered.
+ */
+static void saa716x_frontend_attach(struct saa716x_dev *saa716x)
+{
+	struct saa716x_fe_attach fa[SAA716x_I2C_ADAPTERS];
+	int i;
+
+	for (i = 0; i < SAA716x_I2C_ADAPTERS; i++) {
+		fa[i].saa716x = saa716x;
+		fa[i].i2c_bus = i;
+		INIT_WORK_ONSTACK(&fa[i].work, saa716x_fe_attach_work);
+		queue_work(system_unbound_wq, &fa[i].work);
+	}
+
+	for (i = 0; i < SAA716x_I2C_ADAPTERS; i++) {
+		flush_work(&fa[i].work);
+		destroy_work_on_stack(&fa[i].work);
+	}
+}
+
+/*
+ * The board config decides which FGPI feeds which adapter. Reject what
+ * the hardware cannot do here instead of in the stream path.
+ */
+static int saa716x_dispatch_check(struct saa716x_dev *saa716x)
+{
+	struct saa716x_config *config = saa716x->config;
+	struct saa716x_adap_config *adap_config;
+	unsigned long ports = 0;
+	int i;
+
+	if (config->adapters < 0 || config->adapters > SAA716x_MAX_ADAPTERS)
+		goto err;
+
+	for (i = 0; i < config->adapters; i++) {
+		adap_config = &config->adap_config[i];
+
+		if (adap_config->ts_fgpi >= ARRAY_SIZE(saa716x->fgpi) ||
+		    __test_and_set_bit(adap_config->ts_fgpi, &ports) ||
+		    !GREG_FGPI_CTRL_SEL(adap_config->ts_vp) ||
+		    adap_config->i2c_bus >= SAA716x_I2C_ADAPTERS) {
+			pci_err(saa716x->pdev,
+				"adapter %d: invalid port config vp %u fgpi %u i2c %u",
+				i, adap_config->ts_vp, adap_config->ts_fgpi,
+				adap_config->i2c_bus);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+err:
+	pci_err(saa716x->pdev, "invalid number of adapters %d",
+		config->adapters);
+	return -EINVAL;
+}
+
+/* MSI TAGACK bit -> FGPI port -> adapter, fixed after probe */
+static void saa716x_dispatch_init(struct saa716x_dev *saa716x)
+{
+	struct saa716x_config *config = saa716x->config;
+	struct saa716x_dispatch *entry;
+	struct saa716x_fgpi_stream_port *fgpi;
+	int i, bit;
+
+	for (i = 0; i < config->adapters; i++) {
+		fgpi = &saa716x->fgpi[config->adap_config[i].ts_fgpi];
+		fgpi->hot.priv = &saa716x->saa716x_adap[i];
+
+		bit = saa716x_fgpi_msi_bit(config->adap_config[i].ts_fgpi);
+		entry = &saa716x->dispatch[bit];
+		entry->tasklet = &fgpi->tasklet;
+		entry->tag_time = &fgpi->hot.tag_time;
+		entry->fgpi = fgpi;
+		entry->adapter = &saa716x->saa716x_adap[i];
+
+		saa716x->dispatch_l |= BIT(bit);
+	}
 }
 
 int saa716x_dvb_init(struct saa716x_dev *saa716x)
 {
 	struct saa716x_adapter *saa716x_adap = saa716x->saa716x_adap;
 	struct saa716x_config *config = saa716x->config;
+	char name[16];
 	int result, i;
 
+	result = saa716x_dispatch_check(saa716x);
+	if (result < 0)
+		return result;
+
 	/* all video input ports use their own clocks */
 	SAA716x_EPWR(GREG, GREG_VI_CTRL, 0x2C688000);
 	SAA716x_EPWR(GREG, GREG_FGPI_CTRL, 0);
@@ -162,6 +800,7 @@ int saa716x_dvb_init(struct saa716x_dev *saa716x)
 					 adapter_nr) < 0) {
 
 			pci_err(saa716x->pdev, "Error registering adapter");
+			saa716x_dvb_exit(saa716x);
 			return -ENODEV;
 		}
 
@@ -226,32 +865,25 @@ int saa716x_dvb_init(struct saa716x_dev *saa716x)
 
 		dvb_net_init(&saa716x_adap->dvb_adapter, &saa716x_adap->dvb_net,
 			     &saa716x_adap->demux.dmx);
-		pci_dbg(saa716x->pdev, "Frontend Init");
 		saa716x_adap->saa716x = saa716x;
+		INIT_DELAYED_WORK(&saa716x_adap->idle_work,
+				  saa716x_dma_idle_work);
+		INIT_DELAYED_WORK(&saa716x_adap->wdog_work, saa716x_wdog_work);
 
-		if (config->frontend_attach) {
-			result = config->frontend_attach(saa716x_adap, i);
-			if (result < 0)
-				pci_err(saa716x->pdev, "frontend attach failed");
-
-			if (saa716x_adap->fe == NULL) {
-				pci_err(saa716x->pdev, "A frontend driver was not found for [%04x:%04x] subsystem [%04x:%04x]",
-					saa716x->pdev->vendor,
-					saa716x->pdev->device,
-					saa716x->pdev->subsystem_vendor,
-					saa716x->pdev->subsystem_device);
-			} else {
-				result = dvb_register_frontend(
-				  &saa716x_adap->dvb_adapter, saa716x_adap->fe);
-				if (result < 0) {
-					pci_err(saa716x->pdev, "register frontend failed");
-					goto err6;
-				}
-			}
+		snprintf(name, sizeof(name), "adapter%d", i);
+		saa716x_adap->debugfs = debugfs_create_dir(name,
+							   saa716x->debugfs);
+		debugfs_create_file("zap", 0444, saa716x_adap->debugfs,
+				    saa716x_adap, &saa716x_zap_fops);
+		debugfs_create_file("watchdog", 0444, saa716x_adap->debugfs,
+				    saa716x_adap, &saa716x_wdog_fops);
+		debugfs_create_file("m2ts", 0444, saa716x_adap->debugfs,
+				    saa716x_adap, &saa716x_m2ts_fops);
 
-		} else {
-			pci_err(saa716x->pdev, "Frontend attach = NULL");
-		}
+		saa716x_pidstats_init(saa716x_adap);
+		saa716x_psi_init(saa716x_adap);
+		saa716x_fe_stats_init(saa716x_adap);
+		saa716x_bpf_init(saa716x_adap);
 
 		/* assign video port to fgpi */
 		SAA716x_EPWR(GREG, GREG_FGPI_CTRL,
@@ -263,15 +895,68 @@ int saa716x_dvb_init(struct saa716x_dev *saa716x)
 				  SAA716X_TS_DMA_BUF_SIZE,
 				  saa716x_demux_worker);
 
+		saa716x_adap->registered = 1;
 		saa716x_adap++;
 	}
+	saa716x_dispatch_init(saa716x);
 
+	/* the ports are set up, userspace may start streams from here on */
+	saa716x_adap = saa716x->saa716x_adap;
+	for (i = 0; i < config->adapters; i++, saa716x_adap++) {
+		if (saa716x_m2ts_init(saa716x_adap) < 0)
+			pci_err(saa716x->pdev,
+				"adapter %d: timestamped output not available",
+				i);
+		saa716x_psi_register(saa716x_adap);
+		if (saa716x_streamer_init(saa716x_adap) < 0)
+			pci_err(saa716x->pdev,
+				"adapter %d: streamer not available", i);
+	}
+
+	pci_dbg(saa716x->pdev, "Frontend Init");
+	if (!config->frontend_attach) {
+		pci_err(saa716x->pdev, "Frontend attach = NULL");
+		return 0;
+	}
+	saa716x_frontend_attach(saa716x);
+
+	saa716x_adap = saa716x->saa716x_adap;
+	for (i = 0; i < config->adapters; i++, saa716x_adap++) {
+		if (saa716x_adap->fe == NULL) {
+			pci_err(saa716x->pdev, "A frontend driver was not found for [%04x:%04x] subsystem [%04x:%04x]",
+				saa716x->pdev->vendor,
+				saa716x->pdev->device,
+				saa716x->pdev->subsystem_vendor,
+				saa716x->pdev->subsystem_device);
+			continue;
+		}
+
+		saa716x_fe_hook(saa716x_adap);
+
+		result = dvb_register_frontend(&saa716x_adap->dvb_adapter,
+					       saa716x_adap->fe);
+		if (result < 0) {
+			pci_err(saa716x->pdev, "register frontend failed");
+			goto err_fe;
+		}
+	}
+
+	saa716x_fe_stats_start(saa716x);
 
 	return 0;
 
 	/* Error conditions */
-err6:
-	dvb_frontend_detach(saa716x_adap->fe);
+err_fe:
+	/* attached from here on, but not registered */
+	for (; i < config->adapters; i++, saa716x_adap++) {
+		dvb_module_release(saa716x_adap->i2c_client_tuner);
+		dvb_module_release(saa716x_adap->i2c_client_demod);
+		saa716x_adap->i2c_client_tuner = NULL;
+		saa716x_adap->i2c_client_demod = NULL;
+		saa716x_adap->fe = NULL;
+	}
+	saa716x_dvb_exit(saa716x);
+	return result;
 err4:
 	saa716x_adap->demux.dmx.remove_frontend(
 			&saa716x_adap->demux.dmx, &saa716x_adap->fe_mem);
@@ -285,6 +970,8 @@ err1:
 err0:
 	dvb_unregister_adapter(&saa716x_adap->dvb_adapter);
 
+	/* and the adapters set up before */
+	saa716x_dvb_exit(saa716x);
 	return result;
 }
 EXPORT_SYMBOL(saa716x_dvb_init);
@@ -294,10 +981,35 @@ void saa716x_dvb_exit(struct saa716x_dev *saa716x)
 	struct saa716x_adapter *saa716x_adap = saa716x->saa716x_adap;
 	int i;
 
-	for (i = 0; i < saa716x->config->adapters; i++) {
+	saa716x_fe_stats_stop(saa716x);
+
+	/* also reached from a failed init, the config may be bad */
+	for (i = 0; i < SAA716x_MAX_ADAPTERS; i++, saa716x_adap++) {
+		if (!saa716x_adap->registered)
+			continue;
+
+		saa716x_m2ts_exit(saa716x_adap);
+		saa716x_psi_unregister(saa716x_adap);
+		saa716x_streamer_exit(saa716x_adap);
+		cancel_delayed_work_sync(&saa716x_adap->wdog_work);
+		cancel_delayed_work_sync(&saa716x_adap->idle_work);
+		if (saa716x_adap->dma_active)
+			saa716x_dma_off(saa716x_adap);
+		debugfs_remove_recursive(saa716x_adap->debugfs);
+		saa716x_adap->debugfs = NULL;
 
 		saa716x_fgpi_exit(saa716x,
 				  saa716x->config->adap_config[i].ts_fgpi);
+		saa716x_pidstats_exit(saa716x_adap);
+		saa716x_psi_exit(saa716x_adap);
+		saa716x_bpf_exit(saa716x_adap);
+
+		/* the frontend lives in the demod's state */
+		if (saa716x_adap->fe) {
+			dvb_unregister_frontend(saa716x_adap->fe);
+			saa716x_fe_unhook(saa716x_adap);
+			dvb_frontend_detach(saa716x_adap->fe);
+		}
 
 		/* remove I2C tuner if available */
 		dvb_module_release(saa716x_adap->i2c_client_tuner);
@@ -305,11 +1017,6 @@ void saa716x_dvb_exit(struct saa716x_dev *saa716x)
 		/* remove I2C demod if available */
 		dvb_module_release(saa716x_adap->i2c_client_demod);
 
-		if (saa716x_adap->fe) {
-			dvb_unregister_frontend(saa716x_adap->fe);
-			dvb_frontend_detach(saa716x_adap->fe);
-		}
-
 		dvb_net_release(&saa716x_adap->dvb_net);
 		saa716x_adap->demux.dmx.remove_frontend(
 			&saa716x_adap->demux.dmx, &saa716x_adap->fe_mem);
@@ -320,8 +1027,67 @@ void saa716x_dvb_exit(struct saa716x_dev *saa716x)
 
 		pci_dbg(saa716x->pdev, "dvb_unregister_adapter");
 		dvb_unregister_adapter(&saa716x_adap->dvb_adapter);
-
-		saa716x_adap++;
+		saa716x_adap->fe = NULL;
+		saa716x_adap->registered = 0;
 	}
 }
 EXPORT_SYMBOL(saa716x_dvb_exit);
+
+/*
+ * The FGPI/BAM/MMU setup does not survive a power down. Running ports
+ * are stopped here and started cold again on resume, an idle DMA kept
+ * for the grace period is just stopped.
+ */
+void saa716x_dvb_suspend(struct saa716x_dev *saa716x)
+{
+	struct saa716x_adapter *saa716x_adap = saa716x->saa716x_adap;
+	u32 port;
+	int i;
+
+	saa716x_fe_stats_stop(saa716x);
+
+	for (i = 0; i < saa716x->config->adapters; i++, saa716x_adap++) {
+		port = saa716x_adap_fgpi(saa716x_adap);
+
+		cancel_delayed_work_sync(&saa716x_adap->wdog_work);
+		cancel_delayed_work_sync(&saa716x_adap->idle_work);
+
+		mutex_lock(&saa716x_adap->demux.mutex);
+		if (saa716x_adap->dma_active) {
+			if (saa716x_adap->feeds)
+				saa716x_dma_stop(saa716x, i);
+			else
+				saa716x_dma_off(saa716x_adap);
+		}
+		saa716x_adap->resume_pending = 0;
+		mutex_unlock(&saa716x_adap->demux.mutex);
+
+		tasklet_kill(&saa716x->fgpi[port].tasklet);
+		saa716x_fgpi_invalidate(saa716x, port);
+	}
+}
+EXPORT_SYMBOL(saa716x_dvb_suspend);
+
+void saa716x_dvb_resume(struct saa716x_dev *saa716x)
+{
+	struct saa716x_adapter *saa716x_adap = saa716x->saa716x_adap;
+	int i;
+
+	for (i = 0; i < saa716x->config->adapters; i++, saa716x_adap++) {
+		mutex_lock(&saa716x_adap->demux.mutex);
+		if (saa716x_adap->dma_active) {
+			saa716x_adap->resume_start = ktime_get();
+			saa716x_adap->resume_pending = 1;
+
+			/* on failure the watchdog keeps trying */
+			if (saa716x_dma_start(saa716x, i) < 0)
+				pci_err(saa716x->pdev,
+					"adapter %d: stream restart failed", i);
+			saa716x_wdog_kick(saa716x_adap);
+		}
+		mutex_unlock(&saa716x_adap->demux.mutex);
+	}
+
+	saa716x_fe_stats_start(saa716x);
+}
+EXPORT_SYMBOL(saa716x_dvb_resume);
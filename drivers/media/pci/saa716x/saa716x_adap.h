@@ -4,8 +4,13 @@
 #define __SAA716x_ADAP_H
 
 struct saa716x_dev;
+struct saa716x_adapter;
 
 extern int saa716x_dvb_init(struct saa716x_dev *saa716x);
 extern void saa716x_dvb_exit(struct saa716x_dev *saa716x);
+extern void saa716x_dvb_suspend(struct saa716x_dev *saa716x);
+extern void saa716x_dvb_resume(struct saa716x_dev *saa716x);
+extern int saa716x_stream_get(struct saa716x_adapter *saa716x_adap);
+extern void saa716x_stream_put(struct saa716x_adapter *saa716x_adap);
 
 #endif /* __SAA716x_ADAP_H */
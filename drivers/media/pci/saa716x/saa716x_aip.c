@@ -0,0 +1,154 @@
+// SPDX-License-Identifier: GPL-2.0+
+
+#include <linux/bitops.h>
+#include <linux/kernel.h>
+
+#include "saa716x_mod.h"
+
+#include "saa716x_aip_reg.h"
+#include "saa716x_dma_reg.h"
+#include "saa716x_msi_reg.h"
+
+#include "saa716x_aip.h"
+#include "saa716x_priv.h"
+
+static const u32 ai_ch[] = {
+	AI0,
+	AI1
+};
+
+static const u32 msi_int_tagack[] = {
+	MSI_INT_TAGACK_AI_0,
+	MSI_INT_TAGACK_AI_1
+};
+
+/* 16 bit stereo from an I2S source that provides the clocks */
+#define AIP_CAP_STEREO16	(0x00000003 << 28)
+#define AIP_SERIAL_I2S_SLAVE	0x00000000
+#define AIP_FRAMING_I2S_64FS	((1 << 13) | (33 << 4))
+
+/* MSI status bit of the TAGACK interrupt of a port */
+int saa716x_aip_msi_bit(int port)
+{
+	return __ffs(msi_int_tagack[port]);
+}
+EXPORT_SYMBOL_GPL(saa716x_aip_msi_bit);
+
+int saa716x_aip_get_write_index(struct saa716x_dev *saa716x, int port)
+{
+	u32 buf_mode;
+
+	buf_mode = SAA716x_EPRD(BAM,
+				BAM_DMA_BUF_MODE(saa716x->aip[port].dma_channel));
+	return (buf_mode >> 3) & 0x7;
+}
+EXPORT_SYMBOL_GPL(saa716x_aip_get_write_index);
+
+/*
+ * Everything that may sleep: BAM and MMU for the periods, the AI block
+ * and the clock. saa716x_aip_start() only has to enable capture then,
+ * which is what the ALSA trigger can do.
+ */
+int saa716x_aip_setparams(struct saa716x_dev *saa716x, int port,
+			  struct aip_stream_params *stream_params)
+{
+	struct saa716x_aip_stream_port *aip = &saa716x->aip[port];
+	u32 ai_port = ai_ch[port];
+	u8 dma_channel = aip->dma_channel;
+	u32 buf_mode = BAM_DMA_BUF_MODE(dma_channel);
+	u32 config = MMU_DMA_CONFIG(dma_channel);
+	u32 val;
+	int i;
+
+	/* reset the AI block, it stays stopped until the trigger */
+	SAA716x_EPWR(ai_port, AI_PWR_DOWN, 0);
+	SAA716x_EPWR(ai_port, AI_CTL, AI_RESET);
+	SAA716x_EPWR(ai_port, AI_CTL, 0);
+
+	/* Reset DMA channel */
+	SAA716x_EPWR(BAM, buf_mode, 0x00000040);
+
+	SAA716x_EPWR(MMU, config, stream_params->periods - 1);
+	for (i = 0; i < stream_params->periods; i++) {
+		SAA716x_EPWR(MMU, MMU_PTA_LSB(dma_channel, i),
+			     PTA_LSB(stream_params->pta[i]));
+		SAA716x_EPWR(MMU, MMU_PTA_MSB(dma_channel, i),
+			     PTA_MSB(stream_params->pta[i]));
+	}
+
+	/* monitor BAM reset */
+	if (SAA716x_EPPOLL(BAM, buf_mode, val, !val, 20, 3000000)) {
+		pci_err(saa716x->pdev, "Error: BAM AI Reset failed!");
+		return -EIO;
+	}
+
+	/* set buffer count, periods need not start on a page */
+	SAA716x_EPWR(BAM, buf_mode, stream_params->periods - 1);
+	for (i = 0; i < AIP_BUFFERS; i++)
+		SAA716x_EPWR(BAM, BAM_ADDR_OFFSET(dma_channel) + i * 4,
+			     i < stream_params->periods ?
+			     stream_params->offset[i] : 0);
+
+	SAA716x_EPWR(ai_port, AI_SERIAL, AIP_SERIAL_I2S_SLAVE);
+	SAA716x_EPWR(ai_port, AI_FRAMING, AIP_FRAMING_I2S_64FS);
+	SAA716x_EPWR(ai_port, AI_BASE1, dma_channel << 21);
+	SAA716x_EPWR(ai_port, AI_BASE2, dma_channel << 21);
+	SAA716x_EPWR(ai_port, AI_SIZE, stream_params->period_bytes);
+
+	val = SAA716x_EPRD(MMU, config);
+	SAA716x_EPWR(MMU, config, val & ~0x40);
+	SAA716x_EPWR(MMU, config, val | 0x40);
+
+	if (SAA716x_EPPOLL(MMU, config, val, val & 0x80, 20, 5000000)) {
+		pci_err(saa716x->pdev, "Error: PTE pre-fetch failed!");
+		return -EIO;
+	}
+
+	aip->read_index = 0;
+	saa716x_set_clk_external(saa716x, dma_channel);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(saa716x_aip_setparams);
+
+/* undo saa716x_aip_setparams(), the port is stopped */
+void saa716x_aip_release(struct saa716x_dev *saa716x, int port)
+{
+	saa716x_set_clk_internal(saa716x, saa716x->aip[port].dma_channel);
+	SAA716x_EPWR(ai_ch[port], AI_PWR_DOWN, AI_PWR_DWN);
+}
+EXPORT_SYMBOL_GPL(saa716x_aip_release);
+
+/* register writes only, called from atomic context */
+void saa716x_aip_start(struct saa716x_dev *saa716x, int port)
+{
+	SAA716x_EPWR(ai_ch[port], AI_CTL, AI_CAP_ENABLE | AIP_CAP_STEREO16);
+	SAA716x_EPWR(MSI, MSI_INT_ENA_SET_L, msi_int_tagack[port]);
+}
+EXPORT_SYMBOL_GPL(saa716x_aip_start);
+
+void saa716x_aip_stop(struct saa716x_dev *saa716x, int port)
+{
+	SAA716x_EPWR(MSI, MSI_INT_ENA_CLR_L, msi_int_tagack[port]);
+	SAA716x_EPWR(ai_ch[port], AI_CTL, 0);
+}
+EXPORT_SYMBOL_GPL(saa716x_aip_stop);
+
+void saa716x_aip_init(struct saa716x_dev *saa716x, int port,
+		      void (*worker)(unsigned long))
+{
+	struct saa716x_aip_stream_port *aip = &saa716x->aip[port];
+
+	aip->port = port;
+	aip->dma_channel = port + 10;
+	aip->read_index = 0;
+	aip->saa716x = saa716x;
+	tasklet_init(&aip->tasklet, worker, (unsigned long)aip);
+}
+EXPORT_SYMBOL_GPL(saa716x_aip_init);
+
+void saa716x_aip_exit(struct saa716x_dev *saa716x, int port)
+{
+	tasklet_kill(&saa716x->aip[port].tasklet);
+}
+EXPORT_SYMBOL_GPL(saa716x_aip_exit);
@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+
+#ifndef __SAA716x_AIP_H
+#define __SAA716x_AIP_H
+
+#include <linux/interrupt.h>
+#include <linux/ktime.h>
+
+#define AIP_BUFFERS	8
+
+/*
+ * Audio input parameters
+ * periods: BAM buffers in the ring, 2 to AIP_BUFFERS
+ * period_bytes: bytes written to a BAM buffer before it is acked
+ * pta: page table of every period
+ * offset: start of every period in the first page of its page table
+ */
+struct aip_stream_params {
+	u32			periods;
+	u32			period_bytes;
+	dma_addr_t		pta[AIP_BUFFERS];
+	u32			offset[AIP_BUFFERS];
+};
+
+/*
+ * AI port
+ * read_index: next BAM buffer the consumer expects to complete
+ * tag_time: time of the last TAGACK
+ */
+struct saa716x_aip_stream_port {
+	u8			port;
+	u8			dma_channel;
+	u8			read_index;
+	ktime_t			tag_time;
+	struct saa716x_dev	*saa716x;
+	struct tasklet_struct	tasklet;
+};
+
+extern int saa716x_aip_msi_bit(int port);
+extern int saa716x_aip_get_write_index(struct saa716x_dev *saa716x, int port);
+extern int saa716x_aip_setparams(struct saa716x_dev *saa716x, int port,
+				 struct aip_stream_params *stream_params);
+extern void saa716x_aip_release(struct saa716x_dev *saa716x, int port);
+extern void saa716x_aip_start(struct saa716x_dev *saa716x, int port);
+extern void saa716x_aip_stop(struct saa716x_dev *saa716x, int port);
+extern void saa716x_aip_init(struct saa716x_dev *saa716x, int port,
+			     void (*worker)(unsigned long));
+extern void saa716x_aip_exit(struct saa716x_dev *saa716x, int port);
+
+#endif /* __SAA716x_AIP_H */
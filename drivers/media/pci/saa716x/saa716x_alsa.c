@@ -0,0 +1,439 @@
+// SPDX-License-Identifier: GPL-2.0+
+
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/pm_runtime.h>
+
+#include <sound/core.h>
+#include <sound/initval.h>
+#include <sound/pcm.h>
+
+#include "saa716x_alsa.h"
+#include "saa716x_priv.h"
+
+/* AI_SIZE takes whole 64 byte bursts */
+#define SAA716x_ALSA_PERIOD_STEP	64
+#define SAA716x_ALSA_PERIOD_MIN		256
+#define SAA716x_ALSA_PERIOD_MAX		(64 * 1024)
+
+static const struct snd_pcm_hardware saa716x_alsa_hw = {
+	.info			= SNDRV_PCM_INFO_MMAP |
+				  SNDRV_PCM_INFO_MMAP_VALID |
+				  SNDRV_PCM_INFO_INTERLEAVED |
+				  SNDRV_PCM_INFO_BLOCK_TRANSFER |
+				  SNDRV_PCM_INFO_BATCH |
+				  SNDRV_PCM_INFO_HAS_LINK_ATIME,
+	.formats		= SNDRV_PCM_FMTBIT_S16_LE,
+	.rates			= SNDRV_PCM_RATE_32000 |
+				  SNDRV_PCM_RATE_44100 |
+				  SNDRV_PCM_RATE_48000,
+	.rate_min		= 32000,
+	.rate_max		= 48000,
+	.channels_min		= 2,
+	.channels_max		= 2,
+	.buffer_bytes_max	= AIP_BUFFERS * SAA716x_ALSA_PERIOD_MAX,
+	.period_bytes_min	= SAA716x_ALSA_PERIOD_MIN,
+	.period_bytes_max	= SAA716x_ALSA_PERIOD_MAX,
+	.periods_min		= 2,
+	.periods_max		= AIP_BUFFERS,
+};
+
+static struct saa716x_alsa_stream *
+saa716x_alsa_stream(struct snd_pcm_substream *substream)
+{
+	struct saa716x_alsa *alsa = snd_pcm_substream_chip(substream);
+
+	return &alsa->stream[substream->pcm->device];
+}
+
+/* TAGACK bottom half, a period is complete for every BAM buffer acked */
+static void saa716x_alsa_worker(unsigned long data)
+{
+	struct saa716x_aip_stream_port *aip =
+				(struct saa716x_aip_stream_port *)data;
+	struct saa716x_dev *saa716x = aip->saa716x;
+	struct saa716x_alsa_stream *stream = &saa716x->alsa->stream[aip->port];
+	struct snd_pcm_substream *substream;
+	unsigned long flags;
+	int write_index, done = 0;
+
+	write_index = saa716x_aip_get_write_index(saa716x, aip->port);
+
+	spin_lock_irqsave(&stream->lock, flags);
+	substream = stream->substream;
+	if (!substream || write_index >= stream->params.periods) {
+		spin_unlock_irqrestore(&stream->lock, flags);
+		return;
+	}
+
+	while (aip->read_index != write_index) {
+		aip->read_index = (aip->read_index + 1) %
+				  stream->params.periods;
+		done++;
+	}
+	if (done) {
+		stream->position = aip->read_index;
+		stream->frames += done * substream->runtime->period_size;
+		stream->period_time = READ_ONCE(aip->tag_time);
+	}
+	spin_unlock_irqrestore(&stream->lock, flags);
+
+	if (done)
+		snd_pcm_period_elapsed(substream);
+}
+
+/*
+ * Page table of a period, from the page its first byte is in. The BAM
+ * address offset of the period takes it to the first byte.
+ */
+static void saa716x_alsa_ptab_fill(struct snd_pcm_substream *substream,
+				   struct saa716x_dmabuf *ptab,
+				   unsigned int start, unsigned int bytes)
+{
+	struct pci_dev *pdev = ptab->saa716x->pdev;
+	unsigned int ofs = round_down(start, SAA716x_PAGE_SIZE);
+	dma_addr_t addr = 0;
+	u32 *page;
+	int k = 0;
+
+	dma_sync_single_for_cpu(&pdev->dev, ptab->mem_ptab_phys,
+				SAA716x_PAGE_SIZE, DMA_TO_DEVICE);
+	page = ptab->mem_ptab_virt;
+
+	for (; ofs < start + bytes; ofs += SAA716x_PAGE_SIZE, k++) {
+		addr = snd_pcm_sgbuf_get_addr(substream, ofs);
+		page[k * 2] = PTA_LSB(addr);
+		page[k * 2 + 1] = PTA_MSB(addr);
+	}
+	for (; k < SAA716x_PAGE_SIZE / 8; k++) {
+		page[k * 2] = PTA_LSB(addr);
+		page[k * 2 + 1] = PTA_MSB(addr);
+	}
+
+	dma_sync_single_for_device(&pdev->dev, ptab->mem_ptab_phys,
+				   SAA716x_PAGE_SIZE, DMA_TO_DEVICE);
+}
+
+static int saa716x_alsa_open(struct snd_pcm_substream *substream)
+{
+	struct saa716x_alsa_stream *stream = saa716x_alsa_stream(substream);
+	struct saa716x_dev *saa716x = stream->alsa->saa716x;
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct device *dev = &saa716x->pdev->dev;
+	int ret, i;
+
+	ret = pm_runtime_get_sync(dev);
+	if (ret < 0 && ret != -EACCES) {
+		pm_runtime_put_noidle(dev);
+		return ret;
+	}
+
+	for (i = 0; i < AIP_BUFFERS; i++) {
+		ret = saa716x_dmabuf_ptab_alloc(saa716x, &stream->ptab[i]);
+		if (ret < 0)
+			goto err;
+	}
+
+	runtime->hw = saa716x_alsa_hw;
+	snd_pcm_hw_constraint_integer(runtime, SNDRV_PCM_HW_PARAM_PERIODS);
+	snd_pcm_hw_constraint_step(runtime, 0, SNDRV_PCM_HW_PARAM_PERIOD_BYTES,
+				   SAA716x_ALSA_PERIOD_STEP);
+
+	spin_lock_irq(&stream->lock);
+	stream->substream = substream;
+	spin_unlock_irq(&stream->lock);
+
+	return 0;
+
+err:
+	while (i--)
+		saa716x_dmabuf_ptab_free(&stream->ptab[i]);
+	pm_runtime_put_autosuspend(dev);
+	return ret;
+}
+
+static int saa716x_alsa_hw_free(struct snd_pcm_substream *substream)
+{
+	struct saa716x_alsa_stream *stream = saa716x_alsa_stream(substream);
+
+	if (stream->prepared)
+		saa716x_aip_release(stream->alsa->saa716x, stream->port);
+	stream->prepared = false;
+
+	return 0;
+}
+
+static int saa716x_alsa_close(struct snd_pcm_substream *substream)
+{
+	struct saa716x_alsa_stream *stream = saa716x_alsa_stream(substream);
+	struct saa716x_dev *saa716x = stream->alsa->saa716x;
+	struct device *dev = &saa716x->pdev->dev;
+	int i;
+
+	spin_lock_irq(&stream->lock);
+	stream->substream = NULL;
+	spin_unlock_irq(&stream->lock);
+	tasklet_kill(&saa716x->aip[stream->port].tasklet);
+
+	for (i = 0; i < AIP_BUFFERS; i++)
+		saa716x_dmabuf_ptab_free(&stream->ptab[i]);
+
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
+
+	return 0;
+}
+
+static int saa716x_alsa_prepare(struct snd_pcm_substream *substream)
+{
+	struct saa716x_alsa_stream *stream = saa716x_alsa_stream(substream);
+	struct saa716x_dev *saa716x = stream->alsa->saa716x;
+	struct aip_stream_params *params = &stream->params;
+	unsigned int start;
+	int ret, i;
+
+	params->periods = substream->runtime->periods;
+	params->period_bytes = snd_pcm_lib_period_bytes(substream);
+
+	for (i = 0; i < params->periods; i++) {
+		start = i * params->period_bytes;
+		saa716x_alsa_ptab_fill(substream, &stream->ptab[i], start,
+				       params->period_bytes);
+		params->pta[i] = stream->ptab[i].mem_ptab_phys;
+		params->offset[i] = start % SAA716x_PAGE_SIZE;
+	}
+
+	spin_lock_irq(&stream->lock);
+	stream->position = 0;
+	stream->frames = 0;
+	stream->period_time = 0;
+	spin_unlock_irq(&stream->lock);
+
+	ret = saa716x_aip_setparams(saa716x, stream->port, params);
+	if (ret < 0)
+		return ret;
+	stream->prepared = true;
+
+	return 0;
+}
+
+static int saa716x_alsa_trigger(struct snd_pcm_substream *substream, int cmd)
+{
+	struct saa716x_alsa_stream *stream = saa716x_alsa_stream(substream);
+	struct saa716x_dev *saa716x = stream->alsa->saa716x;
+
+	switch (cmd) {
+	case SNDRV_PCM_TRIGGER_START:
+		saa716x_aip_start(saa716x, stream->port);
+		return 0;
+	case SNDRV_PCM_TRIGGER_STOP:
+	case SNDRV_PCM_TRIGGER_SUSPEND:
+		saa716x_aip_stop(saa716x, stream->port);
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+static snd_pcm_uframes_t saa716x_alsa_pointer(struct snd_pcm_substream *substream)
+{
+	struct saa716x_alsa_stream *stream = saa716x_alsa_stream(substream);
+	unsigned long flags;
+	unsigned int position;
+
+	spin_lock_irqsave(&stream->lock, flags);
+	position = stream->position;
+	spin_unlock_irqrestore(&stream->lock, flags);
+
+	return position * substream->runtime->period_size;
+}
+
+/*
+ * Link timestamps: the frames captured up to the last period, with the
+ * time of its TAGACK on CLOCK_MONOTONIC, the clock of the video buffers
+ */
+static int
+saa716x_alsa_get_time_info(struct snd_pcm_substream *substream,
+			   struct timespec64 *system_ts,
+			   struct timespec64 *audio_ts,
+			   struct snd_pcm_audio_tstamp_config *audio_tstamp_config,
+			   struct snd_pcm_audio_tstamp_report *audio_tstamp_report)
+{
+	struct saa716x_alsa_stream *stream = saa716x_alsa_stream(substream);
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	unsigned long flags;
+	ktime_t period_time;
+	u64 frames;
+
+	if (audio_tstamp_config->type_requested !=
+	    SNDRV_PCM_AUDIO_TSTAMP_TYPE_LINK ||
+	    runtime->tstamp_type != SNDRV_PCM_TSTAMP_TYPE_MONOTONIC) {
+		audio_tstamp_report->actual_type =
+					SNDRV_PCM_AUDIO_TSTAMP_TYPE_DEFAULT;
+		return 0;
+	}
+
+	spin_lock_irqsave(&stream->lock, flags);
+	frames = stream->frames;
+	period_time = stream->period_time;
+	spin_unlock_irqrestore(&stream->lock, flags);
+
+	*system_ts = ktime_to_timespec64(period_time);
+	*audio_ts = ns_to_timespec64(mul_u64_u32_div(frames, NSEC_PER_SEC,
+						     runtime->rate));
+	audio_tstamp_report->actual_type = SNDRV_PCM_AUDIO_TSTAMP_TYPE_LINK;
+	audio_tstamp_report->accuracy_report = 0;
+
+	return 0;
+}
+
+static const struct snd_pcm_ops saa716x_alsa_ops = {
+	.open		= saa716x_alsa_open,
+	.close		= saa716x_alsa_close,
+	.hw_free	= saa716x_alsa_hw_free,
+	.prepare	= saa716x_alsa_prepare,
+	.trigger	= saa716x_alsa_trigger,
+	.pointer	= saa716x_alsa_pointer,
+	.get_time_info	= saa716x_alsa_get_time_info,
+};
+
+/* a card for the device with a capture PCM for every AI port in ports */
+int saa716x_alsa_init(struct saa716x_dev *saa716x, unsigned long ports)
+{
+	struct saa716x_alsa_stream *stream;
+	struct saa716x_alsa *alsa;
+	struct snd_card *card;
+	struct snd_pcm *pcm;
+	int port, bit, ret;
+
+	if (!ports)
+		return 0;
+
+	ret = snd_card_new(&saa716x->pdev->dev, SNDRV_DEFAULT_IDX1,
+			   SNDRV_DEFAULT_STR1, THIS_MODULE, sizeof(*alsa),
+			   &card);
+	if (ret < 0)
+		return ret;
+
+	alsa = card->private_data;
+	alsa->card = card;
+	alsa->saa716x = saa716x;
+	saa716x->alsa = alsa;
+
+	strscpy(card->driver, "SAA716x", sizeof(card->driver));
+	strscpy(card->shortname, saa716x->config->model_name,
+		sizeof(card->shortname));
+	snprintf(card->longname, sizeof(card->longname), "%s at %s",
+		 saa716x->config->model_name, pci_name(saa716x->pdev));
+
+	for_each_set_bit(port, &ports, ARRAY_SIZE(saa716x->aip)) {
+		ret = snd_pcm_new(card, "SAA716x AI", port, 0, 1, &pcm);
+		if (ret < 0)
+			goto err;
+
+		pcm->private_data = alsa;
+		snprintf(pcm->name, sizeof(pcm->name), "SAA716x AI%d", port);
+		snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_CAPTURE,
+				&saa716x_alsa_ops);
+		snd_pcm_set_managed_buffer_all(pcm, SNDRV_DMA_TYPE_DEV_SG,
+					       &saa716x->pdev->dev, 0,
+					       saa716x_alsa_hw.buffer_bytes_max);
+
+		stream = &alsa->stream[port];
+		stream->pcm = pcm;
+		stream->port = port;
+		stream->alsa = alsa;
+		spin_lock_init(&stream->lock);
+
+		saa716x_aip_init(saa716x, port, saa716x_alsa_worker);
+		bit = saa716x_aip_msi_bit(port);
+		saa716x->dispatch[bit].tasklet = &saa716x->aip[port].tasklet;
+		saa716x->dispatch[bit].tag_time = &saa716x->aip[port].tag_time;
+		saa716x->dispatch_l |= BIT(bit);
+		alsa->ports |= BIT(port);
+	}
+
+	ret = snd_card_register(card);
+	if (ret < 0)
+		goto err;
+
+	return 0;
+
+err:
+	pci_err(saa716x->pdev, "ALSA init failed, err=%d", ret);
+	saa716x_alsa_exit(saa716x);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(saa716x_alsa_init);
+
+void saa716x_alsa_exit(struct saa716x_dev *saa716x)
+{
+	struct saa716x_alsa *alsa = saa716x->alsa;
+	unsigned long ports;
+	int port;
+
+	if (!alsa)
+		return;
+
+	ports = alsa->ports;
+	for_each_set_bit(port, &ports, ARRAY_SIZE(saa716x->aip))
+		saa716x->dispatch_l &= ~BIT(saa716x_aip_msi_bit(port));
+
+	/* waits for the PCMs to be closed, alsa goes with the card */
+	snd_card_free(alsa->card);
+	saa716x->alsa = NULL;
+
+	for_each_set_bit(port, &ports, ARRAY_SIZE(saa716x->aip))
+		saa716x_aip_exit(saa716x, port);
+}
+EXPORT_SYMBOL_GPL(saa716x_alsa_exit);
+
+/*
+ * System sleep and PCIe error recovery. Running captures are suspended,
+ * userspace prepares them again after the resume.
+ */
+void saa716x_alsa_suspend(struct saa716x_dev *saa716x)
+{
+	struct saa716x_alsa *alsa = saa716x->alsa;
+	unsigned long ports;
+	int port;
+
+	if (!alsa)
+		return;
+
+	snd_power_change_state(alsa->card, SNDRV_CTL_POWER_D3hot);
+
+	ports = alsa->ports;
+	for_each_set_bit(port, &ports, ARRAY_SIZE(saa716x->aip)) {
+		snd_pcm_suspend_all(alsa->stream[port].pcm);
+		saa716x_aip_stop(saa716x, port);
+	}
+
+	synchronize_irq(pci_irq_vector(saa716x->pdev, 0));
+	for_each_set_bit(port, &ports, ARRAY_SIZE(saa716x->aip))
+		tasklet_kill(&saa716x->aip[port].tasklet);
+}
+EXPORT_SYMBOL_GPL(saa716x_alsa_suspend);
+
+/* the AI and BAM setup of a prepared stream went with the power down */
+void saa716x_alsa_resume(struct saa716x_dev *saa716x)
+{
+	struct saa716x_alsa *alsa = saa716x->alsa;
+	struct saa716x_alsa_stream *stream;
+	unsigned long ports;
+	int port;
+
+	if (!alsa)
+		return;
+
+	ports = alsa->ports;
+	for_each_set_bit(port, &ports, ARRAY_SIZE(saa716x->aip)) {
+		stream = &alsa->stream[port];
+		if (stream->prepared &&
+		    saa716x_aip_setparams(saa716x, port, &stream->params) < 0)
+			pci_err(saa716x->pdev, "AI%d: restore failed", port);
+	}
+
+	snd_power_change_state(alsa->card, SNDRV_CTL_POWER_D0);
+}
+EXPORT_SYMBOL_GPL(saa716x_alsa_resume);
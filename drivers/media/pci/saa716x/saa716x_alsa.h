@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+
+#ifndef __SAA716x_ALSA_H
+#define __SAA716x_ALSA_H
+
+struct saa716x_dev;
+
+#ifdef CONFIG_VIDEO_SAA716X_ALSA
+
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+
+#include "saa716x_aip.h"
+#include "saa716x_dma.h"
+
+struct snd_card;
+struct snd_pcm;
+struct snd_pcm_substream;
+
+/*
+ * PCM capture on an AI port
+ * ptab: page table per period, built at prepare
+ * lock: position and timestamps, shared with the tasklet
+ * position: periods done in the ring
+ * frames: frames done since the start, for the link timestamps
+ * period_time: TAGACK time of the last period done
+ */
+struct saa716x_alsa_stream {
+	struct snd_pcm		*pcm;
+	struct snd_pcm_substream *substream;
+	struct saa716x_dmabuf	ptab[AIP_BUFFERS];
+	struct aip_stream_params params;
+	bool			prepared;
+
+	spinlock_t		lock;
+	unsigned int		position;
+	u64			frames;
+	ktime_t			period_time;
+
+	u8			port;
+	struct saa716x_alsa	*alsa;
+};
+
+/*
+ * Sound card of the device, a PCM device per AI port in use
+ * ports: AI ports with a PCM device, bit per port
+ */
+struct saa716x_alsa {
+	struct snd_card		*card;
+	unsigned long		ports;
+	struct saa716x_alsa_stream stream[2];
+	struct saa716x_dev	*saa716x;
+};
+
+extern int saa716x_alsa_init(struct saa716x_dev *saa716x, unsigned long ports);
+extern void saa716x_alsa_exit(struct saa716x_dev *saa716x);
+extern void saa716x_alsa_suspend(struct saa716x_dev *saa716x);
+extern void saa716x_alsa_resume(struct saa716x_dev *saa716x);
+
+#else
+
+static inline int saa716x_alsa_init(struct saa716x_dev *saa716x,
+				    unsigned long ports)
+{
+	return 0;
+}
+
+static inline void saa716x_alsa_exit(struct saa716x_dev *saa716x)
+{
+}
+
+static inline void saa716x_alsa_suspend(struct saa716x_dev *saa716x)
+{
+}
+
+static inline void saa716x_alsa_resume(struct saa716x_dev *saa716x)
+{
+}
+
+#endif
+
+#endif /* __SAA716x_ALSA_H */
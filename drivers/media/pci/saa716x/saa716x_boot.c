@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0+
 
 #include <linux/delay.h>
+#include <linux/module.h>
 
 #include "saa716x_mod.h"
 
@@ -16,6 +17,11 @@
 #include "saa716x_boot.h"
 #include "saa716x_priv.h"
 
+static bool serr_report;
+module_param(serr_report, bool, 0444);
+MODULE_PARM_DESC(serr_report,
+	"report PCIe errors, needed for AER recovery (default off for quirky BIOSes)");
+
 static void saa716x_core_reset(struct saa716x_dev *saa716x)
 {
 	pci_dbg(saa716x->pdev, "RESET Modules");
@@ -59,7 +65,10 @@ static void saa716x_bus_report(struct pci_dev *pdev, int enable)
 	pci_write_config_dword(pdev, 0x04, reg);
 
 	pci_read_config_dword(pdev, 0x58, &reg);
-	reg &= 0xfffffffd;
+	if (enable)
+		reg |= 0x00000002; /* enable non-fatal error reporting */
+	else
+		reg &= 0xfffffffd;
 	pci_write_config_dword(pdev, 0x58, reg);
 }
 
@@ -71,9 +80,9 @@ int saa716x_jetpack_init(struct saa716x_dev *saa716x)
 	/*
 	 * configure PHY through config space not to report
 	 * non-fatal error messages to avoid problems with
-	 * quirky BIOS'es
+	 * quirky BIOS'es, unless AER recovery is wanted
 	 */
-	saa716x_bus_report(saa716x->pdev, 0);
+	saa716x_bus_report(saa716x->pdev, serr_report);
 
 	/*
 	 * create time out for blocks that have no clock
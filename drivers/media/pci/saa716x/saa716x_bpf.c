@@ -0,0 +1,285 @@
+// SPDX-License-Identifier: GPL-2.0+
+
+#include <linux/bpf.h>
+#include <linux/bpf_trace.h>
+#include <linux/etherdevice.h>
+#include <linux/filter.h>
+#include <linux/kobject.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/netdevice.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+#include <linux/sysfs.h>
+
+#include "saa716x_bpf.h"
+#include "saa716x_priv.h"
+
+/* bpfN below the PCI device, freed on release */
+struct saa716x_bpf_dir {
+	struct kobject		kobj;
+	struct saa716x_adapter	*saa716x_adap;
+};
+
+static inline struct saa716x_adapter *to_adapter(struct kobject *kobj)
+{
+	return container_of(kobj, struct saa716x_bpf_dir, kobj)->saa716x_adap;
+}
+
+/* packets first up to last were passed, count arrived over span */
+static void saa716x_bpf_pass(struct saa716x_adapter *saa716x_adap, u8 *buf,
+			     int first, int last, int count, ktime_t start,
+			     s64 span)
+{
+	dvb_dmx_swfilter(&saa716x_adap->demux, buf + first * 188,
+			 (last - first) * 188);
+	saa716x_m2ts_feed(&saa716x_adap->m2ts, buf + first * 188,
+			  last - first,
+			  ktime_add_ns(start, div_s64(span * first, count)),
+			  ktime_add_ns(start, div_s64(span * last, count)));
+}
+
+/*
+ * Runs the attached program over count packets, called from the
+ * tasklet before anything else consumes the buffer. Verdicts:
+ * XDP_PASS: to the demux and the timestamped output
+ * XDP_DROP, XDP_ABORTED: dropped
+ * XDP_TX, XDP_REDIRECT: there is no interface to send or redirect
+ *	from, they are rejected like unknown verdicts and dropped
+ * Returns false if no program is attached and the buffer is untouched.
+ */
+bool saa716x_bpf_run(struct saa716x_adapter *saa716x_adap, u8 *buf,
+		     int count, ktime_t start, ktime_t end)
+{
+	struct saa716x_bpf *bpf = &saa716x_adap->bpf;
+	s64 span = ktime_to_ns(ktime_sub(end, start));
+	struct bpf_prog *prog;
+	struct xdp_buff xdp;
+	int first = -1;
+	ktime_t t0;
+	u8 *pkt;
+	u32 act;
+	int i;
+
+	if (!rcu_access_pointer(bpf->prog))
+		return false;
+
+	rcu_read_lock();
+	prog = rcu_dereference(bpf->prog);
+	if (!prog) {
+		rcu_read_unlock();
+		return false;
+	}
+
+	t0 = ktime_get();
+	memset(&xdp, 0, sizeof(xdp));
+	xdp.rxq = &bpf->rxq;
+	xdp.frame_sz = 188;
+
+	for (i = 0; i < count; i++) {
+		pkt = buf + i * 188;
+		xdp.data_hard_start = pkt;
+		xdp.data = pkt;
+		xdp.data_end = pkt + 188;
+		xdp_set_data_meta_invalid(&xdp);
+
+		act = bpf_prog_run_xdp(prog, &xdp);
+		if (act == XDP_PASS) {
+			/* consecutive passes go on in one call */
+			if (first < 0)
+				first = i;
+			bpf->pass++;
+			continue;
+		}
+
+		if (first >= 0) {
+			saa716x_bpf_pass(saa716x_adap, buf, first, i, count,
+					 start, span);
+			first = -1;
+		}
+
+		switch (act) {
+		case XDP_DROP:
+			bpf->drop++;
+			break;
+		case XDP_ABORTED:
+			trace_xdp_exception(bpf->ndev, prog, act);
+			bpf->aborted++;
+			break;
+		default:
+			bpf_warn_invalid_xdp_action(act);
+			trace_xdp_exception(bpf->ndev, prog, act);
+			bpf->invalid++;
+			break;
+		}
+	}
+	if (first >= 0)
+		saa716x_bpf_pass(saa716x_adap, buf, first, count, count,
+				 start, span);
+
+	bpf->buffers++;
+	bpf->ns += ktime_to_ns(ktime_sub(ktime_get(), t0));
+	rcu_read_unlock();
+
+	return true;
+}
+EXPORT_SYMBOL_GPL(saa716x_bpf_run);
+
+/* fd of an XDP program to attach, negative to detach */
+static int saa716x_bpf_attach(struct saa716x_adapter *saa716x_adap, int fd)
+{
+	struct saa716x_bpf *bpf = &saa716x_adap->bpf;
+	struct bpf_prog *prog = NULL, *old;
+
+	if (fd >= 0) {
+		prog = bpf_prog_get_type(fd, BPF_PROG_TYPE_XDP);
+		if (IS_ERR(prog))
+			return PTR_ERR(prog);
+	}
+
+	mutex_lock(&bpf->lock);
+	old = rcu_replace_pointer(bpf->prog, prog,
+				  lockdep_is_held(&bpf->lock));
+	mutex_unlock(&bpf->lock);
+
+	/* freeing waits for an RCU grace period, the tasklet is done then */
+	if (old)
+		bpf_prog_put(old);
+
+	return 0;
+}
+
+/*
+ * Id of the attached program, 0 if none. Writing the fd of an XDP
+ * program in the writer's file table attaches it in place of the
+ * previous one, a negative number detaches.
+ */
+static ssize_t prog_show(struct kobject *kobj, struct kobj_attribute *attr,
+			 char *buf)
+{
+	struct saa716x_bpf *bpf = &to_adapter(kobj)->bpf;
+	struct bpf_prog *prog;
+	ssize_t ret;
+
+	mutex_lock(&bpf->lock);
+	prog = rcu_dereference_protected(bpf->prog,
+					 lockdep_is_held(&bpf->lock));
+	ret = sysfs_emit(buf, "%u\n", prog ? prog->aux->id : 0);
+	mutex_unlock(&bpf->lock);
+
+	return ret;
+}
+
+static ssize_t prog_store(struct kobject *kobj, struct kobj_attribute *attr,
+			  const char *buf, size_t count)
+{
+	int fd, ret;
+
+	ret = kstrtoint(buf, 0, &fd);
+	if (ret < 0)
+		return ret;
+
+	ret = saa716x_bpf_attach(to_adapter(kobj), fd);
+
+	return ret < 0 ? ret : count;
+}
+static struct kobj_attribute prog_attr = __ATTR(prog, 0600, prog_show,
+						prog_store);
+
+static ssize_t stats_show(struct kobject *kobj, struct kobj_attribute *attr,
+			  char *buf)
+{
+	struct saa716x_bpf *bpf = &to_adapter(kobj)->bpf;
+	u64 buffers = bpf->buffers;
+
+	return sysfs_emit(buf, "pass %llu drop %llu aborted %llu invalid %llu buffers %llu ns_per_buffer %llu\n",
+			  bpf->pass, bpf->drop, bpf->aborted, bpf->invalid,
+			  buffers, buffers ? div64_u64(bpf->ns, buffers) : 0);
+}
+static struct kobj_attribute stats_attr = __ATTR_RO(stats);
+
+static struct attribute *saa716x_bpf_attrs[] = {
+	&prog_attr.attr,
+	&stats_attr.attr,
+	NULL
+};
+ATTRIBUTE_GROUPS(saa716x_bpf);
+
+static void saa716x_bpf_release(struct kobject *kobj)
+{
+	kfree(container_of(kobj, struct saa716x_bpf_dir, kobj));
+}
+
+static struct kobj_type saa716x_bpf_ktype = {
+	.release	= saa716x_bpf_release,
+	.sysfs_ops	= &kobj_sysfs_ops,
+	.default_groups	= saa716x_bpf_groups,
+};
+
+void saa716x_bpf_init(struct saa716x_adapter *saa716x_adap)
+{
+	struct saa716x_bpf *bpf = &saa716x_adap->bpf;
+	struct device *dev = &saa716x_adap->saa716x->pdev->dev;
+	struct saa716x_bpf_dir *dir;
+	int ret;
+
+	mutex_init(&bpf->lock);
+	RCU_INIT_POINTER(bpf->prog, NULL);
+
+	/* helpers like the FIB lookup take the namespace from rxq->dev */
+	bpf->ndev = alloc_netdev(0, "saa716x-ts", NET_NAME_UNKNOWN,
+				 ether_setup);
+	if (!bpf->ndev)
+		goto err;
+
+	ret = xdp_rxq_info_reg(&bpf->rxq, bpf->ndev, saa716x_adap->count);
+	if (ret < 0)
+		goto err_ndev;
+
+	dir = kzalloc(sizeof(*dir), GFP_KERNEL);
+	if (!dir)
+		goto err_rxq;
+
+	dir->saa716x_adap = saa716x_adap;
+	ret = kobject_init_and_add(&dir->kobj, &saa716x_bpf_ktype, &dev->kobj,
+				   "bpf%d", saa716x_adap->count);
+	if (ret < 0) {
+		kobject_put(&dir->kobj);
+		goto err_rxq;
+	}
+
+	bpf->kobj = &dir->kobj;
+	kobject_uevent(bpf->kobj, KOBJ_ADD);
+
+	return;
+
+err_rxq:
+	xdp_rxq_info_unreg(&bpf->rxq);
+err_ndev:
+	free_netdev(bpf->ndev);
+	bpf->ndev = NULL;
+err:
+	pci_err(saa716x_adap->saa716x->pdev, "adapter %d: no BPF hook",
+		saa716x_adap->count);
+}
+EXPORT_SYMBOL_GPL(saa716x_bpf_init);
+
+/* after the tasklet is gone */
+void saa716x_bpf_exit(struct saa716x_adapter *saa716x_adap)
+{
+	struct saa716x_bpf *bpf = &saa716x_adap->bpf;
+
+	if (!bpf->kobj)
+		return;
+
+	/* no sysfs access after this */
+	kobject_del(bpf->kobj);
+	kobject_put(bpf->kobj);
+	bpf->kobj = NULL;
+
+	saa716x_bpf_attach(saa716x_adap, -1);
+	xdp_rxq_info_unreg(&bpf->rxq);
+	free_netdev(bpf->ndev);
+	bpf->ndev = NULL;
+}
+EXPORT_SYMBOL_GPL(saa716x_bpf_exit);
@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+
+#ifndef __SAA716x_BPF_H
+#define __SAA716x_BPF_H
+
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/types.h>
+
+#ifdef CONFIG_VIDEO_SAA716X_BPF
+#include <net/xdp.h>
+#endif
+
+struct bpf_prog;
+struct kobject;
+struct net_device;
+struct saa716x_adapter;
+
+/*
+ * XDP program run over every TS packet of an adapter
+ * kobj: bpfN below the PCI device, attaches and detaches the program
+ * prog: attached program, RCU protected
+ * ndev: net namespace and name for the helpers that look at rxq->dev,
+ *	never registered as there is no network interface behind it
+ * rxq: the one receive queue, registered with ndev
+ * lock: serializes attach and detach
+ * pass, drop, aborted, invalid: verdicts, invalid counts XDP_TX,
+ *	XDP_REDIRECT and unknown ones, which are dropped
+ * buffers, ns: TS buffers run through the program and time it took
+ */
+struct saa716x_bpf {
+#ifdef CONFIG_VIDEO_SAA716X_BPF
+	struct kobject		*kobj;
+	struct bpf_prog __rcu	*prog;
+	struct net_device	*ndev;
+	struct xdp_rxq_info	rxq;
+	struct mutex		lock;
+
+	u64			pass;
+	u64			drop;
+	u64			aborted;
+	u64			invalid;
+	u64			buffers;
+	u64			ns;
+#endif
+};
+
+#ifdef CONFIG_VIDEO_SAA716X_BPF
+extern void saa716x_bpf_init(struct saa716x_adapter *saa716x_adap);
+extern void saa716x_bpf_exit(struct saa716x_adapter *saa716x_adap);
+extern bool saa716x_bpf_run(struct saa716x_adapter *saa716x_adap, u8 *buf,
+			    int count, ktime_t start, ktime_t end);
+#else
+static inline void saa716x_bpf_init(struct saa716x_adapter *saa716x_adap)
+{
+}
+
+static inline void saa716x_bpf_exit(struct saa716x_adapter *saa716x_adap)
+{
+}
+
+static inline bool saa716x_bpf_run(struct saa716x_adapter *saa716x_adap,
+				   u8 *buf, int count, ktime_t start,
+				   ktime_t end)
+{
+	return false;
+}
+#endif
+
+#endif /* __SAA716x_BPF_H */
@@ -1,5 +1,8 @@
 // SPDX-License-Identifier: GPL-2.0+
 
+#include <linux/bitops.h>
+#include <linux/pm_runtime.h>
+
 #include "saa716x_mod.h"
 
 #include "saa716x_gpio_reg.h"
@@ -12,6 +15,7 @@
 #include "saa716x_pci.h"
 #include "saa716x_budget.h"
 #include "saa716x_gpio.h"
+#include "saa716x_debugfs.h"
 #include "saa716x_priv.h"
 
 #include "si2168.h"
@@ -19,13 +23,37 @@
 
 #define DRIVER_NAME	"SAA716x Budget"
 
+#define SAA716x_AUTOSUSPEND_MS	5000
+
+static unsigned int vip_capture;
+module_param(vip_capture, uint, 0444);
+MODULE_PARM_DESC(vip_capture,
+	"VIP ports to register as V4L2 capture devices in addition to the board's (bit per port)");
+
+static unsigned int aip_capture;
+module_param(aip_capture, uint, 0444);
+MODULE_PARM_DESC(aip_capture,
+	"AI ports to register as ALSA capture devices in addition to the board's (bit per port)");
+
+/* register state that is lost with a power down or a link reset */
+static void saa716x_budget_save_state(struct saa716x_dev *saa716x)
+{
+	struct saa716x_pm_state *pm = &saa716x->pm;
+
+	pm->greg_vi_ctrl = SAA716x_EPRD(GREG, GREG_VI_CTRL);
+	pm->greg_fgpi_ctrl = SAA716x_EPRD(GREG, GREG_FGPI_CTRL);
+	saa716x_gpio_save(saa716x);
+}
+
 static int saa716x_budget_pci_probe(struct pci_dev *pdev,
 				    const struct pci_device_id *pci_id)
 {
 	struct saa716x_dev *saa716x;
+	ktime_t start;
 	int err = 0;
 
-	saa716x = kzalloc(sizeof(struct saa716x_dev), GFP_KERNEL);
+	saa716x = kzalloc_node(sizeof(struct saa716x_dev), GFP_KERNEL,
+			       dev_to_node(&pdev->dev));
 	if (saa716x == NULL) {
 		err = -ENOMEM;
 		goto fail0;
@@ -35,45 +63,89 @@ static int saa716x_budget_pci_probe(struct pci_dev *pdev,
 	saa716x->module		= THIS_MODULE;
 	saa716x->config		= (struct saa716x_config *) pci_id->driver_data;
 
+	saa716x_timeline_init(saa716x);
+
+	start = ktime_get();
 	err = saa716x_pci_init(saa716x);
 	if (err) {
 		pci_err(saa716x->pdev, "PCI Initialization failed");
 		goto fail1;
 	}
+	saa716x_timeline_add(saa716x, "pci_init", -1, start);
+
+	saa716x_debugfs_init(saa716x);
 
 	err = saa716x_cgu_init(saa716x);
 	if (err) {
 		pci_err(saa716x->pdev, "CGU Init failed");
-		goto fail1;
+		goto fail2;
 	}
 
+	start = ktime_get();
 	err = saa716x_jetpack_init(saa716x);
 	if (err) {
 		pci_err(saa716x->pdev, "Jetpack core initialization failed");
 		goto fail2;
 	}
+	saa716x_timeline_add(saa716x, "jetpack_init", -1, start);
 
+	start = ktime_get();
 	err = saa716x_i2c_init(saa716x);
 	if (err) {
 		pci_err(saa716x->pdev, "I2C Initialization failed");
 		goto fail3;
 	}
+	saa716x_timeline_add(saa716x, "i2c_init", -1, start);
 
-	saa716x_gpio_init(saa716x);
+	err = saa716x_gpio_init(saa716x);
+	if (err)
+		goto fail3;
 
+	start = ktime_get();
 	err = saa716x_dvb_init(saa716x);
 	if (err) {
 		pci_err(saa716x->pdev, "DVB initialization failed");
 		goto fail4;
 	}
+	saa716x_timeline_add(saa716x, "dvb_init", -1, start);
+
+	err = saa716x_video_init(saa716x,
+				 saa716x->config->vip_ports | vip_capture);
+	if (err) {
+		pci_err(saa716x->pdev, "Video initialization failed");
+		goto fail4;
+	}
+
+	err = saa716x_alsa_init(saa716x,
+				saa716x->config->aip_ports | aip_capture);
+	if (err) {
+		pci_err(saa716x->pdev, "ALSA initialization failed");
+		goto fail4;
+	}
+	saa716x_timeline_add(saa716x, "probe", -1, saa716x->timeline.base);
+
+	/* link errors can leave no access to the registers */
+	saa716x_budget_save_state(saa716x);
+	pci_save_state(pdev);
+
+	/* suspend once no frontend is open and no stream is running */
+	pm_runtime_set_autosuspend_delay(&pdev->dev, SAA716x_AUTOSUSPEND_MS);
+	pm_runtime_use_autosuspend(&pdev->dev);
+	pm_runtime_mark_last_busy(&pdev->dev);
+	pm_runtime_put_autosuspend(&pdev->dev);
+	pm_runtime_allow(&pdev->dev);
 
 	return 0;
 
 fail4:
+	saa716x_alsa_exit(saa716x);
+	saa716x_video_exit(saa716x);
 	saa716x_dvb_exit(saa716x);
+	saa716x_gpio_exit(saa716x);
 fail3:
 	saa716x_i2c_exit(saa716x);
 fail2:
+	saa716x_debugfs_exit(saa716x);
 	saa716x_pci_exit(saa716x);
 fail1:
 	kfree(saa716x);
@@ -85,8 +157,16 @@ static void saa716x_budget_pci_remove(struct pci_dev *pdev)
 {
 	struct saa716x_dev *saa716x = pci_get_drvdata(pdev);
 
+	pm_runtime_forbid(&pdev->dev);
+	pm_runtime_dont_use_autosuspend(&pdev->dev);
+	pm_runtime_get_noresume(&pdev->dev);
+
+	saa716x_alsa_exit(saa716x);
+	saa716x_video_exit(saa716x);
 	saa716x_dvb_exit(saa716x);
+	saa716x_gpio_exit(saa716x);
 	saa716x_i2c_exit(saa716x);
+	saa716x_debugfs_exit(saa716x);
 	saa716x_pci_exit(saa716x);
 	kfree(saa716x);
 }
@@ -95,7 +175,15 @@ static irqreturn_t saa716x_budget_pci_irq(int irq, void *dev_id)
 {
 	struct saa716x_dev *saa716x	= (struct saa716x_dev *) dev_id;
 
+	struct saa716x_dispatch *entry;
 	u32 stat_h, stat_l, mask_h, mask_l;
+	unsigned long pending;
+	ktime_t now;
+	int bit;
+
+	/* shared line, the device may be powered down */
+	if (saa716x->suspended)
+		return IRQ_NONE;
 
 	stat_l = SAA716x_EPRD(MSI, MSI_INT_STATUS_L);
 	stat_h = SAA716x_EPRD(MSI, MSI_INT_STATUS_H);
@@ -113,18 +201,233 @@ static irqreturn_t saa716x_budget_pci_irq(int irq, void *dev_id)
 	if (stat_h)
 		SAA716x_EPWR(MSI, MSI_INT_STATUS_CLR_H, stat_h);
 
-	if (stat_l & MSI_INT_TAGACK_FGPI_0)
-		tasklet_schedule(&saa716x->fgpi[0].tasklet);
-	if (stat_l & MSI_INT_TAGACK_FGPI_1)
-		tasklet_schedule(&saa716x->fgpi[1].tasklet);
-	if (stat_l & MSI_INT_TAGACK_FGPI_2)
-		tasklet_schedule(&saa716x->fgpi[2].tasklet);
-	if (stat_l & MSI_INT_TAGACK_FGPI_3)
-		tasklet_schedule(&saa716x->fgpi[3].tasklet);
+	/* buffer completion time, the tasklet may run much later */
+	now = ktime_get();
+	pending = stat_l & saa716x->dispatch_l;
+	for_each_set_bit(bit, &pending, 32) {
+		entry = &saa716x->dispatch[bit];
+		if (entry->tag_time)
+			WRITE_ONCE(*entry->tag_time, now);
+		tasklet_schedule(entry->tasklet);
+	}
+
+	if (stat_h & mask_h)
+		saa716x_gpio_handle_irq(saa716x, stat_h & mask_h);
 
 	return IRQ_HANDLED;
 }
 
+/*
+ * Everything needed after a power down is register state kept by the
+ * driver: the frontends keep their firmware while powered, so there
+ * is no boot script run, no reset through the GPIOs and no re-probe.
+ */
+static void saa716x_budget_quiesce(struct saa716x_dev *saa716x)
+{
+	saa716x_i2c_suspend(saa716x);
+
+	SAA716x_EPWR(MSI, MSI_INT_ENA_CLR_L, 0xffffffff);
+	SAA716x_EPWR(MSI, MSI_INT_ENA_CLR_H, 0xffffffff);
+	saa716x->suspended = 1;
+	synchronize_irq(pci_irq_vector(saa716x->pdev, 0));
+}
+
+static void saa716x_budget_restore(struct saa716x_dev *saa716x)
+{
+	struct saa716x_pm_state *pm = &saa716x->pm;
+
+	saa716x_cgu_restore(saa716x);
+	saa716x_jetpack_init(saa716x);
+	saa716x_gpio_restore(saa716x);
+
+	SAA716x_EPWR(GREG, GREG_VI_CTRL, pm->greg_vi_ctrl);
+	SAA716x_EPWR(GREG, GREG_FGPI_CTRL, pm->greg_fgpi_ctrl);
+
+	saa716x->suspended = 0;
+	saa716x_i2c_resume(saa716x);
+}
+
+static void saa716x_budget_hw_suspend(struct saa716x_dev *saa716x)
+{
+	saa716x_budget_save_state(saa716x);
+	saa716x_budget_quiesce(saa716x);
+
+	saa716x->pm.suspends++;
+}
+
+static void saa716x_budget_hw_resume(struct saa716x_dev *saa716x)
+{
+	struct saa716x_pm_state *pm = &saa716x->pm;
+	ktime_t start = ktime_get();
+
+	saa716x_budget_restore(saa716x);
+
+	pm->resumes++;
+	pm->resume_us = ktime_us_delta(ktime_get(), start);
+	saa716x_timeline_add(saa716x, "resume", -1, start);
+}
+
+static int __maybe_unused saa716x_budget_suspend(struct device *dev)
+{
+	struct saa716x_dev *saa716x = dev_get_drvdata(dev);
+	int i;
+
+	saa716x_i2c_mark(saa716x, true);
+
+	/* already quiet, runtime resume restores everything later */
+	if (pm_runtime_suspended(dev))
+		return 0;
+
+	for (i = 0; i < saa716x->config->adapters; i++) {
+		if (saa716x->saa716x_adap[i].fe)
+			dvb_frontend_suspend(saa716x->saa716x_adap[i].fe);
+	}
+
+	saa716x_alsa_suspend(saa716x);
+	saa716x_video_suspend(saa716x);
+	saa716x_dvb_suspend(saa716x);
+	saa716x_budget_hw_suspend(saa716x);
+	return 0;
+}
+
+static int __maybe_unused saa716x_budget_resume(struct device *dev)
+{
+	struct saa716x_dev *saa716x = dev_get_drvdata(dev);
+	int i;
+
+	if (pm_runtime_suspended(dev)) {
+		saa716x_i2c_mark(saa716x, false);
+		return 0;
+	}
+
+	saa716x_budget_hw_resume(saa716x);
+	saa716x_i2c_mark(saa716x, false);
+	saa716x_dvb_resume(saa716x);
+	saa716x_video_resume(saa716x);
+	saa716x_alsa_resume(saa716x);
+
+	/* frontends retune on their own */
+	for (i = 0; i < saa716x->config->adapters; i++) {
+		if (saa716x->saa716x_adap[i].fe)
+			dvb_frontend_resume(saa716x->saa716x_adap[i].fe);
+	}
+
+	return 0;
+}
+
+/*
+ * Only reached with all frontends closed and no DMA running, each of
+ * them holds a runtime PM reference. Nothing to stop, but BAM/MMU lose
+ * their setup.
+ */
+static int __maybe_unused saa716x_budget_runtime_suspend(struct device *dev)
+{
+	struct saa716x_dev *saa716x = dev_get_drvdata(dev);
+	int i;
+
+	for (i = 0; i < saa716x->config->adapters; i++)
+		saa716x_fgpi_invalidate(saa716x,
+				saa716x->config->adap_config[i].ts_fgpi);
+
+	saa716x_budget_hw_suspend(saa716x);
+	return 0;
+}
+
+static int __maybe_unused saa716x_budget_runtime_resume(struct device *dev)
+{
+	saa716x_budget_hw_resume(dev_get_drvdata(dev));
+	return 0;
+}
+
+static const struct dev_pm_ops saa716x_budget_pm_ops = {
+	SET_SYSTEM_SLEEP_PM_OPS(saa716x_budget_suspend,
+				saa716x_budget_resume)
+	SET_RUNTIME_PM_OPS(saa716x_budget_runtime_suspend,
+			   saa716x_budget_runtime_resume, NULL)
+};
+
+/*
+ * PCIe error recovery: the link reset takes the whole bridge down, the
+ * dvb adapters and frontends stay registered and the bridge is brought
+ * back from the state saved at probe or the last suspend. A runtime
+ * suspended bridge is already quiet and may be in D3, it is left to
+ * the runtime resume.
+ */
+static pci_ers_result_t saa716x_budget_error_detected(struct pci_dev *pdev,
+						      pci_channel_state_t state)
+{
+	struct saa716x_dev *saa716x = pci_get_drvdata(pdev);
+	struct saa716x_err_stats *err = &saa716x->err;
+
+	pci_err(pdev, "PCIe error detected, state=%d", state);
+	err->errors++;
+	err->start = ktime_get();
+
+	if (state == pci_channel_io_perm_failure) {
+		err->failed++;
+		return PCI_ERS_RESULT_DISCONNECT;
+	}
+
+	saa716x_i2c_mark(saa716x, true);
+	if (!pm_runtime_suspended(&pdev->dev)) {
+		saa716x_alsa_suspend(saa716x);
+		saa716x_video_suspend(saa716x);
+		saa716x_dvb_suspend(saa716x);
+		saa716x_budget_quiesce(saa716x);
+	}
+	pci_disable_device(pdev);
+
+	return PCI_ERS_RESULT_NEED_RESET;
+}
+
+static pci_ers_result_t saa716x_budget_slot_reset(struct pci_dev *pdev)
+{
+	struct saa716x_dev *saa716x = pci_get_drvdata(pdev);
+
+	if (pci_enable_device(pdev)) {
+		pci_err(pdev, "cannot re-enable device after reset");
+		saa716x->err.failed++;
+		return PCI_ERS_RESULT_DISCONNECT;
+	}
+	pci_set_master(pdev);
+	pci_restore_state(pdev);
+	pci_save_state(pdev);
+
+	if (!pm_runtime_suspended(&pdev->dev))
+		saa716x_budget_restore(saa716x);
+	saa716x_i2c_mark(saa716x, false);
+
+	return PCI_ERS_RESULT_RECOVERED;
+}
+
+static void saa716x_budget_error_resume(struct pci_dev *pdev)
+{
+	struct saa716x_dev *saa716x = pci_get_drvdata(pdev);
+	struct saa716x_err_stats *err = &saa716x->err;
+	u32 us;
+
+	if (!pm_runtime_suspended(&pdev->dev)) {
+		saa716x_dvb_resume(saa716x);
+		saa716x_video_resume(saa716x);
+		saa716x_alsa_resume(saa716x);
+	}
+
+	us = ktime_us_delta(ktime_get(), err->start);
+	err->last_us = us;
+	if (us > err->max_us)
+		err->max_us = us;
+	err->recoveries++;
+	saa716x_timeline_add(saa716x, "error_recovery", -1, err->start);
+
+	pci_info(pdev, "recovered from PCIe error in %u us", us);
+}
+
+static const struct pci_error_handlers saa716x_budget_err_handler = {
+	.error_detected	= saa716x_budget_error_detected,
+	.slot_reset	= saa716x_budget_slot_reset,
+	.resume		= saa716x_budget_error_resume,
+};
+
 #define SAA716x_MODEL_TBS6281		"TurboSight TBS 6281"
 #define SAA716x_DEV_TBS6281		"DVB-T/T2/C"
 
@@ -135,6 +438,7 @@ static int saa716x_tbs6281_frontend_attach(struct saa716x_adapter *adapter,
 	struct i2c_adapter *i2c_adapter;
 	struct si2168_config si2168_config = {};
 	struct si2157_config si2157_config = {};
+	u32 i2c_bus = dev->config->adap_config[count].i2c_bus;
 
 	if (count > 1)
 		goto err;
@@ -153,7 +457,7 @@ static int saa716x_tbs6281_frontend_attach(struct saa716x_adapter *adapter,
 	si2168_config.ts_clock_gapped = true;
 	adapter->i2c_client_demod =
 			dvb_module_probe("si2168", NULL,
-					 &dev->i2c[1 - count].i2c_adapter,
+					 &dev->i2c[i2c_bus].i2c_adapter,
 					 0x64, &si2168_config);
 	if (!adapter->i2c_client_demod)
 		goto err;
@@ -191,12 +495,14 @@ static const struct saa716x_config saa716x_tbs6281_config = {
 		{
 			/* adapter 0 */
 			.ts_vp   = 6,
-			.ts_fgpi = 1
+			.ts_fgpi = 1,
+			.i2c_bus = 1
 		},
 		{
 			/* adapter 1 */
 			.ts_vp   = 2,
-			.ts_fgpi = 3
+			.ts_fgpi = 3,
+			.i2c_bus = 0
 		},
 	},
 };
@@ -211,6 +517,7 @@ static int saa716x_tbs6285_frontend_attach(struct saa716x_adapter *adapter,
 	struct i2c_adapter *i2c_adapter;
 	struct si2168_config si2168_config = {};
 	struct si2157_config si2157_config = {};
+	u32 i2c_bus = dev->config->adap_config[count].i2c_bus;
 
 	if (count > 3)
 		goto err;
@@ -222,9 +529,7 @@ static int saa716x_tbs6285_frontend_attach(struct saa716x_adapter *adapter,
 	si2168_config.ts_clock_gapped = true;
 	adapter->i2c_client_demod =
 			dvb_module_probe("si2168", NULL,
-					 ((count == 0) || (count == 1)) ?
-					  &dev->i2c[1].i2c_adapter :
-					  &dev->i2c[0].i2c_adapter,
+					 &dev->i2c[i2c_bus].i2c_adapter,
 					 ((count == 0) || (count == 2)) ?
 					  0x64 : 0x66,
 					 &si2168_config);
@@ -266,22 +571,26 @@ static const struct saa716x_config saa716x_tbs6285_config = {
 		{
 			/* adapter 0 */
 			.ts_vp   = 2,
-			.ts_fgpi = 3
+			.ts_fgpi = 3,
+			.i2c_bus = 1
 		},
 		{
 			/* adapter 1 */
 			.ts_vp   = 3,
-			.ts_fgpi = 2
+			.ts_fgpi = 2,
+			.i2c_bus = 1
 		},
 		{
 			/* adapter 2 */
 			.ts_vp   = 6,
-			.ts_fgpi = 1
+			.ts_fgpi = 1,
+			.i2c_bus = 0
 		},
 		{
 			/* adapter 3 */
 			.ts_vp   = 5,
-			.ts_fgpi = 0
+			.ts_fgpi = 0,
+			.i2c_bus = 0
 		},
 	},
 };
@@ -299,6 +608,13 @@ static struct pci_driver saa716x_budget_pci_driver = {
 	.id_table		= saa716x_budget_pci_table,
 	.probe			= saa716x_budget_pci_probe,
 	.remove			= saa716x_budget_pci_remove,
+	.err_handler		= &saa716x_budget_err_handler,
+	.driver			= {
+		/* cards bring up their frontends independently */
+		.probe_type	= PROBE_PREFER_ASYNCHRONOUS,
+		.pm		= &saa716x_budget_pm_ops,
+		.dev_groups	= saa716x_pci_groups,
+	},
 };
 
 static int __init saa716x_budget_init(void)
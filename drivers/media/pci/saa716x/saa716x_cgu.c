@@ -41,14 +41,8 @@ char *clk_desc[14] = {
 	"Clk Phy"
 };
 
-int saa716x_getbootscript_setup(struct saa716x_dev *saa716x)
+static void saa716x_cgu_run(struct saa716x_dev *saa716x)
 {
-	struct saa716x_cgu *cgu = &saa716x->cgu;
-
-	u8 i;
-	s8 N = 0;
-	s16 M = 0;
-
 	SAA716x_EPWR(CGU, CGU_PCR_0_6, CGU_PCR_RUN); /* GREG */
 	SAA716x_EPWR(CGU, CGU_PCR_0_3, CGU_PCR_RUN); /* PSS_MMU */
 	SAA716x_EPWR(CGU, CGU_PCR_0_4, CGU_PCR_RUN); /* PSS_DTL2MTL */
@@ -59,6 +53,17 @@ int saa716x_getbootscript_setup(struct saa716x_dev *saa716x)
 	SAA716x_EPWR(CGU, CGU_PCR_2_1, CGU_PCR_RUN); /* SPI */
 	SAA716x_EPWR(CGU, CGU_PCR_1_1, CGU_PCR_RUN); /* DCS */
 	SAA716x_EPWR(CGU, CGU_PCR_3_1, CGU_PCR_RUN); /* BOOT */
+}
+
+int saa716x_getbootscript_setup(struct saa716x_dev *saa716x)
+{
+	struct saa716x_cgu *cgu = &saa716x->cgu;
+
+	u8 i;
+	s8 N = 0;
+	s16 M = 0;
+
+	saa716x_cgu_run(saa716x);
 
 	/* get all dividers */
 	for (i = 0; i < CGU_CLKS; i++) {
@@ -198,9 +203,9 @@ int saa716x_set_clk_internal(struct saa716x_dev *saa716x, u32 port)
 		break;
 	}
 
-	/* wait for PLL */
+	/* glitch free switch, takes a few cycles of the old and new clock */
 	if (delay)
-		msleep(1);
+		usleep_range(10, 20);
 
 	return 0;
 }
@@ -310,7 +315,7 @@ int saa716x_set_clk_external(struct saa716x_dev *saa716x, u32 port)
 	}
 
 	if (delay)
-		msleep(1);
+		usleep_range(10, 20);
 
 	return 0;
 }
@@ -354,13 +359,28 @@ int saa716x_get_clk(struct saa716x_dev *saa716x,
 	return 0;
 }
 
+/* load the current divider of a domain through a divider reset */
+static void saa716x_cgu_write_div(struct saa716x_dev *saa716x, u8 domain)
+{
+	struct saa716x_cgu *cgu = &saa716x->cgu;
+	u32 reset = 0;
+
+	/* Reset */
+	SAA716x_EPWR(CGU, cgu_clk[domain], cgu->clk_curr_div[domain] | 0x2);
+
+	/* Reset disable */
+	if (SAA716x_EPPOLL(CGU, cgu_clk[domain], reset,
+			   reset == cgu->clk_curr_div[domain], 10, 10000))
+		SAA716x_EPWR(CGU, cgu_clk[domain], cgu->clk_curr_div[domain]);
+}
+
 int saa716x_set_clk(struct saa716x_dev *saa716x,
 		    enum saa716x_clk_domain domain,
 		    u32 frequency)
 {
 	struct saa716x_cgu *cgu = &saa716x->cgu;
 
-	u32 M = 1, N = 1, reset, i;
+	u32 M = 1, N = 1;
 	s8 N_tmp, M_tmp, sub, add, lsb;
 
 
@@ -503,30 +523,37 @@ int saa716x_set_clk(struct saa716x_dev *saa716x,
 		M,
 		cgu->clk_curr_div[domain]);
 
-	reset = 0;
+	saa716x_cgu_write_div(saa716x, domain);
 
-	/* Reset */
-	SAA716x_EPWR(CGU, cgu_clk[domain], cgu->clk_curr_div[domain] | 0x2);
+	return 0;
+}
+EXPORT_SYMBOL(saa716x_set_clk);
 
-	/* Reset disable */
-	for (i = 0; i < 1000; i++) {
-		udelay(10);
-		reset = SAA716x_EPRD(CGU, cgu_clk[domain]);
+/*
+ * Bring the CGU back to the state before a power down, without
+ * running the boot script again: only dividers that changed from the
+ * boot values have to be written.
+ */
+void saa716x_cgu_restore(struct saa716x_dev *saa716x)
+{
+	struct saa716x_cgu *cgu = &saa716x->cgu;
+	u8 i;
 
-		if (cgu->clk_curr_div[domain] == reset)
-			break;
-	}
+	saa716x_cgu_run(saa716x);
 
-	if (cgu->clk_curr_div[domain] != reset)
-		SAA716x_EPWR(CGU, cgu_clk[domain], cgu->clk_curr_div[domain]);
+	for (i = 0; i < CGU_CLKS; i++) {
+		if (SAA716x_EPRD(CGU, cgu_clk[i]) != cgu->clk_curr_div[i])
+			saa716x_cgu_write_div(saa716x, i);
+	}
 
-	return 0;
+	saa716x_set_clk_internal(saa716x, PORT_ALL);
 }
-EXPORT_SYMBOL(saa716x_set_clk);
+EXPORT_SYMBOL(saa716x_cgu_restore);
 
 int saa716x_cgu_init(struct saa716x_dev *saa716x)
 {
 	struct saa716x_cgu *cgu = &saa716x->cgu;
+	ktime_t start = ktime_get();
 
 	cgu->clk_freq_min = PLL_FREQ / 255;
 	if (PLL_FREQ > (cgu->clk_freq_min * 255))
@@ -537,6 +564,7 @@ int saa716x_cgu_init(struct saa716x_dev *saa716x)
 	saa716x_getbootscript_setup(saa716x);
 	saa716x_set_clk_internal(saa716x, PORT_ALL);
 
+	saa716x_timeline_add(saa716x, "cgu_init", -1, start);
 	return 0;
 }
 EXPORT_SYMBOL(saa716x_cgu_init);
@@ -5,6 +5,9 @@
 
 #define PLL_FREQ	2500
 
+/* clk_freq[] and PLL_FREQ are kept in units of 100kHz */
+#define CGU_FREQ_UNIT	100000
+
 #define SAA716x_CGU_CLKRUN(__reg)  do {					   \
 	SAA716x_EPWR(CGU, CGU_PCR_##__reg, CGU_PCR_RUN); /* Run */	   \
 	SAA716x_EPWR(CGU, CGU_SCR_##__reg, CGU_SCR_ENF1); /* Switch */	   \
@@ -61,5 +64,6 @@ extern int saa716x_set_clk_internal(struct saa716x_dev *saa716x, u32 port);
 extern int saa716x_set_clk_external(struct saa716x_dev *saa716x, u32 port);
 extern int saa716x_set_clk(struct saa716x_dev *saa716x,
 			   enum saa716x_clk_domain domain, u32 frequency);
+extern void saa716x_cgu_restore(struct saa716x_dev *saa716x);
 
 #endif /* __SAA716x_CGU_H */
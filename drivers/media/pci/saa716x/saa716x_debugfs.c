@@ -0,0 +1,292 @@
+// SPDX-License-Identifier: GPL-2.0+
+
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/irq.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/pm_runtime.h>
+#include <linux/seq_file.h>
+#include <linux/topology.h>
+#include <linux/vmalloc.h>
+
+#include "saa716x_debugfs.h"
+#include "saa716x_priv.h"
+
+static struct dentry *saa716x_debugfs_root;
+
+void saa716x_timeline_init(struct saa716x_dev *saa716x)
+{
+	struct saa716x_timeline *tl = &saa716x->timeline;
+
+	spin_lock_init(&tl->lock);
+	tl->base = ktime_get();
+	tl->head = 0;
+	tl->count = 0;
+}
+EXPORT_SYMBOL_GPL(saa716x_timeline_init);
+
+/* record a stage that started at start and ends now */
+void saa716x_timeline_add(struct saa716x_dev *saa716x, const char *stage,
+			  int index, ktime_t start)
+{
+	struct saa716x_timeline *tl = &saa716x->timeline;
+	struct saa716x_timeline_event *ev;
+	ktime_t now = ktime_get();
+	unsigned long flags;
+
+	spin_lock_irqsave(&tl->lock, flags);
+	ev = &tl->event[tl->head];
+	ev->stage = stage;
+	ev->index = index;
+	ev->start = start;
+	ev->duration = ktime_sub(now, start);
+
+	tl->head = (tl->head + 1) % SAA716x_TIMELINE_EVENTS;
+	if (tl->count < SAA716x_TIMELINE_EVENTS)
+		tl->count++;
+	spin_unlock_irqrestore(&tl->lock, flags);
+
+	pci_dbg(saa716x->pdev, "%s[%d] took %lld us", stage, index,
+		ktime_to_us(ev->duration));
+}
+EXPORT_SYMBOL_GPL(saa716x_timeline_add);
+
+static int saa716x_timeline_show(struct seq_file *s, void *unused)
+{
+	struct saa716x_dev *saa716x = s->private;
+	struct saa716x_timeline *tl = &saa716x->timeline;
+	struct saa716x_timeline_event ev;
+	unsigned int i, first;
+	unsigned long flags;
+
+	seq_puts(s, "# start[us]  duration[us]  stage[index]\n");
+
+	spin_lock_irqsave(&tl->lock, flags);
+	first = (tl->head + SAA716x_TIMELINE_EVENTS - tl->count) %
+		SAA716x_TIMELINE_EVENTS;
+	for (i = 0; i < tl->count; i++) {
+		ev = tl->event[(first + i) % SAA716x_TIMELINE_EVENTS];
+		seq_printf(s, "%12lld  %12lld  %s[%d]\n",
+			   ktime_us_delta(ev.start, tl->base),
+			   ktime_to_us(ev.duration),
+			   ev.stage, ev.index);
+	}
+	spin_unlock_irqrestore(&tl->lock, flags);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(saa716x_timeline);
+
+static int saa716x_pm_show(struct seq_file *s, void *unused)
+{
+	struct saa716x_dev *saa716x = s->private;
+	struct saa716x_pm_state *pm = &saa716x->pm;
+	int i;
+
+	seq_printf(s, "suspends:    %u\n", pm->suspends);
+	seq_printf(s, "resumes:     %u\n", pm->resumes);
+	seq_printf(s, "resume [us]: %u\n", pm->resume_us);
+
+	for (i = 0; i < saa716x->config->adapters; i++)
+		seq_printf(s, "adapter %d resume to first packet [us]: %u\n",
+			   i, saa716x->saa716x_adap[i].resume_us);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(saa716x_pm);
+
+/* TS DMA rate per adapter with the PCIe setting in effect */
+static int saa716x_pcie_throughput_show(struct seq_file *s, void *unused)
+{
+	struct saa716x_dev *saa716x = s->private;
+	struct saa716x_pcie_bench *bench = &saa716x->pcie_bench;
+	struct saa716x_fgpi_stream_port *fgpi;
+	struct pci_dev *pdev = saa716x->pdev;
+	u16 devctl = 0;
+	u64 elapsed_us, bytes;
+	int i;
+
+	pcie_capability_read_word(pdev, PCI_EXP_DEVCTL, &devctl);
+	seq_printf(s, "MPS %d MRRS %d RO %d NS %d\n",
+		   pcie_get_mps(pdev), pcie_get_readrq(pdev),
+		   !!(devctl & PCI_EXP_DEVCTL_RELAX_EN),
+		   !!(devctl & PCI_EXP_DEVCTL_NOSNOOP_EN));
+
+	elapsed_us = ktime_us_delta(ktime_get(), bench->start);
+	seq_printf(s, "measured for %llu ms\n", div_u64(elapsed_us, 1000));
+	if (!elapsed_us)
+		return 0;
+
+	for (i = 0; i < saa716x->config->adapters; i++) {
+		fgpi = &saa716x->fgpi[saa716x->config->adap_config[i].ts_fgpi];
+		bytes = READ_ONCE(fgpi->hot.bytes) - bench->bytes[i];
+		seq_printf(s, "adapter %d: %llu bytes, %llu kbit/s\n", i,
+			   bytes, div64_u64(bytes * 8000, elapsed_us));
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(saa716x_pcie_throughput);
+
+static int saa716x_buf_node(void *addr)
+{
+	struct page *pg;
+
+	if (!addr)
+		return NUMA_NO_NODE;
+
+	pg = is_vmalloc_addr(addr) ? vmalloc_to_page(addr) :
+				     virt_to_page(addr);
+	return pg ? page_to_nid(pg) : NUMA_NO_NODE;
+}
+
+/* where the streaming path lives, compared to the device */
+static int saa716x_placement_show(struct seq_file *s, void *unused)
+{
+	struct saa716x_dev *saa716x = s->private;
+	struct saa716x_fgpi_stream_port *fgpi;
+	int node = dev_to_node(&saa716x->pdev->dev);
+	int irq = pci_irq_vector(saa716x->pdev, 0);
+	int i;
+
+	seq_printf(s, "device node: %d\n", node);
+	if (node != NUMA_NO_NODE)
+		seq_printf(s, "node cpus:   %*pbl\n",
+			   cpumask_pr_args(cpumask_of_node(node)));
+	seq_printf(s, "irq %d cpus:  %*pbl\n", irq,
+		   cpumask_pr_args(irq_get_effective_affinity_mask(irq)));
+	seq_printf(s, "saa716x_dev: node %d\n", saa716x_buf_node(saa716x));
+
+	for (i = 0; i < saa716x->config->adapters; i++) {
+		fgpi = &saa716x->fgpi[saa716x->config->adap_config[i].ts_fgpi];
+
+		seq_printf(s, "adapter %d: buffer node %d, page table node %d, tasklet local %u remote %u\n",
+			   i, saa716x_buf_node(fgpi->dma_buf[0].mem_virt),
+			   saa716x_buf_node(fgpi->dma_buf[0].mem_ptab_virt),
+			   fgpi->hot.bh_local, fgpi->hot.bh_remote);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(saa716x_placement);
+
+static int saa716x_err_show(struct seq_file *s, void *unused)
+{
+	struct saa716x_dev *saa716x = s->private;
+	struct saa716x_err_stats *err = &saa716x->err;
+
+	seq_printf(s, "errors:        %u\n", err->errors);
+	seq_printf(s, "recoveries:    %u\n", err->recoveries);
+	seq_printf(s, "failed:        %u\n", err->failed);
+	seq_printf(s, "recovery [us]: last %u max %u\n",
+		   err->last_us, err->max_us);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(saa716x_err);
+
+/*
+ * Run the driver's PCIe error recovery as the AER core would for a
+ * non-fatal error, with a function reset in place of the link reset.
+ * The device lock keeps remove and unbind out, like the AER core does.
+ * Remove holds it while it waits for this file to go, so it is only
+ * tried.
+ */
+static ssize_t saa716x_inject_error_write(struct file *file,
+					  const char __user *buf,
+					  size_t count, loff_t *ppos)
+{
+	struct saa716x_dev *saa716x = file->private_data;
+	struct pci_dev *pdev = saa716x->pdev;
+	const struct pci_error_handlers *err_handler;
+	pci_ers_result_t result;
+	ssize_t ret;
+
+	if (!device_trylock(&pdev->dev))
+		return -EBUSY;
+
+	if (!pdev->dev.driver) {
+		ret = -ENODEV;
+		goto out_unlock;
+	}
+	err_handler = to_pci_driver(pdev->dev.driver)->err_handler;
+	if (!err_handler) {
+		ret = -EOPNOTSUPP;
+		goto out_unlock;
+	}
+
+	ret = pm_runtime_get_sync(&pdev->dev);
+	if (ret < 0)
+		goto out_put;
+
+	ret = -EIO;
+	result = err_handler->error_detected(pdev, pci_channel_io_frozen);
+	if (result != PCI_ERS_RESULT_NEED_RESET)
+		goto out_put;
+
+	if (pci_reset_function_locked(pdev))
+		pci_err(pdev, "function reset failed");
+
+	result = err_handler->slot_reset(pdev);
+	if (result != PCI_ERS_RESULT_RECOVERED)
+		goto out_put;
+
+	err_handler->resume(pdev);
+	ret = count;
+
+out_put:
+	pm_runtime_mark_last_busy(&pdev->dev);
+	pm_runtime_put_autosuspend(&pdev->dev);
+out_unlock:
+	device_unlock(&pdev->dev);
+	return ret;
+}
+
+static const struct file_operations saa716x_inject_error_fops = {
+	.owner	= THIS_MODULE,
+	.open	= simple_open,
+	.write	= saa716x_inject_error_write,
+	.llseek	= noop_llseek,
+};
+
+void saa716x_debugfs_init(struct saa716x_dev *saa716x)
+{
+	saa716x->debugfs = debugfs_create_dir(pci_name(saa716x->pdev),
+					      saa716x_debugfs_root);
+
+	debugfs_create_file("timeline", 0444, saa716x->debugfs, saa716x,
+			    &saa716x_timeline_fops);
+	debugfs_create_file("pm", 0444, saa716x->debugfs, saa716x,
+			    &saa716x_pm_fops);
+	debugfs_create_file("pcie_errors", 0444, saa716x->debugfs, saa716x,
+			    &saa716x_err_fops);
+	debugfs_create_file("pcie_throughput", 0444, saa716x->debugfs,
+			    saa716x, &saa716x_pcie_throughput_fops);
+	debugfs_create_file("placement", 0444, saa716x->debugfs, saa716x,
+			    &saa716x_placement_fops);
+	debugfs_create_file("inject_error", 0200, saa716x->debugfs, saa716x,
+			    &saa716x_inject_error_fops);
+}
+EXPORT_SYMBOL_GPL(saa716x_debugfs_init);
+
+void saa716x_debugfs_exit(struct saa716x_dev *saa716x)
+{
+	debugfs_remove_recursive(saa716x->debugfs);
+	saa716x->debugfs = NULL;
+}
+EXPORT_SYMBOL_GPL(saa716x_debugfs_exit);
+
+static int __init saa716x_core_init(void)
+{
+	saa716x_debugfs_root = debugfs_create_dir("saa716x", NULL);
+	return 0;
+}
+
+static void __exit saa716x_core_exit(void)
+{
+	debugfs_remove_recursive(saa716x_debugfs_root);
+}
+
+module_init(saa716x_core_init);
+module_exit(saa716x_core_exit);
@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+
+#ifndef __SAA716x_DEBUGFS_H
+#define __SAA716x_DEBUGFS_H
+
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+
+#define SAA716x_TIMELINE_EVENTS	64
+
+/*
+ * Timeline event
+ * stage: name of the probe or stream start stage
+ * index: port, bus or adapter the stage ran for, -1 if none
+ * start: start of the stage
+ * duration: time the stage took
+ */
+struct saa716x_timeline_event {
+	const char		*stage;
+	int			index;
+	ktime_t			start;
+	ktime_t			duration;
+};
+
+struct saa716x_timeline {
+	spinlock_t			lock;
+	ktime_t				base;
+	unsigned int			head;
+	unsigned int			count;
+	struct saa716x_timeline_event	event[SAA716x_TIMELINE_EVENTS];
+};
+
+struct saa716x_dev;
+
+extern void saa716x_timeline_init(struct saa716x_dev *saa716x);
+extern void saa716x_timeline_add(struct saa716x_dev *saa716x,
+				 const char *stage, int index, ktime_t start);
+
+extern void saa716x_debugfs_init(struct saa716x_dev *saa716x);
+extern void saa716x_debugfs_exit(struct saa716x_dev *saa716x);
+
+#endif /* __SAA716x_DEBUGFS_H */
@@ -1,8 +1,10 @@
 // SPDX-License-Identifier: GPL-2.0+
 
+#include <linux/gfp.h>
 #include <linux/kernel.h>
 #include <linux/pci.h>
 #include <linux/scatterlist.h>
+#include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include <asm/page.h>
 #include <asm/pgtable.h>
@@ -18,14 +20,15 @@ static int saa716x_allocate_ptable(struct saa716x_dmabuf *dmabuf)
 {
 	struct saa716x_dev *saa716x	= dmabuf->saa716x;
 	struct pci_dev *pdev		= saa716x->pdev;
+	struct page *pg;
 
 	pci_dbg(saa716x->pdev, "SG Page table allocate");
-	dmabuf->mem_ptab_virt = (void *) __get_free_page(GFP_KERNEL);
-
-	if (dmabuf->mem_ptab_virt == NULL) {
+	pg = alloc_pages_node(dev_to_node(&pdev->dev), GFP_KERNEL, 0);
+	if (pg == NULL) {
 		pci_err(saa716x->pdev, "ERROR: Out of pages !");
 		return -ENOMEM;
 	}
+	dmabuf->mem_ptab_virt = page_address(pg);
 
 	dmabuf->mem_ptab_phys = dma_map_single(&pdev->dev,
 						dmabuf->mem_ptab_virt,
@@ -90,6 +93,7 @@ static void saa716x_dmabuf_sgfree(struct saa716x_dmabuf *dmabuf)
 static int saa716x_dmabuf_sgalloc(struct saa716x_dmabuf *dmabuf, int size)
 {
 	struct saa716x_dev *saa716x	= dmabuf->saa716x;
+	int node			= dev_to_node(&saa716x->pdev->dev);
 	struct scatterlist *list;
 	struct page *pg;
 
@@ -105,16 +109,17 @@ static int saa716x_dmabuf_sgalloc(struct saa716x_dmabuf *dmabuf, int size)
 		pages = size / SAA716x_PAGE_SIZE;
 
 	/* Allocate memory for SG list */
-	dmabuf->sg_list = kcalloc(pages, sizeof(struct scatterlist),
-				  GFP_KERNEL);
+	dmabuf->sg_list = kcalloc_node(pages, sizeof(struct scatterlist),
+				       GFP_KERNEL, node);
 	if (dmabuf->sg_list == NULL)
 		return -ENOMEM;
 
 	pci_dbg(saa716x->pdev, "Initializing SG table");
 	sg_init_table(dmabuf->sg_list, pages);
 
-	/* allocate memory, unaligned */
-	dmabuf->mem_virt_noalign = vzalloc((pages + 1) * SAA716x_PAGE_SIZE);
+	/* allocate memory close to the device, unaligned */
+	dmabuf->mem_virt_noalign = vzalloc_node((pages + 1) * SAA716x_PAGE_SIZE,
+						node);
 	if (dmabuf->mem_virt_noalign == NULL)
 		return -ENOMEM;
 
@@ -295,3 +300,68 @@ void saa716x_dmabuf_free(struct saa716x_dev *saa716x,
 	saa716x_dmabuf_sgfree(dmabuf);
 	saa716x_free_ptable(dmabuf);
 }
+
+/* Page table only, for buffers the driver does not own */
+int saa716x_dmabuf_ptab_alloc(struct saa716x_dev *saa716x,
+			      struct saa716x_dmabuf *dmabuf)
+{
+	int ret;
+
+	memset(dmabuf, 0, sizeof(*dmabuf));
+	dmabuf->dma_type = SAA716x_DMABUF_EXT_SG;
+	dmabuf->saa716x = saa716x;
+
+	ret = saa716x_allocate_ptable(dmabuf);
+	if (ret < 0)
+		saa716x_free_ptable(dmabuf);
+
+	return ret;
+}
+
+void saa716x_dmabuf_ptab_free(struct saa716x_dmabuf *dmabuf)
+{
+	if (dmabuf->saa716x)
+		saa716x_free_ptable(dmabuf);
+}
+
+/*
+ * Fill the page table with the 4k pages of a mapped SG list, starting
+ * at page first. Entries past the end repeat the last page.
+ */
+void saa716x_dmabuf_ptab_fill(struct saa716x_dmabuf *dmabuf,
+			      struct scatterlist *sg_list, int nents,
+			      int first)
+{
+	struct pci_dev *pdev = dmabuf->saa716x->pdev;
+	struct scatterlist *sg;
+	dma_addr_t addr = 0;
+	unsigned int off;
+	int i, k = 0, n = 0;
+	u32 *page;
+
+	dma_sync_single_for_cpu(&pdev->dev, dmabuf->mem_ptab_phys,
+				SAA716x_PAGE_SIZE, DMA_TO_DEVICE);
+	page = dmabuf->mem_ptab_virt;
+
+	for_each_sg(sg_list, sg, nents, i) {
+		for (off = 0; off < sg_dma_len(sg); off += SAA716x_PAGE_SIZE) {
+			if (n++ < first)
+				continue;
+			if (k == SAA716x_PAGE_SIZE / 8)
+				goto done;
+
+			addr = sg_dma_address(sg) + off;
+			page[k * 2] = PTA_LSB(addr);
+			page[k * 2 + 1] = PTA_MSB(addr);
+			k++;
+		}
+	}
+done:
+	for (; k < SAA716x_PAGE_SIZE / 8; k++) {
+		page[k * 2] = PTA_LSB(addr);
+		page[k * 2 + 1] = PTA_MSB(addr);
+	}
+
+	dma_sync_single_for_device(&pdev->dev, dmabuf->mem_ptab_phys,
+				   SAA716x_PAGE_SIZE, DMA_TO_DEVICE);
+}
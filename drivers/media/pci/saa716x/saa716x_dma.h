@@ -37,6 +37,7 @@ enum saa716x_dma_type {
 };
 
 struct saa716x_dev;
+struct scatterlist;
 
 struct saa716x_dmabuf {
 	enum saa716x_dma_type	dma_type;
@@ -59,6 +60,13 @@ extern int saa716x_dmabuf_alloc(struct saa716x_dev *saa716x,
 extern void saa716x_dmabuf_free(struct saa716x_dev *saa716x,
 				struct saa716x_dmabuf *dmabuf);
 
+extern int saa716x_dmabuf_ptab_alloc(struct saa716x_dev *saa716x,
+				     struct saa716x_dmabuf *dmabuf);
+extern void saa716x_dmabuf_ptab_free(struct saa716x_dmabuf *dmabuf);
+extern void saa716x_dmabuf_ptab_fill(struct saa716x_dmabuf *dmabuf,
+				     struct scatterlist *sg_list, int nents,
+				     int first);
+
 extern void saa716x_dmabufsync_dev(struct saa716x_dmabuf *dmabuf);
 extern void saa716x_dmabufsync_cpu(struct saa716x_dmabuf *dmabuf);
 
@@ -201,4 +201,7 @@
 #define MMU_PTA7_LSB(__ch)		(MMU_PTA_BASE(__ch) + 0x38)
 #define MMU_PTA7_MSB(__ch)		(MMU_PTA_BASE(__ch) + 0x3c)
 
+#define MMU_PTA_LSB(__ch, __n)		(MMU_PTA_BASE(__ch) + (__n) * 0x08)
+#define MMU_PTA_MSB(__ch, __n)		(MMU_PTA_LSB(__ch, __n) + 0x04)
+
 #endif /* __SAA716x_DMA_REG_H */
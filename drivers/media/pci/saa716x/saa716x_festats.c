@@ -0,0 +1,357 @@
+// SPDX-License-Identifier: GPL-2.0+
+
+#include <linux/debugfs.h>
+#include <linux/jiffies.h>
+#include <linux/module.h>
+#include <linux/pm_runtime.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+
+#include "saa716x_festats.h"
+#include "saa716x_priv.h"
+
+static unsigned int fe_stats_ms = 1000;
+module_param(fe_stats_ms, uint, 0444);
+MODULE_PARM_DESC(fe_stats_ms,
+	"refresh the frontend signal statistics in the background this often and serve reads from them (ms, 0=off)");
+
+/*
+ * A value read within the last refresh period is as good as a new read,
+ * whoever asks. Older ones and those of before a retune go to the
+ * frontend.
+ */
+static bool saa716x_fe_stats_get(struct saa716x_fe_stats *stats,
+				 enum saa716x_fe_stat stat, u32 *value)
+{
+	unsigned long maxage = msecs_to_jiffies(fe_stats_ms);
+	bool hit;
+
+	spin_lock(&stats->lock);
+	hit = fe_stats_ms && (stats->valid & BIT(stat)) &&
+	      time_before(jiffies, stats->stamp[stat] + maxage);
+	if (hit) {
+		*value = stats->value[stat];
+		stats->hits++;
+	} else {
+		stats->misses++;
+	}
+	spin_unlock(&stats->lock);
+
+	return hit;
+}
+
+static void saa716x_fe_stats_put(struct saa716x_fe_stats *stats,
+				 enum saa716x_fe_stat stat, u32 value)
+{
+	spin_lock(&stats->lock);
+	stats->value[stat] = value;
+	stats->stamp[stat] = jiffies;
+	stats->valid |= BIT(stat);
+	spin_unlock(&stats->lock);
+}
+
+/*
+ * Every op that goes to the frontend holds ops_lock: the refresh runs
+ * beside the frontend thread, which is all dvb-core serializes. An op
+ * called from another one under the lock does not take it again.
+ */
+bool saa716x_fe_lock(struct saa716x_fe_stats *stats)
+{
+	if (READ_ONCE(stats->ops_owner) == current)
+		return false;
+
+	mutex_lock(&stats->ops_lock);
+	WRITE_ONCE(stats->ops_owner, current);
+
+	return true;
+}
+EXPORT_SYMBOL_GPL(saa716x_fe_lock);
+
+void saa716x_fe_unlock(struct saa716x_fe_stats *stats, bool locked)
+{
+	if (!locked)
+		return;
+
+	WRITE_ONCE(stats->ops_owner, NULL);
+	mutex_unlock(&stats->ops_lock);
+}
+EXPORT_SYMBOL_GPL(saa716x_fe_unlock);
+
+/* on init and retune, nothing read before is true any longer */
+void saa716x_fe_stats_invalidate(struct saa716x_fe_stats *stats)
+{
+	spin_lock(&stats->lock);
+	stats->valid = 0;
+	stats->busy = jiffies;
+	spin_unlock(&stats->lock);
+}
+EXPORT_SYMBOL_GPL(saa716x_fe_stats_invalidate);
+
+/* a lock on the mux tuned in epoch lets the PSI cache take sections */
+static int saa716x_fe_read_status(struct dvb_frontend *fe,
+				  enum fe_status *status)
+{
+	struct saa716x_adapter *saa716x_adap = fe->dvb->priv;
+	struct saa716x_fe_stats *stats = &saa716x_adap->fe_stats;
+	u32 epoch = saa716x_psi_epoch(&saa716x_adap->psi);
+	bool locked;
+	u32 value;
+	int ret;
+
+	if (saa716x_fe_stats_get(stats, SAA716x_FE_STAT_STATUS, &value)) {
+		*status = value;
+		saa716x_psi_status(&saa716x_adap->psi, epoch, *status);
+		return 0;
+	}
+
+	locked = saa716x_fe_lock(stats);
+	ret = saa716x_adap->fe_ops.read_status(fe, status);
+	saa716x_fe_unlock(stats, locked);
+	if (!ret) {
+		saa716x_fe_stats_put(stats, SAA716x_FE_STAT_STATUS, *status);
+		saa716x_psi_status(&saa716x_adap->psi, epoch, *status);
+	}
+	return ret;
+}
+
+static int saa716x_fe_read_signal_strength(struct dvb_frontend *fe,
+					   u16 *strength)
+{
+	struct saa716x_adapter *saa716x_adap = fe->dvb->priv;
+	struct saa716x_fe_stats *stats = &saa716x_adap->fe_stats;
+	bool locked;
+	u32 value;
+	int ret;
+
+	if (saa716x_fe_stats_get(stats, SAA716x_FE_STAT_STRENGTH, &value)) {
+		*strength = value;
+		return 0;
+	}
+
+	locked = saa716x_fe_lock(stats);
+	ret = saa716x_adap->fe_ops.read_signal_strength(fe, strength);
+	saa716x_fe_unlock(stats, locked);
+	if (!ret)
+		saa716x_fe_stats_put(stats, SAA716x_FE_STAT_STRENGTH,
+				     *strength);
+	return ret;
+}
+
+static int saa716x_fe_read_snr(struct dvb_frontend *fe, u16 *snr)
+{
+	struct saa716x_adapter *saa716x_adap = fe->dvb->priv;
+	struct saa716x_fe_stats *stats = &saa716x_adap->fe_stats;
+	bool locked;
+	u32 value;
+	int ret;
+
+	if (saa716x_fe_stats_get(stats, SAA716x_FE_STAT_SNR, &value)) {
+		*snr = value;
+		return 0;
+	}
+
+	locked = saa716x_fe_lock(stats);
+	ret = saa716x_adap->fe_ops.read_snr(fe, snr);
+	saa716x_fe_unlock(stats, locked);
+	if (!ret)
+		saa716x_fe_stats_put(stats, SAA716x_FE_STAT_SNR, *snr);
+	return ret;
+}
+
+static int saa716x_fe_read_ber(struct dvb_frontend *fe, u32 *ber)
+{
+	struct saa716x_adapter *saa716x_adap = fe->dvb->priv;
+	struct saa716x_fe_stats *stats = &saa716x_adap->fe_stats;
+	bool locked;
+	int ret;
+
+	if (saa716x_fe_stats_get(stats, SAA716x_FE_STAT_BER, ber))
+		return 0;
+
+	locked = saa716x_fe_lock(stats);
+	ret = saa716x_adap->fe_ops.read_ber(fe, ber);
+	saa716x_fe_unlock(stats, locked);
+	if (!ret)
+		saa716x_fe_stats_put(stats, SAA716x_FE_STAT_BER, *ber);
+	return ret;
+}
+
+static int saa716x_fe_read_ucblocks(struct dvb_frontend *fe, u32 *ucblocks)
+{
+	struct saa716x_adapter *saa716x_adap = fe->dvb->priv;
+	struct saa716x_fe_stats *stats = &saa716x_adap->fe_stats;
+	bool locked;
+	int ret;
+
+	if (saa716x_fe_stats_get(stats, SAA716x_FE_STAT_UCB, ucblocks))
+		return 0;
+
+	locked = saa716x_fe_lock(stats);
+	ret = saa716x_adap->fe_ops.read_ucblocks(fe, ucblocks);
+	saa716x_fe_unlock(stats, locked);
+	if (!ret)
+		saa716x_fe_stats_put(stats, SAA716x_FE_STAT_UCB, *ucblocks);
+	return ret;
+}
+
+/*
+ * The refresh reads through the demod driver's ops and fills the
+ * cache; ops_lock is held over all of them and the frontend thread
+ * waits. A read of the status also updates the DVBv5 statistics of the
+ * property cache on the demods that have them, which FE_GET_PROPERTY
+ * returns without I2C.
+ */
+static void saa716x_fe_stats_refresh(struct saa716x_adapter *saa716x_adap,
+				     struct saa716x_i2c *i2c)
+{
+	struct saa716x_fe_stats *stats = &saa716x_adap->fe_stats;
+	struct dvb_frontend_ops *ops = &saa716x_adap->fe_ops;
+	struct dvb_frontend *fe = saa716x_adap->fe;
+	unsigned long period = msecs_to_jiffies(fe_stats_ms);
+	enum fe_status status;
+	u32 epoch;
+	u16 val16;
+	u32 val32;
+
+	/* tuning and firmware downloads go first */
+	if (time_before(jiffies, READ_ONCE(stats->busy) + period) ||
+	    saa716x_i2c_busy(i2c) || !mutex_trylock(&stats->ops_lock)) {
+		stats->skipped++;
+		return;
+	}
+	WRITE_ONCE(stats->ops_owner, current);
+
+	epoch = saa716x_psi_epoch(&saa716x_adap->psi);
+	if (ops->read_status) {
+		if (ops->read_status(fe, &status))
+			goto out;
+		saa716x_fe_stats_put(stats, SAA716x_FE_STAT_STATUS, status);
+		saa716x_psi_status(&saa716x_adap->psi, epoch, status);
+	}
+	if (ops->read_signal_strength &&
+	    !ops->read_signal_strength(fe, &val16))
+		saa716x_fe_stats_put(stats, SAA716x_FE_STAT_STRENGTH, val16);
+	if (ops->read_snr && !ops->read_snr(fe, &val16))
+		saa716x_fe_stats_put(stats, SAA716x_FE_STAT_SNR, val16);
+	if (ops->read_ber && !ops->read_ber(fe, &val32))
+		saa716x_fe_stats_put(stats, SAA716x_FE_STAT_BER, val32);
+	if (ops->read_ucblocks && !ops->read_ucblocks(fe, &val32))
+		saa716x_fe_stats_put(stats, SAA716x_FE_STAT_UCB, val32);
+
+	stats->refreshes++;
+out:
+	saa716x_fe_unlock(stats, true);
+}
+
+static void saa716x_fe_stats_work(struct work_struct *work)
+{
+	struct saa716x_fe_stats_bus *bus = container_of(work,
+				struct saa716x_fe_stats_bus, work.work);
+	struct saa716x_dev *saa716x = bus->saa716x;
+	struct saa716x_config *config = saa716x->config;
+	struct device *dev = &saa716x->pdev->dev;
+	int i;
+
+	/* only while a frontend is open, never wake the device up for it */
+	if (pm_runtime_get_if_in_use(dev) > 0) {
+		for (i = 0; i < config->adapters; i++) {
+			if (config->adap_config[i].i2c_bus != bus->bus ||
+			    !saa716x->saa716x_adap[i].fe)
+				continue;
+
+			saa716x_fe_stats_refresh(&saa716x->saa716x_adap[i],
+						 &saa716x->i2c[bus->bus]);
+		}
+		pm_runtime_put_autosuspend(dev);
+	}
+
+	schedule_delayed_work(&bus->work, msecs_to_jiffies(fe_stats_ms));
+}
+
+static int saa716x_fe_stats_show(struct seq_file *s, void *unused)
+{
+	struct saa716x_fe_stats *stats = s->private;
+	static const char * const names[SAA716x_FE_STATS] = {
+		"status", "strength", "snr", "ber", "ucblocks"
+	};
+	int i;
+
+	spin_lock(&stats->lock);
+	seq_printf(s, "hits:      %u\n", stats->hits);
+	seq_printf(s, "misses:    %u\n", stats->misses);
+	seq_printf(s, "refreshes: %u\n", stats->refreshes);
+	seq_printf(s, "skipped:   %u\n", stats->skipped);
+	for (i = 0; i < SAA716x_FE_STATS; i++) {
+		if (!(stats->valid & BIT(i)))
+			continue;
+		seq_printf(s, "%-10s 0x%08x, %u ms old\n", names[i],
+			   stats->value[i],
+			   jiffies_to_msecs(jiffies - stats->stamp[i]));
+	}
+	spin_unlock(&stats->lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(saa716x_fe_stats);
+
+void saa716x_fe_stats_init(struct saa716x_adapter *saa716x_adap)
+{
+	struct saa716x_fe_stats *stats = &saa716x_adap->fe_stats;
+
+	spin_lock_init(&stats->lock);
+	mutex_init(&stats->ops_lock);
+	stats->busy = jiffies;
+	debugfs_create_file("fe_stats", 0444, saa716x_adap->debugfs, stats,
+			    &saa716x_fe_stats_fops);
+}
+EXPORT_SYMBOL_GPL(saa716x_fe_stats_init);
+
+/* once the demod driver's ops are copied to saa716x_adap->fe_ops */
+void saa716x_fe_stats_hook(struct saa716x_adapter *saa716x_adap)
+{
+	struct dvb_frontend_ops *ops = &saa716x_adap->fe->ops;
+
+	if (ops->read_status)
+		ops->read_status = saa716x_fe_read_status;
+	if (ops->read_signal_strength)
+		ops->read_signal_strength = saa716x_fe_read_signal_strength;
+	if (ops->read_snr)
+		ops->read_snr = saa716x_fe_read_snr;
+	if (ops->read_ber)
+		ops->read_ber = saa716x_fe_read_ber;
+	if (ops->read_ucblocks)
+		ops->read_ucblocks = saa716x_fe_read_ucblocks;
+}
+EXPORT_SYMBOL_GPL(saa716x_fe_stats_hook);
+
+/* one work item per I2C bus, so that a slow bus does not hold up the other */
+void saa716x_fe_stats_start(struct saa716x_dev *saa716x)
+{
+	struct saa716x_fe_stats_bus *bus;
+	int i;
+
+	if (!fe_stats_ms)
+		return;
+
+	for (i = 0; i < SAA716x_I2C_ADAPTERS; i++) {
+		bus = &saa716x->fe_stats_bus[i];
+		bus->saa716x = saa716x;
+		bus->bus = i;
+		INIT_DELAYED_WORK(&bus->work, saa716x_fe_stats_work);
+		schedule_delayed_work(&bus->work, msecs_to_jiffies(fe_stats_ms));
+	}
+}
+EXPORT_SYMBOL_GPL(saa716x_fe_stats_start);
+
+void saa716x_fe_stats_stop(struct saa716x_dev *saa716x)
+{
+	struct saa716x_fe_stats_bus *bus;
+	int i;
+
+	for (i = 0; i < SAA716x_I2C_ADAPTERS; i++) {
+		bus = &saa716x->fe_stats_bus[i];
+		if (bus->saa716x)
+			cancel_delayed_work_sync(&bus->work);
+	}
+}
+EXPORT_SYMBOL_GPL(saa716x_fe_stats_stop);
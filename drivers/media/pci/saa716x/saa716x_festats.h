@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+
+#ifndef __SAA716x_FESTATS_H
+#define __SAA716x_FESTATS_H
+
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+
+#include <media/dvb_frontend.h>
+
+enum saa716x_fe_stat {
+	SAA716x_FE_STAT_STATUS = 0,
+	SAA716x_FE_STAT_STRENGTH,
+	SAA716x_FE_STAT_SNR,
+	SAA716x_FE_STAT_BER,
+	SAA716x_FE_STAT_UCB,
+	SAA716x_FE_STATS
+};
+
+/*
+ * Signal statistics of a frontend, as last read over I2C
+ * valid: values read since the last retune, bit per saa716x_fe_stat
+ * stamp: jiffies of every value
+ * busy: jiffies of the last init or retune, the refresh keeps off then
+ * hits: reads served from the cache, misses: reads passed on
+ * refreshes: background reads done, skipped: held back for a busy bus
+ * ops_lock: serializes the frontend ops, demods are not reentrant
+ * ops_owner: task holding ops_lock, the ops may call each other
+ */
+struct saa716x_fe_stats {
+	spinlock_t		lock;
+	u32			value[SAA716x_FE_STATS];
+	unsigned long		stamp[SAA716x_FE_STATS];
+	u8			valid;
+	unsigned long		busy;
+
+	u32			hits;
+	u32			misses;
+	u32			refreshes;
+	u32			skipped;
+
+	struct mutex		ops_lock;
+	struct task_struct	*ops_owner;
+};
+
+/* background refresh of the frontends on one I2C bus */
+struct saa716x_fe_stats_bus {
+	struct delayed_work	work;
+	struct saa716x_dev	*saa716x;
+	u8			bus;
+};
+
+struct saa716x_adapter;
+
+extern void saa716x_fe_stats_init(struct saa716x_adapter *saa716x_adap);
+extern void saa716x_fe_stats_hook(struct saa716x_adapter *saa716x_adap);
+extern bool saa716x_fe_lock(struct saa716x_fe_stats *stats);
+extern void saa716x_fe_unlock(struct saa716x_fe_stats *stats, bool locked);
+extern void saa716x_fe_stats_invalidate(struct saa716x_fe_stats *stats);
+extern void saa716x_fe_stats_start(struct saa716x_dev *saa716x);
+extern void saa716x_fe_stats_stop(struct saa716x_dev *saa716x);
+
+#endif /* __SAA716x_FESTATS_H */
@@ -1,6 +1,9 @@
 // SPDX-License-Identifier: GPL-2.0+
 
+#include <linux/bitops.h>
+#include <linux/delay.h>
 #include <linux/kernel.h>
+#include <linux/string.h>
 
 #include "saa716x_mod.h"
 
@@ -60,6 +63,13 @@ void saa716x_fgpiint_disable(struct saa716x_dmabuf *dmabuf, int channel)
 }
 EXPORT_SYMBOL_GPL(saa716x_fgpiint_disable);
 
+/* MSI status bit of the TAGACK interrupt of a port */
+int saa716x_fgpi_msi_bit(int port)
+{
+	return __ffs(msi_int_tagack[port]);
+}
+EXPORT_SYMBOL_GPL(saa716x_fgpi_msi_bit);
+
 int saa716x_fgpi_get_write_index(struct saa716x_dev *saa716x, u32 fgpi_index)
 {
 	u32 fgpi_base;
@@ -170,8 +180,8 @@ int saa716x_fgpi_setparams(struct saa716x_dmabuf *dmabuf,
 
 	u32 fgpi_port, buf_mode, val, mid;
 	u32 D1_XY_END, offst_1, offst_2;
-	int i = 0;
 	u8 dma_channel;
+	ktime_t start = ktime_get();
 
 	fgpi_port = fgpi_ch[port];
 	buf_mode = bamdma_bufmode[port];
@@ -186,14 +196,7 @@ int saa716x_fgpi_setparams(struct saa716x_dmabuf *dmabuf,
 
 
 	/* monitor BAM reset */
-	val = SAA716x_EPRD(BAM, buf_mode);
-	while (val && (i < 100)) {
-		msleep(30);
-		val = SAA716x_EPRD(BAM, buf_mode);
-		i++;
-	}
-
-	if (val) {
+	if (SAA716x_EPPOLL(BAM, buf_mode, val, !val, 20, 3000000)) {
 		pci_err(saa716x->pdev, "Error: BAM FGPI Reset failed!");
 		return -EIO;
 	}
@@ -282,29 +285,77 @@ int saa716x_fgpi_setparams(struct saa716x_dmabuf *dmabuf,
 	SAA716x_EPWR(fgpi_port, FGPI_BASE_1, (dma_channel << 21) + offst_1);
 	SAA716x_EPWR(fgpi_port, FGPI_BASE_2, (dma_channel << 21) + offst_2);
 
+	saa716x_timeline_add(saa716x, "fgpi_setparams", port, start);
+	return 0;
+}
+
+/*
+ * BAM, MMU and the page tables are left alone by saa716x_fgpi_stop(),
+ * so a restart with unchanged parameters only has to enable capture
+ * again. Buffers written before the stop are skipped.
+ */
+static int saa716x_fgpi_rearm(struct saa716x_dev *saa716x, int port)
+{
+	struct saa716x_fgpi_stream_port *fgpi = &saa716x->fgpi[port];
+	u32 fgpi_port;
+	u32 val;
+	int write_index;
+	ktime_t start = ktime_get();
+
+	fgpi_port = fgpi_ch[port];
+
+	write_index = saa716x_fgpi_get_write_index(saa716x, port);
+	if (write_index < 0)
+		return -EIO;
+	fgpi->hot.read_index = write_index;
+	fgpi->hot.last_time = 0;
+
+	SAA716x_EPWR(fgpi_port, INT_CLR_STATUS, 0x7F);
+	SAA716x_EPWR(fgpi_port, INT_ENABLE, 0x7F);
+
+	val = SAA716x_EPRD(fgpi_port, FGPI_CONTROL);
+	val |= 0x3000;
+
+	saa716x_set_clk_external(saa716x, fgpi->dma_channel);
+
+	SAA716x_EPWR(fgpi_port, FGPI_CONTROL, val);
+
+	SAA716x_EPWR(MSI, MSI_INT_ENA_SET_L, msi_int_tagack[port]);
+
+	fgpi->warm_starts++;
+	saa716x_timeline_add(saa716x, "fgpi_rearm", port, start);
 	return 0;
 }
 
 int saa716x_fgpi_start(struct saa716x_dev *saa716x, int port,
 		       struct fgpi_stream_params *stream_params)
 {
+	struct saa716x_fgpi_stream_port *fgpi = &saa716x->fgpi[port];
 	u32 fgpi_port;
 	u32 config;
 	u32 val;
-	u32 i;
 	int ret;
+	ktime_t start = ktime_get();
+
+	if (fgpi->warm &&
+	    !memcmp(&fgpi->params, stream_params, sizeof(*stream_params)))
+		return saa716x_fgpi_rearm(saa716x, port);
 
+	fgpi->warm = 0;
 	fgpi_port = fgpi_ch[port];
 
+	/* enable the bus interface, the readback flushes the posted write */
 	SAA716x_EPWR(fgpi_port, FGPI_INTERFACE, 0);
-	msleep(10);
+	SAA716x_EPRD(fgpi_port, FGPI_INTERFACE);
+	usleep_range(100, 200);
 
 	ret = saa716x_fgpi_setparams(saa716x->fgpi[port].dma_buf,
 				     stream_params, port);
 	if (ret)
 		return -EIO;
 
-	saa716x->fgpi[port].read_index = 0;
+	saa716x->fgpi[port].hot.read_index = 0;
+	saa716x->fgpi[port].hot.last_time = 0;
 
 	config = MMU_DMA_CONFIG(saa716x->fgpi[port].dma_channel);
 
@@ -314,17 +365,7 @@ int saa716x_fgpi_start(struct saa716x_dev *saa716x, int port,
 
 	SAA716x_EPWR(fgpi_port, INT_ENABLE, 0x7F);
 
-	val = SAA716x_EPRD(MMU, config);
-	i = 0;
-	while (i < 500) {
-		if (val & 0x80)
-			break;
-		msleep(10);
-		val = SAA716x_EPRD(MMU, config);
-		i++;
-	}
-
-	if (!(val & 0x80)) {
+	if (SAA716x_EPPOLL(MMU, config, val, val & 0x80, 20, 5000000)) {
 		pci_err(saa716x->pdev, "Error: PTE pre-fetch failed!");
 		return -EIO;
 	}
@@ -338,6 +379,11 @@ int saa716x_fgpi_start(struct saa716x_dev *saa716x, int port,
 
 	SAA716x_EPWR(MSI, MSI_INT_ENA_SET_L, msi_int_tagack[port]);
 
+	fgpi->params = *stream_params;
+	fgpi->warm = 1;
+	fgpi->cold_starts++;
+
+	saa716x_timeline_add(saa716x, "fgpi_start", port, start);
 	return 0;
 }
 EXPORT_SYMBOL_GPL(saa716x_fgpi_start);
@@ -361,24 +407,38 @@ int saa716x_fgpi_stop(struct saa716x_dev *saa716x, int port)
 }
 EXPORT_SYMBOL_GPL(saa716x_fgpi_stop);
 
+/* force the next start through the full BAM/MMU setup */
+void saa716x_fgpi_invalidate(struct saa716x_dev *saa716x, int port)
+{
+	saa716x->fgpi[port].warm = 0;
+}
+EXPORT_SYMBOL_GPL(saa716x_fgpi_invalidate);
+
 int saa716x_fgpi_init(struct saa716x_dev *saa716x, int port, int dma_buf_size,
 		      void (*worker)(unsigned long))
 {
+	struct saa716x_fgpi_hot *hot = &saa716x->fgpi[port].hot;
+	struct saa716x_dmabuf *dmabuf;
 	int i;
 	int ret;
 
 	saa716x->fgpi[port].dma_channel = port + 6;
+	hot->port = port;
 	for (i = 0; i < FGPI_BUFFERS; i++) {
-		ret = saa716x_dmabuf_alloc(saa716x,
-					   &saa716x->fgpi[port].dma_buf[i],
-					   dma_buf_size);
+		dmabuf = &saa716x->fgpi[port].dma_buf[i];
+		ret = saa716x_dmabuf_alloc(saa716x, dmabuf, dma_buf_size);
 		if (ret < 0)
 			return ret;
+
+		hot->buf[i].mem_virt = dmabuf->mem_virt;
+		hot->buf[i].sg_list = dmabuf->sg_list;
+		hot->buf[i].list_len = dmabuf->list_len;
 	}
 	saa716x->fgpi[port].saa716x = saa716x;
 	tasklet_init(&saa716x->fgpi[port].tasklet, worker,
 		     (unsigned long)&saa716x->fgpi[port]);
-	saa716x->fgpi[port].read_index = 0;
+	hot->read_index = 0;
+	saa716x->fgpi[port].warm = 0;
 
 	return 0;
 }
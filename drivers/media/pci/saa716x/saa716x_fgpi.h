@@ -3,7 +3,9 @@
 #ifndef __SAA716x_FGPI_H
 #define __SAA716x_FGPI_H
 
+#include <linux/cache.h>
 #include <linux/interrupt.h>
+#include <linux/ktime.h>
 
 #define FGPI_BUFFERS		8
 
@@ -70,21 +72,65 @@ struct fgpi_stream_params {
 };
 
 struct saa716x_dmabuf;
+struct scatterlist;
+
+/*
+ * Stream state the tasklet touches for every buffer, on cache lines of
+ * its own so that ports served by different CPUs do not share them
+ * with each other or with the setup below.
+ * buf: copy of what the tasklet needs from dma_buf[]
+ * tag_time: TAGACK interrupt of the last completed buffer
+ * last_time: completion of the last buffer handed on, 0 after a start
+ * buf_ns: time one buffer takes to fill, running average
+ */
+struct saa716x_fgpi_hot {
+	u8			port;
+	u8			read_index;
+	u32			buffers;
+	u64			bytes;
+
+	/* tasklet runs on a CPU of the device's NUMA node or not */
+	u32			bh_local;
+	u32			bh_remote;
+
+	ktime_t			tag_time;
+	ktime_t			last_time;
+	u32			buf_ns;
+
+	struct {
+		void		*mem_virt;
+		struct scatterlist *sg_list;
+		int		list_len;
+	} buf[FGPI_BUFFERS];
+
+	/* consumer of the stream, set once at init */
+	void			*priv;
+} ____cacheline_aligned_in_smp;
 
 struct saa716x_fgpi_stream_port {
+	struct saa716x_fgpi_hot	hot;
+
 	u8			dma_channel;
 	struct saa716x_dmabuf	dma_buf[FGPI_BUFFERS];
 	struct saa716x_dev	*saa716x;
 	struct tasklet_struct	tasklet;
-	u8			read_index;
+
+	/* BAM/MMU still hold the setup for params, only re-arm the FGPI */
+	u8			warm;
+	struct fgpi_stream_params params;
+
+	u32			cold_starts;
+	u32			warm_starts;
 };
 
 extern void saa716x_fgpiint_disable(struct saa716x_dmabuf *dmabuf, int channel);
+extern int saa716x_fgpi_msi_bit(int port);
 extern int saa716x_fgpi_get_write_index(struct saa716x_dev *saa716x,
 					u32 fgpi_index);
 extern int saa716x_fgpi_start(struct saa716x_dev *saa716x, int port,
 			      struct fgpi_stream_params *stream_params);
 extern int saa716x_fgpi_stop(struct saa716x_dev *saa716x, int port);
+extern void saa716x_fgpi_invalidate(struct saa716x_dev *saa716x, int port);
 
 extern int saa716x_fgpi_init(struct saa716x_dev *saa716x, int port,
 			      int dma_buf_size,
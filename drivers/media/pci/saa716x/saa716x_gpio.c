@@ -1,67 +1,60 @@
 // SPDX-License-Identifier: GPL-2.0+
 
+#include <linux/gpio/driver.h>
+#include <linux/irq.h>
 #include <linux/kernel.h>
+#include <linux/pm_runtime.h>
 #include <linux/spinlock.h>
 
 #include "saa716x_mod.h"
 
 #include "saa716x_gpio_reg.h"
+#include "saa716x_msi_reg.h"
 
 #include "saa716x_gpio.h"
 #include "saa716x_priv.h"
 
-void saa716x_gpio_init(struct saa716x_dev *saa716x)
+/* MSI_INT_EXTINT_n of the high status word is MSI configuration 33 + n */
+#define GPIO_MSI_SHIFT		__ffs(MSI_INT_EXTINT_0)
+#define GPIO_MSI_CONFIG(__n)	MSI_CONFIG(32 + GPIO_MSI_SHIFT + (__n))
+
+static void saa716x_gpio_update(struct saa716x_dev *saa716x, u32 reg,
+				u32 *shadow, u32 mask, u32 bits)
 {
-	spin_lock_init(&saa716x->gpio_lock);
+	unsigned long flags;
+
+	spin_lock_irqsave(&saa716x->gpio_lock, flags);
+	*shadow = (*shadow & ~mask) | (bits & mask);
+	SAA716x_EPWR(GPIO, reg, *shadow);
+	spin_unlock_irqrestore(&saa716x->gpio_lock, flags);
 }
-EXPORT_SYMBOL_GPL(saa716x_gpio_init);
 
 void saa716x_gpio_set_output(struct saa716x_dev *saa716x, int gpio)
 {
-	uint32_t value;
-
-	value = SAA716x_EPRD(GPIO, GPIO_OEN);
-	value &= ~(1 << gpio);
-	SAA716x_EPWR(GPIO, GPIO_OEN, value);
+	saa716x_gpio_update(saa716x, GPIO_OEN, &saa716x->gpio_state.oen,
+			    BIT(gpio), 0);
 }
 EXPORT_SYMBOL_GPL(saa716x_gpio_set_output);
 
 void saa716x_gpio_set_input(struct saa716x_dev *saa716x, int gpio)
 {
-	uint32_t value;
-
-	value = SAA716x_EPRD(GPIO, GPIO_OEN);
-	value |= 1 << gpio;
-	SAA716x_EPWR(GPIO, GPIO_OEN, value);
+	saa716x_gpio_update(saa716x, GPIO_OEN, &saa716x->gpio_state.oen,
+			    BIT(gpio), BIT(gpio));
 }
 EXPORT_SYMBOL_GPL(saa716x_gpio_set_input);
 
 void saa716x_gpio_set_mode(struct saa716x_dev *saa716x, int gpio, int mode)
 {
-	uint32_t value;
-
-	value = SAA716x_EPRD(GPIO, GPIO_WR_MODE);
-	if (mode)
-		value |= 1 << gpio;
-	else
-		value &= ~(1 << gpio);
-	SAA716x_EPWR(GPIO, GPIO_WR_MODE, value);
+	saa716x_gpio_update(saa716x, GPIO_WR_MODE,
+			    &saa716x->gpio_state.wr_mode,
+			    BIT(gpio), mode ? BIT(gpio) : 0);
 }
 EXPORT_SYMBOL_GPL(saa716x_gpio_set_mode);
 
 void saa716x_gpio_write(struct saa716x_dev *saa716x, int gpio, int set)
 {
-	uint32_t value;
-	unsigned long flags;
-
-	spin_lock_irqsave(&saa716x->gpio_lock, flags);
-	value = SAA716x_EPRD(GPIO, GPIO_WR);
-	if (set)
-		value |= 1 << gpio;
-	else
-		value &= ~(1 << gpio);
-	SAA716x_EPWR(GPIO, GPIO_WR, value);
-	spin_unlock_irqrestore(&saa716x->gpio_lock, flags);
+	saa716x_gpio_update(saa716x, GPIO_WR, &saa716x->gpio_state.wr,
+			    BIT(gpio), set ? BIT(gpio) : 0);
 }
 EXPORT_SYMBOL_GPL(saa716x_gpio_write);
 
@@ -75,3 +68,336 @@ int saa716x_gpio_read(struct saa716x_dev *saa716x, int gpio)
 	return 0;
 }
 EXPORT_SYMBOL_GPL(saa716x_gpio_read);
+
+/*
+ * gpiolib users come at any time, the device may be runtime suspended.
+ * Each access takes a reference, so the chip is a sleeping one.
+ */
+static int saa716x_gpio_pm_get(struct saa716x_dev *saa716x)
+{
+	struct device *dev = &saa716x->pdev->dev;
+	int ret;
+
+	ret = pm_runtime_get_sync(dev);
+	if (ret < 0 && ret != -EACCES) {
+		pm_runtime_put_noidle(dev);
+		return ret;
+	}
+
+	return 0;
+}
+
+static void saa716x_gpio_pm_put(struct saa716x_dev *saa716x)
+{
+	struct device *dev = &saa716x->pdev->dev;
+
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
+}
+
+static int saa716x_gpio_get_direction(struct gpio_chip *gc,
+				      unsigned int offset)
+{
+	struct saa716x_dev *saa716x = gpiochip_get_data(gc);
+
+	if (saa716x->gpio_state.oen & BIT(offset))
+		return GPIO_LINE_DIRECTION_IN;
+	return GPIO_LINE_DIRECTION_OUT;
+}
+
+static int saa716x_gpio_direction_input(struct gpio_chip *gc,
+					unsigned int offset)
+{
+	struct saa716x_dev *saa716x = gpiochip_get_data(gc);
+	int ret;
+
+	ret = saa716x_gpio_pm_get(saa716x);
+	if (ret < 0)
+		return ret;
+
+	saa716x_gpio_set_input(saa716x, offset);
+	saa716x_gpio_pm_put(saa716x);
+	return 0;
+}
+
+/* level first, the line must not glitch when it starts to be driven */
+static int saa716x_gpio_direction_output(struct gpio_chip *gc,
+					 unsigned int offset, int value)
+{
+	struct saa716x_dev *saa716x = gpiochip_get_data(gc);
+	int ret;
+
+	ret = saa716x_gpio_pm_get(saa716x);
+	if (ret < 0)
+		return ret;
+
+	saa716x_gpio_write(saa716x, offset, value);
+	saa716x_gpio_set_output(saa716x, offset);
+	saa716x_gpio_pm_put(saa716x);
+	return 0;
+}
+
+static int saa716x_gpio_get(struct gpio_chip *gc, unsigned int offset)
+{
+	struct saa716x_dev *saa716x = gpiochip_get_data(gc);
+	int ret;
+
+	ret = saa716x_gpio_pm_get(saa716x);
+	if (ret < 0)
+		return ret;
+
+	ret = saa716x_gpio_read(saa716x, offset);
+	saa716x_gpio_pm_put(saa716x);
+	return ret;
+}
+
+static int saa716x_gpio_get_multiple(struct gpio_chip *gc,
+				     unsigned long *mask, unsigned long *bits)
+{
+	struct saa716x_dev *saa716x = gpiochip_get_data(gc);
+	int ret;
+
+	ret = saa716x_gpio_pm_get(saa716x);
+	if (ret < 0)
+		return ret;
+
+	*bits = (*bits & ~*mask) | (SAA716x_EPRD(GPIO, GPIO_RD) & *mask);
+	saa716x_gpio_pm_put(saa716x);
+	return 0;
+}
+
+static void saa716x_gpio_set(struct gpio_chip *gc, unsigned int offset,
+			     int value)
+{
+	struct saa716x_dev *saa716x = gpiochip_get_data(gc);
+
+	if (saa716x_gpio_pm_get(saa716x) < 0)
+		return;
+
+	saa716x_gpio_write(saa716x, offset, value);
+	saa716x_gpio_pm_put(saa716x);
+}
+
+static void saa716x_gpio_set_multiple(struct gpio_chip *gc,
+				      unsigned long *mask, unsigned long *bits)
+{
+	struct saa716x_dev *saa716x = gpiochip_get_data(gc);
+
+	if (saa716x_gpio_pm_get(saa716x) < 0)
+		return;
+
+	saa716x_gpio_update(saa716x, GPIO_WR, &saa716x->gpio_state.wr,
+			    *mask, *bits);
+	saa716x_gpio_pm_put(saa716x);
+}
+
+/* a requested interrupt keeps the device awake until it is freed */
+static int saa716x_gpio_irq_reqres(struct irq_data *d)
+{
+	struct gpio_chip *gc = irq_data_get_irq_chip_data(d);
+	struct saa716x_dev *saa716x = gpiochip_get_data(gc);
+	int ret;
+
+	ret = saa716x_gpio_pm_get(saa716x);
+	if (ret < 0)
+		return ret;
+
+	ret = gpiochip_reqres_irq(gc, irqd_to_hwirq(d));
+	if (ret < 0)
+		saa716x_gpio_pm_put(saa716x);
+	return ret;
+}
+
+static void saa716x_gpio_irq_relres(struct irq_data *d)
+{
+	struct gpio_chip *gc = irq_data_get_irq_chip_data(d);
+
+	gpiochip_relres_irq(gc, irqd_to_hwirq(d));
+	saa716x_gpio_pm_put(gpiochip_get_data(gc));
+}
+
+static void saa716x_gpio_irq_ack(struct irq_data *d)
+{
+	struct saa716x_dev *saa716x =
+			gpiochip_get_data(irq_data_get_irq_chip_data(d));
+
+	SAA716x_EPWR(MSI, MSI_INT_STATUS_CLR_H,
+		     BIT(GPIO_MSI_SHIFT + irqd_to_hwirq(d)));
+}
+
+static void saa716x_gpio_irq_mask(struct irq_data *d)
+{
+	struct saa716x_dev *saa716x =
+			gpiochip_get_data(irq_data_get_irq_chip_data(d));
+	irq_hw_number_t hwirq = irqd_to_hwirq(d);
+	unsigned long flags;
+
+	spin_lock_irqsave(&saa716x->gpio_lock, flags);
+	saa716x->gpio_state.irq_enabled &= ~BIT(hwirq);
+	SAA716x_EPWR(MSI, MSI_INT_ENA_CLR_H, BIT(GPIO_MSI_SHIFT + hwirq));
+	spin_unlock_irqrestore(&saa716x->gpio_lock, flags);
+}
+
+static void saa716x_gpio_irq_unmask(struct irq_data *d)
+{
+	struct saa716x_dev *saa716x =
+			gpiochip_get_data(irq_data_get_irq_chip_data(d));
+	irq_hw_number_t hwirq = irqd_to_hwirq(d);
+	unsigned long flags;
+
+	spin_lock_irqsave(&saa716x->gpio_lock, flags);
+	saa716x->gpio_state.irq_enabled |= BIT(hwirq);
+	SAA716x_EPWR(MSI, MSI_INT_ENA_SET_H, BIT(GPIO_MSI_SHIFT + hwirq));
+	spin_unlock_irqrestore(&saa716x->gpio_lock, flags);
+}
+
+/* the MSI block only detects edges on the external interrupts */
+static int saa716x_gpio_irq_set_type(struct irq_data *d, unsigned int type)
+{
+	struct saa716x_dev *saa716x =
+			gpiochip_get_data(irq_data_get_irq_chip_data(d));
+	irq_hw_number_t hwirq = irqd_to_hwirq(d);
+	unsigned long flags;
+	u32 pol, config;
+
+	switch (type & IRQ_TYPE_SENSE_MASK) {
+	case IRQ_TYPE_EDGE_RISING:
+		pol = MSI_INT_POL_EDGE_RISE;
+		break;
+	case IRQ_TYPE_EDGE_FALLING:
+		pol = MSI_INT_POL_EDGE_FALL;
+		break;
+	case IRQ_TYPE_EDGE_BOTH:
+		pol = MSI_INT_POL_EDGE_ANY;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	spin_lock_irqsave(&saa716x->gpio_lock, flags);
+	saa716x->gpio_state.irq_pol[hwirq] = pol;
+	config = SAA716x_EPRD(MSI, GPIO_MSI_CONFIG(hwirq));
+	config &= ~MSI_INT_POL_EDGE_ANY;
+	SAA716x_EPWR(MSI, GPIO_MSI_CONFIG(hwirq), config | pol);
+	spin_unlock_irqrestore(&saa716x->gpio_lock, flags);
+
+	irq_set_handler_locked(d, handle_edge_irq);
+	return 0;
+}
+
+/* called from the interrupt handler with MSI_INT_STATUS_H */
+void saa716x_gpio_handle_irq(struct saa716x_dev *saa716x, u32 stat_h)
+{
+	unsigned long pending;
+	int hwirq;
+
+	pending = (stat_h >> GPIO_MSI_SHIFT) & saa716x->gpio_state.irq_enabled;
+	for_each_set_bit(hwirq, &pending, SAA716x_GPIO_IRQS)
+		generic_handle_irq(irq_find_mapping(saa716x->gpio_chip.irq.domain,
+						    hwirq));
+}
+EXPORT_SYMBOL_GPL(saa716x_gpio_handle_irq);
+
+/*
+ * Registers the GPIOs as a gpio_chip, GPIO 0 to 15 with interrupts, so
+ * that frontends can take reset and interrupt lines through gpiolib.
+ */
+int saa716x_gpio_init(struct saa716x_dev *saa716x)
+{
+	struct saa716x_gpio_state *state = &saa716x->gpio_state;
+	struct gpio_chip *gc = &saa716x->gpio_chip;
+	struct irq_chip *ic = &saa716x->gpio_irqchip;
+	struct gpio_irq_chip *girq;
+	int ret;
+
+	spin_lock_init(&saa716x->gpio_lock);
+	state->wr = SAA716x_EPRD(GPIO, GPIO_WR);
+	state->wr_mode = SAA716x_EPRD(GPIO, GPIO_WR_MODE);
+	state->oen = SAA716x_EPRD(GPIO, GPIO_OEN);
+	state->irq_enabled = 0;
+
+	ic->name		= "saa716x-gpio";
+	ic->irq_ack		= saa716x_gpio_irq_ack;
+	ic->irq_mask		= saa716x_gpio_irq_mask;
+	ic->irq_unmask		= saa716x_gpio_irq_unmask;
+	ic->irq_set_type	= saa716x_gpio_irq_set_type;
+	ic->irq_request_resources = saa716x_gpio_irq_reqres;
+	ic->irq_release_resources = saa716x_gpio_irq_relres;
+
+	gc->label		= pci_name(saa716x->pdev);
+	gc->parent		= &saa716x->pdev->dev;
+	gc->owner		= THIS_MODULE;
+	gc->base		= -1;
+	gc->ngpio		= SAA716x_GPIO_LINES;
+	gc->can_sleep		= true;
+	gc->get_direction	= saa716x_gpio_get_direction;
+	gc->direction_input	= saa716x_gpio_direction_input;
+	gc->direction_output	= saa716x_gpio_direction_output;
+	gc->get			= saa716x_gpio_get;
+	gc->get_multiple	= saa716x_gpio_get_multiple;
+	gc->set			= saa716x_gpio_set;
+	gc->set_multiple	= saa716x_gpio_set_multiple;
+
+	girq = &gc->irq;
+	girq->chip		= ic;
+	girq->parent_handler	= NULL;
+	girq->num_parents	= 0;
+	girq->parents		= NULL;
+	/* the trigger type only picks the edge, all of them are edges */
+	girq->default_type	= IRQ_TYPE_NONE;
+	girq->handler		= handle_edge_irq;
+
+	ret = gpiochip_add_data(gc, saa716x);
+	if (ret < 0)
+		pci_err(saa716x->pdev, "GPIO chip registration failed, err=%d",
+			ret);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(saa716x_gpio_init);
+
+void saa716x_gpio_exit(struct saa716x_dev *saa716x)
+{
+	gpiochip_remove(&saa716x->gpio_chip);
+}
+EXPORT_SYMBOL_GPL(saa716x_gpio_exit);
+
+void saa716x_gpio_save(struct saa716x_dev *saa716x)
+{
+	struct saa716x_gpio_state *state = &saa716x->gpio_state;
+	unsigned long flags;
+
+	spin_lock_irqsave(&saa716x->gpio_lock, flags);
+	state->wr = SAA716x_EPRD(GPIO, GPIO_WR);
+	state->wr_mode = SAA716x_EPRD(GPIO, GPIO_WR_MODE);
+	state->oen = SAA716x_EPRD(GPIO, GPIO_OEN);
+	spin_unlock_irqrestore(&saa716x->gpio_lock, flags);
+}
+EXPORT_SYMBOL_GPL(saa716x_gpio_save);
+
+/*
+ * levels first, so that outputs (frontend resets) come up driven right,
+ * then the interrupt lines that were unmasked
+ */
+void saa716x_gpio_restore(struct saa716x_dev *saa716x)
+{
+	struct saa716x_gpio_state *state = &saa716x->gpio_state;
+	unsigned long flags, enabled;
+	u32 config;
+	int hwirq;
+
+	spin_lock_irqsave(&saa716x->gpio_lock, flags);
+	SAA716x_EPWR(GPIO, GPIO_WR, state->wr);
+	SAA716x_EPWR(GPIO, GPIO_WR_MODE, state->wr_mode);
+	SAA716x_EPWR(GPIO, GPIO_OEN, state->oen);
+
+	enabled = state->irq_enabled;
+	for_each_set_bit(hwirq, &enabled, SAA716x_GPIO_IRQS) {
+		config = SAA716x_EPRD(MSI, GPIO_MSI_CONFIG(hwirq));
+		config &= ~MSI_INT_POL_EDGE_ANY;
+		SAA716x_EPWR(MSI, GPIO_MSI_CONFIG(hwirq),
+			     config | state->irq_pol[hwirq]);
+	}
+	SAA716x_EPWR(MSI, MSI_INT_ENA_SET_H, enabled << GPIO_MSI_SHIFT);
+	spin_unlock_irqrestore(&saa716x->gpio_lock, flags);
+}
+EXPORT_SYMBOL_GPL(saa716x_gpio_restore);
@@ -3,20 +3,45 @@
 #ifndef __SAA716x_GPIO_H
 #define __SAA716x_GPIO_H
 
+#include <linux/types.h>
+
 #define BOOT_MODE	(GPIO_31 | GPIO_30)
 #define AV_UNIT_B	GPIO_25
 #define AV_UNIT_A	GPIO_24
 #define AV_INTR_B	GPIO_01
 #define AV_INTR_A	GPIO_00
 
+#define SAA716x_GPIO_LINES	32
+/* GPIO 0 to 15 raise the MSI external interrupts */
+#define SAA716x_GPIO_IRQS	16
+
 struct saa716x_dev;
 
-extern void saa716x_gpio_init(struct saa716x_dev *saa716x);
+/*
+ * GPIO state, a copy of the registers so that a change costs one write,
+ * kept across a power down
+ * irq_enabled: unmasked interrupt lines, bit per GPIO
+ * irq_pol: MSI edge polarity of every interrupt line
+ */
+struct saa716x_gpio_state {
+	u32			wr;
+	u32			wr_mode;
+	u32			oen;
+
+	u16			irq_enabled;
+	u32			irq_pol[SAA716x_GPIO_IRQS];
+};
+
+extern int saa716x_gpio_init(struct saa716x_dev *saa716x);
+extern void saa716x_gpio_exit(struct saa716x_dev *saa716x);
 extern void saa716x_gpio_set_output(struct saa716x_dev *saa716x, int gpio);
 extern void saa716x_gpio_set_input(struct saa716x_dev *saa716x, int gpio);
 extern void saa716x_gpio_set_mode(struct saa716x_dev *saa716x, int gpio,
 				  int mode);
 extern void saa716x_gpio_write(struct saa716x_dev *saa716x, int gpio, int set);
 extern int saa716x_gpio_read(struct saa716x_dev *saa716x, int gpio);
+extern void saa716x_gpio_handle_irq(struct saa716x_dev *saa716x, u32 stat_h);
+extern void saa716x_gpio_save(struct saa716x_dev *saa716x);
+extern void saa716x_gpio_restore(struct saa716x_dev *saa716x);
 
 #endif /* __SAA716x_GPIO_H */
@@ -1,12 +1,18 @@
 // SPDX-License-Identifier: GPL-2.0+
 
+#include <linux/debugfs.h>
 #include <linux/delay.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/seq_file.h>
+#include <linux/workqueue.h>
 
 #include <linux/signal.h>
 #include <linux/sched.h>
 #include <linux/interrupt.h>
 
 #include <linux/i2c.h>
+#include <linux/pm_runtime.h>
 
 #include "saa716x_mod.h"
 
@@ -27,21 +33,136 @@
 #define SAA716x_I2C_RXBUSY	(I2C_RECEIVE		| \
 				 I2C_RECEIVE_CLEAR)
 
+#define SAA716x_I2C_IDLE	(I2C_SCL_LINE		| \
+				 I2C_SDA_LINE		| \
+				 I2C_TRANSMIT_CLEAR)
+
+#define SAA716x_I2C_FLUSH	(I2C_SCL_CONTROL	| \
+				 I2C_SDA_CONTROL	| \
+				 I2C_TRANS_SELF_CLEAR	| \
+				 I2C_TRANS_S_SELF_CLEAR)
+
+/* bytes the TX FIFO is given to drain before the bus counts as blocked */
+#define SAA716x_I2C_DRAIN_BYTES	32
+
+/* clock domain frequency assumed when the CGU reports none (boot default) */
+#define SAA716x_I2C_CLK_DEFAULT	27000000
+
+static unsigned int i2c_rate;
+module_param(i2c_rate, uint, 0444);
+MODULE_PARM_DESC(i2c_rate, "I2C bus rate in kHz: 100, 400 or 1000 (Fast-mode Plus), default: board setting");
+
+/*
+ * Minimum SCL low/high periods and the SDA hold time we aim for,
+ * in ns, as given by the I2C specification for each bus mode.
+ */
+struct saa716x_i2c_timing {
+	u32	rate;
+	u32	t_low;
+	u32	t_high;
+	u32	t_hold;
+};
+
+static const struct saa716x_i2c_timing saa716x_i2c_timings[] = {
+	[SAA716x_I2C_RATE_100]	= {  100000, 4700, 4000, 3450 },
+	[SAA716x_I2C_RATE_400]	= {  400000, 1300,  600,  600 },
+	[SAA716x_I2C_RATE_1000]	= { 1000000,  500,  260,  250 },
+};
+
+/*
+ * Divisors the boards were tuned with at the 27 MHz boot clock, high,
+ * low and hold. They run the bus somewhat above the nominal rate and
+ * are kept as they are; the computed ones only replace them at other
+ * clocks and for Fast-mode Plus.
+ */
+static const u8 saa716x_i2c_tuned[][3] = {
+	[SAA716x_I2C_RATE_100]	= { 0x68, 0x87, 0x60 },
+	[SAA716x_I2C_RATE_400]	= { 0x1a, 0x21, 0x10 },
+};
+
+/* number of I2C core clock cycles covering ns, rounded up */
+static u32 saa716x_i2c_cycles(u32 clk, u32 ns)
+{
+	return DIV_ROUND_UP_ULL((u64) clk * ns, NSEC_PER_SEC);
+}
+
+static void saa716x_i2c_set_rate(struct saa716x_i2c *i2c, u32 I2C_DEV)
+{
+	struct saa716x_dev *saa716x = i2c->saa716x;
+	const struct saa716x_i2c_timing *t;
+	u32 clk, period, low, high, hold, spare;
+
+	if (i2c->i2c_rate < SAA716x_I2C_RATE_400 ||
+	    i2c->i2c_rate > SAA716x_I2C_RATE_1000) {
+		pci_err(saa716x->pdev, "Adapter %s Unknown Rate (Rate=0x%02x), using 100k",
+			i2c->i2c_adapter.name, i2c->i2c_rate);
+		i2c->i2c_rate = SAA716x_I2C_RATE_100;
+	}
+	t = &saa716x_i2c_timings[i2c->i2c_rate];
+
+	clk = saa716x->cgu.clk_freq[CLK_DOMAIN_I2C] * CGU_FREQ_UNIT;
+	if (!clk)
+		clk = SAA716x_I2C_CLK_DEFAULT;
+
+	if (clk == SAA716x_I2C_CLK_DEFAULT &&
+	    i2c->i2c_rate < ARRAY_SIZE(saa716x_i2c_tuned)) {
+		high = saa716x_i2c_tuned[i2c->i2c_rate][0];
+		low = saa716x_i2c_tuned[i2c->i2c_rate][1];
+		hold = saa716x_i2c_tuned[i2c->i2c_rate][2];
+		goto out;
+	}
+
+	period = DIV_ROUND_UP(clk, t->rate);
+	low = saa716x_i2c_cycles(clk, t->t_low);
+	high = saa716x_i2c_cycles(clk, t->t_high);
+
+	/* share the remaining cycles in proportion to the minimum periods */
+	if (period > low + high) {
+		spare = period - low - high;
+		low += spare * low / (low + high);
+		high = period - low;
+	}
+
+	low = min_t(u32, low, I2C_CLOCK_LOW);
+	high = min_t(u32, high, I2C_CLOCK_HIGH);
+	hold = min_t(u32, saa716x_i2c_cycles(clk, t->t_hold), I2C_HOLD_TIME);
+
+out:
+	i2c->i2c_freq = clk / (low + high);
+
+	pci_dbg(saa716x->pdev, "Initializing Adapter %s @ %uHz (clk=%uHz, high=0x%02x, low=0x%02x, hold=0x%02x)",
+		i2c->i2c_adapter.name, i2c->i2c_freq, clk, high, low, hold);
+
+	SAA716x_EPWR(I2C_DEV, I2C_CLOCK_DIVISOR_HIGH, high);
+	SAA716x_EPWR(I2C_DEV, I2C_CLOCK_DIVISOR_LOW,  low);
+	SAA716x_EPWR(I2C_DEV, I2C_SDA_HOLD, hold);
+}
+
+/*
+ * Drive a START/STOP sequence by hand, one step per SCL half period
+ * even at 100kHz.
+ */
 static void saa716x_term_xfer(struct saa716x_i2c *i2c, u32 I2C_DEV)
 {
 	struct saa716x_dev *saa716x = i2c->saa716x;
 
 	SAA716x_EPWR(I2C_DEV, I2C_CONTROL, 0xc0); /* Start: SCL/SDA High */
-	msleep(10);
+	usleep_range(10, 20);
 	SAA716x_EPWR(I2C_DEV, I2C_CONTROL, 0x80);
-	msleep(10);
+	usleep_range(10, 20);
 	SAA716x_EPWR(I2C_DEV, I2C_CONTROL, 0x00);
-	msleep(10);
+	usleep_range(10, 20);
 	SAA716x_EPWR(I2C_DEV, I2C_CONTROL, 0x80);
-	msleep(10);
+	usleep_range(10, 20);
 	SAA716x_EPWR(I2C_DEV, I2C_CONTROL, 0xc0);
 }
 
+/* time a byte with its ACK takes on the bus */
+static u32 saa716x_i2c_byte_us(struct saa716x_i2c *i2c)
+{
+	return DIV_ROUND_UP(9 * USEC_PER_SEC, i2c->i2c_freq ?: 100000);
+}
+
 static void saa716x_i2c_hwdeinit(struct saa716x_i2c *i2c, u32 I2C_DEV)
 {
 	struct saa716x_dev *saa716x = i2c->saa716x;
@@ -55,8 +176,9 @@ static int saa716x_i2c_hwinit(struct saa716x_i2c *i2c, u32 I2C_DEV)
 {
 	struct saa716x_dev *saa716x = i2c->saa716x;
 	struct i2c_adapter *adapter = &i2c->i2c_adapter;
+	ktime_t start = ktime_get();
 
-	int i, err = 0;
+	int err = 0;
 	u32 reg;
 
 	reg = SAA716x_EPRD(I2C_DEV, I2C_STATUS);
@@ -74,22 +196,11 @@ static int saa716x_i2c_hwinit(struct saa716x_i2c *i2c, u32 I2C_DEV)
 	SAA716x_EPWR(I2C_DEV, INT_CLR_ENABLE, 0x1fff);
 	SAA716x_EPWR(I2C_DEV, INT_CLR_STATUS, 0x1fff);
 
-	/* Reset I2C Core and generate a delay */
+	/* Reset I2C Core and wait for it to come out of reset */
 	SAA716x_EPWR(I2C_DEV, I2C_CONTROL, 0xc1);
 
-	for (i = 0; i < 100; i++) {
-		reg = SAA716x_EPRD(I2C_DEV, I2C_CONTROL);
-		if (reg == 0xc0) {
-			pci_dbg(saa716x->pdev, "Adapter (%02x) %s RESET",
-				I2C_DEV, adapter->name);
-			break;
-		}
-		msleep(1);
-
-		if (i == 99)
-			err = -EIO;
-	}
-
+	err = SAA716x_EPPOLL(I2C_DEV, I2C_CONTROL, reg, reg == 0xc0,
+			     10, 100000);
 	if (err) {
 		pci_err(saa716x->pdev, "Adapter (%02x) %s RESET failed",
 			I2C_DEV, adapter->name);
@@ -98,35 +209,11 @@ static int saa716x_i2c_hwinit(struct saa716x_i2c *i2c, u32 I2C_DEV)
 		err = -EIO;
 		goto exit;
 	}
+	pci_dbg(saa716x->pdev, "Adapter (%02x) %s RESET",
+		I2C_DEV, adapter->name);
 
-	/* I2C Rate Setup, set clock divisor to 0.5 * 27MHz/i2c_rate */
-	switch (i2c->i2c_rate) {
-	case SAA716x_I2C_RATE_400:
-
-		pci_dbg(saa716x->pdev, "Initializing Adapter %s @ 400k",
-			adapter->name);
-		SAA716x_EPWR(I2C_DEV, I2C_CLOCK_DIVISOR_HIGH, 0x1a);
-		SAA716x_EPWR(I2C_DEV, I2C_CLOCK_DIVISOR_LOW,  0x21);
-		SAA716x_EPWR(I2C_DEV, I2C_SDA_HOLD, 0x10);
-		break;
-
-	case SAA716x_I2C_RATE_100:
-
-		pci_dbg(saa716x->pdev, "Initializing Adapter %s @ 100k",
-			adapter->name);
-		SAA716x_EPWR(I2C_DEV, I2C_CLOCK_DIVISOR_HIGH, 0x68);
-		SAA716x_EPWR(I2C_DEV, I2C_CLOCK_DIVISOR_LOW,  0x87);
-		SAA716x_EPWR(I2C_DEV, I2C_SDA_HOLD, 0x60);
-		break;
-
-	default:
-
-		pci_err(saa716x->pdev, "Adapter %s Unknown Rate (Rate=0x%02x)",
-			adapter->name,
-			i2c->i2c_rate);
-
-		break;
-	}
+	/* I2C Rate Setup, divisors derived from the CGU I2C clock */
+	saa716x_i2c_set_rate(i2c, I2C_DEV);
 
 	/* Disable all interrupts and clear status */
 	SAA716x_EPWR(I2C_DEV, INT_CLR_ENABLE, 0x1fff);
@@ -139,18 +226,16 @@ static int saa716x_i2c_hwinit(struct saa716x_i2c *i2c, u32 I2C_DEV)
 		 * Master Transaction Data Request
 		 * (0x81)
 		 */
-		msleep(5);
-
 		SAA716x_EPWR(I2C_DEV, INT_SET_ENABLE,
 			I2C_SET_ENABLE_MTDR | I2C_SET_ENABLE_MTD);
 
 		/* Check interrupt enable status */
-		reg = SAA716x_EPRD(I2C_DEV, INT_ENABLE);
-		if (reg != 0x81) {
+		if (SAA716x_EPPOLL(I2C_DEV, INT_ENABLE, reg, reg == 0x81,
+				   10, 5000)) {
 
 			pci_err(saa716x->pdev,
-				"Adapter (%d) %s Interrupt enable failed, Exiting !",
-				i,
+				"Adapter (%02x) %s Interrupt enable failed, Exiting !",
+				I2C_DEV,
 				adapter->name);
 
 			err = -EIO;
@@ -176,11 +261,82 @@ static int saa716x_i2c_hwinit(struct saa716x_i2c *i2c, u32 I2C_DEV)
 		(reg >> 1) & 0x01,
 		reg & 0x01);
 
+	saa716x_timeline_add(saa716x, "i2c_hwinit", i2c->i2c_dev, start);
 	return 0;
 exit:
 	return err;
 }
 
+/* tier 1: drop what is left in the FIFOs, all a NAK needs */
+static bool saa716x_i2c_flush(struct saa716x_i2c *i2c, u32 I2C_DEV)
+{
+	struct saa716x_dev *saa716x = i2c->saa716x;
+	u32 reg;
+
+	SAA716x_EPWR(I2C_DEV, I2C_CONTROL, SAA716x_I2C_FLUSH);
+	SAA716x_EPWR(I2C_DEV, INT_CLR_STATUS, 0x1fff);
+
+	return !SAA716x_EPPOLL(I2C_DEV, I2C_STATUS, reg,
+			       (reg & SAA716x_I2C_IDLE) == SAA716x_I2C_IDLE,
+			       2, 2 * saa716x_i2c_byte_us(i2c));
+}
+
+/*
+ * tier 2: a slave stopped in the middle of a byte holds SDA low, up to
+ * 9 clocks let it finish, a STOP then frees the bus
+ */
+static bool saa716x_i2c_bus_clear(struct saa716x_i2c *i2c, u32 I2C_DEV)
+{
+	struct saa716x_dev *saa716x = i2c->saa716x;
+	u32 half_us = DIV_ROUND_UP(USEC_PER_SEC,
+				   2 * (i2c->i2c_freq ?: 100000));
+	int i;
+
+	for (i = 0; i < 9; i++) {
+		if (SAA716x_EPRD(I2C_DEV, I2C_STATUS) & I2C_SDA_LINE)
+			break;
+		SAA716x_EPWR(I2C_DEV, I2C_CONTROL, I2C_SDA_CONTROL);
+		udelay(half_us);
+		SAA716x_EPWR(I2C_DEV, I2C_CONTROL,
+			     I2C_SCL_CONTROL | I2C_SDA_CONTROL);
+		udelay(half_us);
+	}
+
+	SAA716x_EPWR(I2C_DEV, I2C_CONTROL, 0);
+	udelay(half_us);
+	SAA716x_EPWR(I2C_DEV, I2C_CONTROL, I2C_SCL_CONTROL);
+	udelay(half_us);
+	SAA716x_EPWR(I2C_DEV, I2C_CONTROL, I2C_SCL_CONTROL | I2C_SDA_CONTROL);
+	udelay(half_us);
+
+	return saa716x_i2c_flush(i2c, I2C_DEV);
+}
+
+/* the cheapest step that leaves an idle bus, tier 3 is a full reset */
+static int saa716x_i2c_recover(struct saa716x_i2c *i2c, u32 I2C_DEV)
+{
+	struct saa716x_i2c_recovery *rec = &i2c->recovery;
+	ktime_t start = ktime_get();
+	int err = 0;
+
+	if (saa716x_i2c_flush(i2c, I2C_DEV)) {
+		rec->flush++;
+	} else if (saa716x_i2c_bus_clear(i2c, I2C_DEV)) {
+		rec->bus_clear++;
+	} else {
+		err = saa716x_i2c_hwinit(i2c, I2C_DEV);
+		if (err < 0)
+			rec->failed++;
+		else
+			rec->reset++;
+	}
+
+	rec->last_us = ktime_us_delta(ktime_get(), start);
+	rec->max_us = max(rec->max_us, rec->last_us);
+
+	return err;
+}
+
 static int saa716x_i2c_send(struct saa716x_i2c *i2c, u32 I2C_DEV, u32 data)
 {
 	struct saa716x_dev *saa716x = i2c->saa716x;
@@ -193,27 +349,13 @@ static int saa716x_i2c_send(struct saa716x_i2c *i2c, u32 I2C_DEV, u32 data)
 		return 0;
 	}
 
-	/* Check FIFO status before TX */
-	reg = SAA716x_EPRD(I2C_DEV, I2C_STATUS);
-	if (reg & SAA716x_I2C_TXBUSY) {
-		for (i = 0; i < 100; i++) {
-			/* TODO! check for hotplug devices */
-			msleep(10);
-			reg = SAA716x_EPRD(I2C_DEV, I2C_STATUS);
-
-			if (reg & SAA716x_I2C_TXBUSY) {
-				pci_err(saa716x->pdev, "FIFO full or Blocked");
-
-				err = saa716x_i2c_hwinit(i2c, I2C_DEV);
-				if (err < 0) {
-					pci_err(saa716x->pdev, "Error Reinit");
-					err = -EIO;
-					goto exit;
-				}
-			} else {
-				break;
-			}
-		}
+	/* Check FIFO status before TX, it drains at the bus rate */
+	if (SAA716x_EPPOLL(I2C_DEV, I2C_STATUS, reg,
+			   !(reg & SAA716x_I2C_TXBUSY), 5,
+			   SAA716x_I2C_DRAIN_BYTES * saa716x_i2c_byte_us(i2c))) {
+		pci_err(saa716x->pdev, "FIFO full or Blocked");
+		err = -EIO;
+		goto exit;
 	}
 
 	/* Write to FIFO */
@@ -440,8 +582,17 @@ static int saa716x_i2c_xfer(struct i2c_adapter *adapter,
 
 	u32 DEV = SAA716x_I2C_BUS(i2c->i2c_dev);
 	int i, t, err;
+	u32 nak;
 
 	pci_dbg(saa716x->pdev, "Bus(%02x) I2C transfer", DEV);
+
+	/* frontends may still talk to a closed device, e.g. to sleep */
+	err = pm_runtime_get_sync(&saa716x->pdev->dev);
+	if (err < 0 && err != -EACCES) {
+		pm_runtime_put_noidle(&saa716x->pdev->dev);
+		return err;
+	}
+
 	mutex_lock(&i2c->i2c_lock);
 
 	for (t = 0; t < 3; t++) {
@@ -459,16 +610,35 @@ static int saa716x_i2c_xfer(struct i2c_adapter *adapter,
 		}
 		break;
 retry:
-		err = saa716x_i2c_hwinit(i2c, DEV);
+		i2c->recovery.errors++;
+		nak = SAA716x_EPRD(DEV, INT_STATUS) & I2C_ACK_INTER_MTNA;
+
+		err = saa716x_i2c_recover(i2c, DEV);
 		if (err < 0)
 			break;
+
+		/* no device or a sleeping one, a retry would not be acked */
+		if (nak) {
+			i2c->recovery.naks++;
+			err = -ENXIO;
+			break;
+		}
 	}
 
 	mutex_unlock(&i2c->i2c_lock);
 
+	pm_runtime_mark_last_busy(&saa716x->pdev->dev);
+	pm_runtime_put_autosuspend(&saa716x->pdev->dev);
+
 	if ((t < 3) && (err >= 0))
 		return num;
 
+	if (err == -ENXIO) {
+		pci_dbg(saa716x->pdev, "I2C NAK, msg %d, addr = 0x%02x",
+			i, msgs[i].addr);
+		return err;
+	}
+
 	pci_err(saa716x->pdev,
 		"I2C transfer error, msg %d, addr = 0x%02x, len=%d, flags=0x%x",
 		i, msgs[i].addr, msgs[i].len, msgs[i].flags);
@@ -485,17 +655,176 @@ static const struct i2c_algorithm saa716x_algo = {
 	.functionality	= saa716x_i2c_func,
 };
 
+/*
+ * Tuning is marked by the frontend wrappers for the task doing it, the
+ * statistics refresh is known by its work item, the rest is normal.
+ */
+static enum saa716x_i2c_prio saa716x_i2c_prio(struct saa716x_dev *saa716x)
+{
+	struct work_struct *work = current_work();
+	int i;
+
+	for (i = 0; i < saa716x->config->adapters; i++) {
+		if (READ_ONCE(saa716x->saa716x_adap[i].tune_task) == current)
+			return SAA716x_I2C_PRIO_URGENT;
+	}
+
+	for (i = 0; work && i < SAA716x_I2C_ADAPTERS; i++) {
+		if (work == &saa716x->fe_stats_bus[i].work.work)
+			return SAA716x_I2C_PRIO_BACKGROUND;
+	}
+
+	return SAA716x_I2C_PRIO_NORMAL;
+}
+
+/* no transaction of a higher priority waits for or holds the bus */
+static bool saa716x_i2c_clear(struct saa716x_i2c *i2c,
+			      enum saa716x_i2c_prio prio)
+{
+	int p;
+
+	for (p = 0; p < prio; p++) {
+		if (atomic_read(&i2c->pending[p]))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * The bus_lock rt_mutex of the I2C core is kept, with its priority
+ * inheritance and lockdep class; a transaction is only held back from
+ * it while ones of a higher priority are pending, and not longer than
+ * SAA716x_I2C_AGE_MS. Muxes behind the demods lock this adapter for
+ * their transfers as well, so the tuner is scheduled with its demod.
+ */
+static void saa716x_i2c_lock_bus(struct i2c_adapter *adapter,
+				 unsigned int flags)
+{
+	struct saa716x_i2c *i2c = i2c_get_adapdata(adapter);
+	enum saa716x_i2c_prio prio = saa716x_i2c_prio(i2c->saa716x);
+	struct saa716x_i2c_queue_stats *queue = &i2c->queue[prio];
+	ktime_t start = ktime_get();
+	bool aged = false;
+	u32 wait_us;
+
+	atomic_inc(&i2c->pending[prio]);
+	if (!saa716x_i2c_clear(i2c, prio))
+		aged = !wait_event_timeout(i2c->sched_wq,
+					   saa716x_i2c_clear(i2c, prio),
+					   msecs_to_jiffies(SAA716x_I2C_AGE_MS));
+
+	rt_mutex_lock_nested(&adapter->bus_lock, i2c_adapter_depth(adapter));
+	i2c->owner_prio = prio;
+
+	wait_us = ktime_us_delta(ktime_get(), start);
+	spin_lock(&i2c->sched_lock);
+	queue->count++;
+	queue->aged += aged;
+	queue->total_us += wait_us;
+	queue->max_us = max(queue->max_us, wait_us);
+	spin_unlock(&i2c->sched_lock);
+}
+
+static int saa716x_i2c_trylock_bus(struct i2c_adapter *adapter,
+				   unsigned int flags)
+{
+	struct saa716x_i2c *i2c = i2c_get_adapdata(adapter);
+	enum saa716x_i2c_prio prio = saa716x_i2c_prio(i2c->saa716x);
+
+	if (!rt_mutex_trylock(&adapter->bus_lock))
+		return 0;
+
+	atomic_inc(&i2c->pending[prio]);
+	i2c->owner_prio = prio;
+
+	return 1;
+}
+
+static void saa716x_i2c_unlock_bus(struct i2c_adapter *adapter,
+				   unsigned int flags)
+{
+	struct saa716x_i2c *i2c = i2c_get_adapdata(adapter);
+	enum saa716x_i2c_prio prio = i2c->owner_prio;
+
+	rt_mutex_unlock(&adapter->bus_lock);
+
+	if (atomic_dec_and_test(&i2c->pending[prio]))
+		wake_up_all(&i2c->sched_wq);
+}
+
+static const struct i2c_lock_operations saa716x_i2c_lock_ops = {
+	.lock_bus	= saa716x_i2c_lock_bus,
+	.trylock_bus	= saa716x_i2c_trylock_bus,
+	.unlock_bus	= saa716x_i2c_unlock_bus,
+};
+
+/* a transaction holds the bus or waits for it */
+bool saa716x_i2c_busy(struct saa716x_i2c *i2c)
+{
+	int p;
+
+	for (p = 0; p < SAA716x_I2C_PRIOS; p++) {
+		if (atomic_read(&i2c->pending[p]))
+			return true;
+	}
+
+	return false;
+}
+EXPORT_SYMBOL_GPL(saa716x_i2c_busy);
+
+static int saa716x_i2c_stats_show(struct seq_file *s, void *unused)
+{
+	static const char * const names[SAA716x_I2C_PRIOS] = {
+		"urgent", "normal", "background"
+	};
+	struct saa716x_i2c *i2c = s->private;
+	struct saa716x_i2c_recovery *rec = &i2c->recovery;
+	struct saa716x_i2c_queue_stats queue[SAA716x_I2C_PRIOS];
+	int prio;
+
+	spin_lock(&i2c->sched_lock);
+	memcpy(queue, i2c->queue, sizeof(queue));
+	spin_unlock(&i2c->sched_lock);
+
+	seq_printf(s, "rate: %u Hz\n", i2c->i2c_freq);
+	seq_puts(s, "# priority        count        aged  wait avg[us]  wait max[us]\n");
+	for (prio = 0; prio < SAA716x_I2C_PRIOS; prio++)
+		seq_printf(s, "%-10s  %10u  %10u  %12llu  %12u\n", names[prio],
+			   queue[prio].count, queue[prio].aged,
+			   queue[prio].count ?
+			   div_u64(queue[prio].total_us, queue[prio].count) : 0,
+			   queue[prio].max_us);
+
+	seq_printf(s, "errors:        %u\n", rec->errors);
+	seq_printf(s, "naks:          %u\n", rec->naks);
+	seq_printf(s, "flush:         %u\n", rec->flush);
+	seq_printf(s, "bus clear:     %u\n", rec->bus_clear);
+	seq_printf(s, "reset:         %u\n", rec->reset);
+	seq_printf(s, "failed:        %u\n", rec->failed);
+	seq_printf(s, "recovery [us]: last %u max %u\n",
+		   rec->last_us, rec->max_us);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(saa716x_i2c_stats);
+
 int saa716x_i2c_init(struct saa716x_dev *saa716x)
 {
 	struct pci_dev *pdev		= saa716x->pdev;
 	struct saa716x_i2c *i2c		= saa716x->i2c;
 	struct i2c_adapter *adapter	= NULL;
 
-	int i, err = 0;
+	char name[8];
+	int i, p, err = 0;
 
 	pci_dbg(saa716x->pdev, "Initializing SAA%02x I2C Core",
 		saa716x->pdev->device);
 
+	if (i2c_rate && i2c_rate != 100 && i2c_rate != 400 && i2c_rate != 1000)
+		pci_warn(saa716x->pdev, "i2c_rate=%u not supported, using the board setting",
+			 i2c_rate);
+
 	for (i = 0; i < SAA716x_I2C_ADAPTERS; i++) {
 
 		mutex_init(&i2c->i2c_lock);
@@ -503,8 +832,19 @@ int saa716x_i2c_init(struct saa716x_dev *saa716x)
 		init_waitqueue_head(&i2c->i2c_wq);
 		i2c->i2c_op = 0;
 
+		spin_lock_init(&i2c->sched_lock);
+		init_waitqueue_head(&i2c->sched_wq);
+		for (p = 0; p < SAA716x_I2C_PRIOS; p++)
+			atomic_set(&i2c->pending[p], 0);
+
 		i2c->i2c_dev	= i;
 		i2c->i2c_rate	= saa716x->config->i2c_rate;
+		if (i2c_rate == 100)
+			i2c->i2c_rate = SAA716x_I2C_RATE_100;
+		else if (i2c_rate == 400)
+			i2c->i2c_rate = SAA716x_I2C_RATE_400;
+		else if (i2c_rate == 1000)
+			i2c->i2c_rate = SAA716x_I2C_RATE_1000;
 		i2c->i2c_mode	= saa716x->config->i2c_mode;
 		adapter		= &i2c->i2c_adapter;
 
@@ -522,6 +862,7 @@ int saa716x_i2c_init(struct saa716x_dev *saa716x)
 			adapter->owner		= saa716x->module;
 			adapter->algo		= &saa716x_algo;
 			adapter->algo_data	= NULL;
+			adapter->lock_ops	= &saa716x_i2c_lock_ops;
 			adapter->timeout	= 500; /* FIXME ! */
 			adapter->retries	= 3; /* FIXME ! */
 			adapter->dev.parent	= &pdev->dev;
@@ -530,12 +871,18 @@ int saa716x_i2c_init(struct saa716x_dev *saa716x)
 				i,
 				adapter->name);
 
+			/* the bus lock needs it from the first transfer on */
+			i2c->saa716x = saa716x;
+
 			err = i2c_add_adapter(adapter);
 			if (err < 0)
 				goto exit;
 
-			i2c->saa716x = saa716x;
 			saa716x_i2c_hwinit(i2c, SAA716x_I2C_BUS(i));
+
+			snprintf(name, sizeof(name), "i2c%d", i);
+			debugfs_create_file(name, 0444, saa716x->debugfs, i2c,
+					    &saa716x_i2c_stats_fops);
 		}
 		i2c++;
 	}
@@ -576,3 +923,49 @@ void saa716x_i2c_exit(struct saa716x_dev *saa716x)
 	}
 }
 EXPORT_SYMBOL_GPL(saa716x_i2c_exit);
+
+/*
+ * Runtime suspend only takes the bus setup down, the next transfer
+ * resumes the device through xfer. The I2C core refuses transfers only
+ * while the adapters are marked, which is system sleep and error
+ * recovery.
+ */
+void saa716x_i2c_mark(struct saa716x_dev *saa716x, bool suspended)
+{
+	struct saa716x_i2c *i2c = saa716x->i2c;
+	int i;
+
+	for (i = 0; i < SAA716x_I2C_ADAPTERS; i++, i2c++) {
+		if (suspended)
+			i2c_mark_adapter_suspended(&i2c->i2c_adapter);
+		else
+			i2c_mark_adapter_resumed(&i2c->i2c_adapter);
+	}
+}
+EXPORT_SYMBOL_GPL(saa716x_i2c_mark);
+
+void saa716x_i2c_suspend(struct saa716x_dev *saa716x)
+{
+	struct saa716x_i2c *i2c = saa716x->i2c;
+	int i;
+
+	for (i = 0; i < SAA716x_I2C_ADAPTERS; i++, i2c++)
+		saa716x_i2c_hwdeinit(i2c, SAA716x_I2C_BUS(i));
+}
+EXPORT_SYMBOL_GPL(saa716x_i2c_suspend);
+
+/* only the bus setup is lost, the adapters stay registered */
+void saa716x_i2c_resume(struct saa716x_dev *saa716x)
+{
+	struct saa716x_i2c *i2c = saa716x->i2c;
+	int i;
+
+	for (i = 0; i < SAA716x_I2C_ADAPTERS; i++, i2c++)
+		saa716x_i2c_hwinit(i2c, SAA716x_I2C_BUS(i));
+
+	if (saa716x->config->i2c_mode >= SAA716x_I2C_MODE_IRQ) {
+		SAA716x_EPWR(MSI, MSI_INT_ENA_SET_H, MSI_INT_I2CINT_0);
+		SAA716x_EPWR(MSI, MSI_INT_ENA_SET_H, MSI_INT_I2CINT_1);
+	}
+}
+EXPORT_SYMBOL_GPL(saa716x_i2c_resume);
@@ -3,7 +3,10 @@
 #ifndef __SAA716x_I2C_H
 #define __SAA716x_I2C_H
 
+#include <linux/cache.h>
 #include <linux/i2c.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
 
 #define SAA716x_I2C_ADAPTERS	2
 
@@ -22,6 +25,7 @@ struct saa716x_dev;
 enum saa716x_i2c_rate {
 	SAA716x_I2C_RATE_400 = 1,
 	SAA716x_I2C_RATE_100,
+	SAA716x_I2C_RATE_1000,
 };
 
 enum saa716x_i2c_mode {
@@ -30,6 +34,49 @@ enum saa716x_i2c_mode {
 	SAA716x_I2C_MODE_IRQ_BUFFERED
 };
 
+/*
+ * Order in which waiting transactions get the bus
+ * URGENT: tuning, including the tuner behind the demod's gate
+ * BACKGROUND: the signal statistics refresh
+ * A transaction held back longer than SAA716x_I2C_AGE_MS goes anyway.
+ */
+enum saa716x_i2c_prio {
+	SAA716x_I2C_PRIO_URGENT = 0,
+	SAA716x_I2C_PRIO_NORMAL,
+	SAA716x_I2C_PRIO_BACKGROUND,
+	SAA716x_I2C_PRIOS
+};
+
+#define SAA716x_I2C_AGE_MS		50
+
+/*
+ * time spent waiting for the bus
+ * aged: went for the bus while higher priorities were still pending
+ */
+struct saa716x_i2c_queue_stats {
+	u32				count;
+	u32				aged;
+	u32				max_us;
+	u64				total_us;
+};
+
+/*
+ * Recovery after failed transfers, by the step that brought the bus back
+ * flush: FIFOs flushed, bus_clear: SCL pulsed until SDA was released,
+ * reset: full core reset, failed: not even that helped
+ * naks: transfers not acked by the slave, not retried
+ */
+struct saa716x_i2c_recovery {
+	u32				errors;
+	u32				naks;
+	u32				flush;
+	u32				bus_clear;
+	u32				reset;
+	u32				failed;
+	u32				last_us;
+	u32				max_us;
+};
+
 struct saa716x_i2c {
 	struct i2c_adapter		i2c_adapter;
 	struct mutex			i2c_lock;
@@ -39,14 +86,33 @@ struct saa716x_i2c {
 	enum saa716x_i2c_rate		i2c_rate;
 	enum saa716x_i2c_mode		i2c_mode;
 
+	/* effective SCL frequency in Hz, from the CGU I2C clock */
+	u32				i2c_freq;
+
 	/* block size for buffered mode, 1 otherwise */
 	u32				block_size;
 
 	wait_queue_head_t		i2c_wq;
 	int				i2c_op;
-};
+
+	struct saa716x_i2c_recovery	recovery;
+
+	/*
+	 * held back from the bus_lock of the adapter while higher
+	 * priorities are pending, sched_lock guards the queue stats
+	 */
+	spinlock_t			sched_lock;
+	wait_queue_head_t		sched_wq;
+	atomic_t			pending[SAA716x_I2C_PRIOS];
+	enum saa716x_i2c_prio		owner_prio;
+	struct saa716x_i2c_queue_stats	queue[SAA716x_I2C_PRIOS];
+} ____cacheline_aligned_in_smp;
 
 extern int saa716x_i2c_init(struct saa716x_dev *saa716x);
 extern void saa716x_i2c_exit(struct saa716x_dev *saa716x);
+extern void saa716x_i2c_mark(struct saa716x_dev *saa716x, bool suspended);
+extern void saa716x_i2c_suspend(struct saa716x_dev *saa716x);
+extern void saa716x_i2c_resume(struct saa716x_dev *saa716x);
+extern bool saa716x_i2c_busy(struct saa716x_i2c *i2c);
 
 #endif /* __SAA716x_I2C_H */
@@ -0,0 +1,272 @@
+// SPDX-License-Identifier: GPL-2.0+
+
+#include <linux/fs.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+
+#include "saa716x_adap.h"
+#include "saa716x_m2ts.h"
+#include "saa716x_priv.h"
+
+static unsigned int m2ts_buffers = 32;
+module_param(m2ts_buffers, uint, 0644);
+MODULE_PARM_DESC(m2ts_buffers,
+	"timestamped output ring buffer size in TS DMA buffers (default 32)");
+
+/* the 192 byte format counts arrival time in 27 MHz ticks, 30 bits */
+static inline u32 saa716x_m2ts_ats(ktime_t t)
+{
+	return (u32)div_u64((u64)ktime_to_ns(t) * 27, 1000) & 0x3fffffff;
+}
+
+/* serializes a reader's release against the removal of its adapter */
+static DEFINE_MUTEX(saa716x_m2ts_mutex);
+
+static bool __saa716x_m2ts_put(struct saa716x_m2ts *m2ts, const u8 *pkt,
+			       ktime_t t)
+{
+	struct dvb_ringbuffer *rb = &m2ts->reader->rb;
+	__be32 ats;
+
+	if (dvb_ringbuffer_free(rb) < SAA716x_M2TS_PACKET)
+		return false;
+
+	ats = cpu_to_be32(saa716x_m2ts_ats(t));
+	dvb_ringbuffer_write(rb, (u8 *)&ats, sizeof(ats));
+	dvb_ringbuffer_write(rb, pkt, 188);
+	m2ts->packets++;
+
+	return true;
+}
+
+/*
+ * Called from the tasklet for count packets that arrived between
+ * start and end, spread evenly over that time.
+ */
+void saa716x_m2ts_feed(struct saa716x_m2ts *m2ts, const u8 *buf, int count,
+		       ktime_t start, ktime_t end)
+{
+	s64 span = ktime_to_ns(ktime_sub(end, start));
+	int i;
+
+	if (!READ_ONCE(m2ts->reader))
+		return;
+
+	spin_lock(&m2ts->lock);
+	if (!m2ts->reader)
+		goto out;
+
+	for (i = 0; i < count; i++, buf += 188) {
+		if (!__saa716x_m2ts_put(m2ts, buf, ktime_add_ns(start,
+					div_s64(span * (i + 1), count)))) {
+			m2ts->overflows += count - i;
+			break;
+		}
+	}
+	wake_up_interruptible(&m2ts->reader->rb.queue);
+out:
+	spin_unlock(&m2ts->lock);
+}
+EXPORT_SYMBOL_GPL(saa716x_m2ts_feed);
+
+/* detach the reader from the tasklet, the caller holds the mutex */
+static void saa716x_m2ts_detach(struct saa716x_m2ts_reader *reader)
+{
+	struct saa716x_adapter *saa716x_adap = reader->saa716x_adap;
+	struct saa716x_m2ts *m2ts = &saa716x_adap->m2ts;
+
+	spin_lock_bh(&m2ts->lock);
+	m2ts->reader = NULL;
+	spin_unlock_bh(&m2ts->lock);
+
+	saa716x_stream_put(saa716x_adap);
+	WRITE_ONCE(reader->saa716x_adap, NULL);
+}
+
+/*
+ * misc_open() holds the misc lock over this, so the adapter cannot go
+ * away underneath; afterwards the file only uses its reader.
+ */
+static int saa716x_m2ts_open(struct inode *inode, struct file *file)
+{
+	struct miscdevice *misc = file->private_data;
+	struct saa716x_adapter *saa716x_adap = container_of(misc,
+					struct saa716x_adapter, m2ts.misc);
+	struct saa716x_m2ts *m2ts = &saa716x_adap->m2ts;
+	struct device *dev = &saa716x_adap->saa716x->pdev->dev;
+	struct saa716x_m2ts_reader *reader;
+	size_t size;
+	int ret;
+
+	if ((file->f_flags & O_ACCMODE) != O_RDONLY)
+		return -EINVAL;
+
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+
+	size = (size_t)max(m2ts_buffers, 2U) * 348 * SAA716x_M2TS_PACKET;
+	reader->data = vmalloc_node(size, dev_to_node(dev));
+	if (!reader->data) {
+		ret = -ENOMEM;
+		goto err_reader;
+	}
+	dvb_ringbuffer_init(&reader->rb, reader->data, size);
+	reader->saa716x_adap = saa716x_adap;
+
+	spin_lock_bh(&m2ts->lock);
+	if (m2ts->reader) {
+		spin_unlock_bh(&m2ts->lock);
+		ret = -EBUSY;
+		goto err_data;
+	}
+	m2ts->reader = reader;
+	spin_unlock_bh(&m2ts->lock);
+
+	ret = saa716x_stream_get(saa716x_adap);
+	if (ret < 0) {
+		spin_lock_bh(&m2ts->lock);
+		m2ts->reader = NULL;
+		spin_unlock_bh(&m2ts->lock);
+		goto err_data;
+	}
+
+	file->private_data = reader;
+
+	return stream_open(inode, file);
+
+err_data:
+	vfree(reader->data);
+err_reader:
+	kfree(reader);
+	return ret;
+}
+
+static int saa716x_m2ts_release(struct inode *inode, struct file *file)
+{
+	struct saa716x_m2ts_reader *reader = file->private_data;
+
+	mutex_lock(&saa716x_m2ts_mutex);
+	if (reader->saa716x_adap)
+		saa716x_m2ts_detach(reader);
+	mutex_unlock(&saa716x_m2ts_mutex);
+
+	vfree(reader->data);
+	kfree(reader);
+
+	return 0;
+}
+
+static bool saa716x_m2ts_ready(struct saa716x_m2ts_reader *reader)
+{
+	return dvb_ringbuffer_avail(&reader->rb) >= SAA716x_M2TS_PACKET ||
+	       !READ_ONCE(reader->saa716x_adap);
+}
+
+static ssize_t saa716x_m2ts_read(struct file *file, char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	struct saa716x_m2ts_reader *reader = file->private_data;
+	ssize_t avail;
+	int ret;
+
+	/* whole packets only, the reader never sees a torn one */
+	count -= count % SAA716x_M2TS_PACKET;
+	if (!count)
+		return -EINVAL;
+
+	while ((avail = dvb_ringbuffer_avail(&reader->rb)) <
+	       SAA716x_M2TS_PACKET) {
+		/* the adapter was removed and everything read */
+		if (!READ_ONCE(reader->saa716x_adap))
+			return -ENODEV;
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible(reader->rb.queue,
+					       saa716x_m2ts_ready(reader));
+		if (ret)
+			return ret;
+	}
+
+	avail -= avail % SAA716x_M2TS_PACKET;
+	return dvb_ringbuffer_read_user(&reader->rb, buf, min_t(size_t, count,
+								  avail));
+}
+
+static __poll_t saa716x_m2ts_poll(struct file *file, poll_table *wait)
+{
+	struct saa716x_m2ts_reader *reader = file->private_data;
+
+	poll_wait(file, &reader->rb.queue, wait);
+	if (dvb_ringbuffer_avail(&reader->rb) >= SAA716x_M2TS_PACKET)
+		return EPOLLIN | EPOLLRDNORM;
+	if (!READ_ONCE(reader->saa716x_adap))
+		return EPOLLERR | EPOLLHUP;
+
+	return 0;
+}
+
+static const struct file_operations saa716x_m2ts_fops = {
+	.owner		= THIS_MODULE,
+	.open		= saa716x_m2ts_open,
+	.release	= saa716x_m2ts_release,
+	.read		= saa716x_m2ts_read,
+	.poll		= saa716x_m2ts_poll,
+	.llseek		= noop_llseek,
+};
+
+int saa716x_m2ts_init(struct saa716x_adapter *saa716x_adap)
+{
+	struct saa716x_m2ts *m2ts = &saa716x_adap->m2ts;
+	struct saa716x_dev *saa716x = saa716x_adap->saa716x;
+	int ret;
+
+	spin_lock_init(&m2ts->lock);
+	m2ts->reader = NULL;
+
+	snprintf(m2ts->name, sizeof(m2ts->name), "saa716x-%s-m2ts%d",
+		 pci_name(saa716x->pdev), saa716x_adap->count);
+	m2ts->misc.minor = MISC_DYNAMIC_MINOR;
+	m2ts->misc.name = m2ts->name;
+	m2ts->misc.fops = &saa716x_m2ts_fops;
+	m2ts->misc.parent = &saa716x->pdev->dev;
+
+	ret = misc_register(&m2ts->misc);
+	if (ret < 0)
+		m2ts->misc.fops = NULL;
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(saa716x_m2ts_init);
+
+/*
+ * A reader may keep its file open past the removal of the adapter, it
+ * is detached here and only finds the end of the stream afterwards.
+ */
+void saa716x_m2ts_exit(struct saa716x_adapter *saa716x_adap)
+{
+	struct saa716x_m2ts *m2ts = &saa716x_adap->m2ts;
+	struct saa716x_m2ts_reader *reader;
+
+	/* not registered if init failed */
+	if (!m2ts->misc.fops)
+		return;
+
+	misc_deregister(&m2ts->misc);
+	m2ts->misc.fops = NULL;
+
+	mutex_lock(&saa716x_m2ts_mutex);
+	reader = m2ts->reader;
+	if (reader) {
+		saa716x_m2ts_detach(reader);
+		wake_up_interruptible(&reader->rb.queue);
+	}
+	mutex_unlock(&saa716x_m2ts_mutex);
+}
+EXPORT_SYMBOL_GPL(saa716x_m2ts_exit);
@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+
+#ifndef __SAA716x_M2TS_H
+#define __SAA716x_M2TS_H
+
+#include <linux/ktime.h>
+#include <linux/miscdevice.h>
+#include <linux/spinlock.h>
+
+#include <media/dvb_ringbuffer.h>
+
+#define SAA716x_M2TS_PACKET	192
+
+/*
+ * Reader of the timestamped output, owned by the open file
+ * saa716x_adap: adapter the reader streams from, NULL once it is gone
+ * data: ring buffer memory
+ */
+struct saa716x_m2ts_reader {
+	struct saa716x_adapter	*saa716x_adap;
+	u8			*data;
+	struct dvb_ringbuffer	rb;
+};
+
+/*
+ * Timestamped TS output, 4 byte arrival time in front of each packet
+ * misc: character device, one reader at a time
+ * lock: protects reader against the tasklet on open/release
+ * reader: the open file, NULL while nobody reads
+ * packets: packets written to the ring buffer
+ * overflows: packets dropped because the reader was too slow
+ */
+struct saa716x_m2ts {
+	struct miscdevice	misc;
+	char			name[32];
+
+	spinlock_t		lock;
+	struct saa716x_m2ts_reader *reader;
+
+	u32			packets;
+	u32			overflows;
+};
+
+struct saa716x_adapter;
+
+extern int saa716x_m2ts_init(struct saa716x_adapter *saa716x_adap);
+extern void saa716x_m2ts_exit(struct saa716x_adapter *saa716x_adap);
+extern void saa716x_m2ts_feed(struct saa716x_m2ts *m2ts, const u8 *buf,
+			      int count, ktime_t start, ktime_t end);
+
+#endif /* __SAA716x_M2TS_H */
@@ -63,6 +63,7 @@
 #define MSI_CONFIG48			0x0c8
 #define MSI_CONFIG49			0x0cc
 #define MSI_CONFIG50			0x0d0
+#define MSI_CONFIG(__n)			(MSI_CONFIG0 + (__n) * 0x04)
 
 #define MSI_INT_POL_EDGE_RISE		(0x00000001 << 24)
 #define MSI_INT_POL_EDGE_FALL		(0x00000002 << 24)
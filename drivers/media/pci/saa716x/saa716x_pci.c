@@ -9,11 +9,134 @@
 #include <linux/signal.h>
 #include <linux/sched.h>
 #include <linux/interrupt.h>
+#include <linux/topology.h>
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/module.h>
 
 #include "saa716x_priv.h"
 
 #define DRIVER_NAME				"SAA716x Core"
 
+static bool numa_affinity = true;
+module_param(numa_affinity, bool, 0444);
+MODULE_PARM_DESC(numa_affinity,
+	"run the interrupt and the stream tasklets on the device's NUMA node (default on)");
+
+static int pcie_mps;
+module_param(pcie_mps, int, 0444);
+MODULE_PARM_DESC(pcie_mps,
+	"PCIe Max Payload Size in bytes (0=as set up by the PCI core)");
+
+static int pcie_mrrs;
+module_param(pcie_mrrs, int, 0444);
+MODULE_PARM_DESC(pcie_mrrs,
+	"PCIe Max Read Request Size in bytes (0=as set up by the PCI core, -1=same as the payload size)");
+
+static int relaxed_ordering = -1;
+module_param(relaxed_ordering, int, 0444);
+MODULE_PARM_DESC(relaxed_ordering,
+	"PCIe relaxed ordering (-1=as set up by the PCI core, 0=off, 1=on)");
+
+static int no_snoop = -1;
+module_param(no_snoop, int, 0444);
+MODULE_PARM_DESC(no_snoop,
+	"PCIe no-snoop, stream buffers are not cache coherent when on (-1=as set up by the firmware, 0=off, 1=on)");
+
+/* start a new throughput measurement for the current setting */
+static void saa716x_pcie_bench_reset(struct saa716x_dev *saa716x)
+{
+	struct saa716x_pcie_bench *bench = &saa716x->pcie_bench;
+	u32 port;
+	int i;
+
+	bench->start = ktime_get();
+	for (i = 0; i < saa716x->config->adapters; i++) {
+		port = saa716x->config->adap_config[i].ts_fgpi;
+		bench->bytes[i] = READ_ONCE(saa716x->fgpi[port].hot.bytes);
+	}
+}
+
+/* the payload has to fit the port above, TLPs get dropped otherwise */
+static int saa716x_pcie_set_mps(struct saa716x_dev *saa716x, int mps)
+{
+	struct pci_dev *pdev = saa716x->pdev;
+	struct pci_dev *bridge = pci_upstream_bridge(pdev);
+
+	if (mps < 128 || mps > 4096 || !is_power_of_2(mps))
+		return -EINVAL;
+
+	if (bridge && pci_is_pcie(bridge) && mps > pcie_get_mps(bridge))
+		return -EINVAL;
+
+	return pcie_set_mps(pdev, mps);
+}
+
+static int saa716x_pcie_set_mrrs(struct saa716x_dev *saa716x, int mrrs)
+{
+	if (mrrs < 128 || mrrs > 4096 || !is_power_of_2(mrrs))
+		return -EINVAL;
+
+	return pcie_set_readrq(saa716x->pdev, mrrs);
+}
+
+static void saa716x_pcie_set_flag(struct saa716x_dev *saa716x, u16 flag,
+				  bool enable)
+{
+	if (enable)
+		pcie_capability_set_word(saa716x->pdev, PCI_EXP_DEVCTL, flag);
+	else
+		pcie_capability_clear_word(saa716x->pdev, PCI_EXP_DEVCTL, flag);
+}
+
+static bool saa716x_pcie_flag(struct saa716x_dev *saa716x, u16 flag)
+{
+	u16 devctl = 0;
+
+	pcie_capability_read_word(saa716x->pdev, PCI_EXP_DEVCTL, &devctl);
+	return devctl & flag;
+}
+
+/*
+ * The stream DMA is almost only memory writes, which go out in
+ * payload sized TLPs. Reads are page table fetches only, a read
+ * request no larger than the payload (pcie_mrrs=-1) keeps completions
+ * short for the other devices on the link.
+ */
+static void saa716x_pcie_tune(struct saa716x_dev *saa716x)
+{
+	struct pci_dev *pdev = saa716x->pdev;
+	int mrrs;
+
+	if (!pci_is_pcie(pdev))
+		return;
+
+	if (pcie_mps && saa716x_pcie_set_mps(saa716x, pcie_mps))
+		pci_err(pdev, "Max Payload Size %d not possible", pcie_mps);
+
+	mrrs = pcie_mrrs < 0 ? pcie_get_mps(pdev) : pcie_mrrs;
+	if (mrrs && saa716x_pcie_set_mrrs(saa716x, mrrs))
+		pci_err(pdev, "Max Read Request Size %d not possible", mrrs);
+
+	/* the PCI core clears it below root ports known to break it */
+	if (relaxed_ordering >= 0)
+		saa716x_pcie_set_flag(saa716x, PCI_EXP_DEVCTL_RELAX_EN,
+				      relaxed_ordering);
+
+	if (no_snoop >= 0)
+		saa716x_pcie_set_flag(saa716x, PCI_EXP_DEVCTL_NOSNOOP_EN,
+				      no_snoop);
+	if (saa716x_pcie_flag(saa716x, PCI_EXP_DEVCTL_NOSNOOP_EN))
+		pci_warn(pdev, "no-snoop enabled, TS data may be stale");
+
+	pci_info(pdev, "PCIe MPS %d, MRRS %d, RO %d, NS %d",
+		 pcie_get_mps(pdev), pcie_get_readrq(pdev),
+		 saa716x_pcie_flag(saa716x, PCI_EXP_DEVCTL_RELAX_EN),
+		 saa716x_pcie_flag(saa716x, PCI_EXP_DEVCTL_NOSNOOP_EN));
+
+	saa716x_pcie_bench_reset(saa716x);
+}
+
 static int saa716x_request_irq(struct saa716x_dev *saa716x)
 {
 	struct pci_dev *pdev = saa716x->pdev;
@@ -30,13 +153,22 @@ static int saa716x_request_irq(struct saa716x_dev *saa716x)
 			  IRQF_SHARED,
 			  DRIVER_NAME,
 			  saa716x);
-	return ret;
+	if (ret)
+		return ret;
+
+	/* the tasklets run where the interrupt was taken */
+	if (numa_affinity && dev_to_node(&pdev->dev) != NUMA_NO_NODE)
+		irq_set_affinity_hint(pci_irq_vector(pdev, 0),
+				      cpumask_of_node(dev_to_node(&pdev->dev)));
+
+	return 0;
 }
 
 static void saa716x_free_irq(struct saa716x_dev *saa716x)
 {
 	struct pci_dev *pdev = saa716x->pdev;
 
+	irq_set_affinity_hint(pci_irq_vector(pdev, 0), NULL);
 	free_irq(pci_irq_vector(pdev, 0), saa716x);
 	pci_free_irq_vectors(pdev);
 }
@@ -75,6 +207,9 @@ int saa716x_pci_init(struct saa716x_dev *saa716x)
 
 	pci_set_master(pdev);
 
+	mutex_init(&saa716x->pcie_lock);
+	saa716x_pcie_tune(saa716x);
+
 	pm_cap = pci_find_capability(pdev, PCI_CAP_ID_PM);
 	if (pm_cap == 0) {
 		pci_err(saa716x->pdev, "Cannot find Power Management Capability");
@@ -162,6 +297,139 @@ void saa716x_pci_exit(struct saa716x_dev *saa716x)
 }
 EXPORT_SYMBOL_GPL(saa716x_pci_exit);
 
+/* the link settings must not change under a running DMA */
+static bool saa716x_pcie_busy(struct saa716x_dev *saa716x)
+{
+	int i;
+
+	for (i = 0; i < saa716x->config->adapters; i++) {
+		if (READ_ONCE(saa716x->saa716x_adap[i].dma_active))
+			return true;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(saa716x->vip); i++) {
+		if (READ_ONCE(saa716x->vip[i].running))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Run time tuning, each change also restarts the throughput
+ * measurement in debugfs pcie_throughput and is kept for the restore
+ * after a link reset. Refused while any stream DMA runs.
+ */
+static ssize_t saa716x_pcie_store(struct device *dev, const char *buf,
+				  size_t count, u16 flag,
+				  int (*set)(struct saa716x_dev *, int))
+{
+	struct saa716x_dev *saa716x = dev_get_drvdata(dev);
+	int val, ret;
+
+	ret = kstrtoint(buf, 0, &val);
+	if (ret)
+		return ret;
+
+	mutex_lock(&saa716x->pcie_lock);
+	if (saa716x_pcie_busy(saa716x)) {
+		ret = -EBUSY;
+	} else if (set) {
+		ret = set(saa716x, val);
+	} else {
+		saa716x_pcie_set_flag(saa716x, flag, val);
+		ret = 0;
+	}
+	if (!ret) {
+		pci_save_state(saa716x->pdev);
+		saa716x_pcie_bench_reset(saa716x);
+	}
+	mutex_unlock(&saa716x->pcie_lock);
+
+	return ret ? ret : count;
+}
+
+static ssize_t max_payload_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	return sysfs_emit(buf, "%d\n", pcie_get_mps(to_pci_dev(dev)));
+}
+
+static ssize_t max_payload_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	return saa716x_pcie_store(dev, buf, count, 0, saa716x_pcie_set_mps);
+}
+static DEVICE_ATTR_RW(max_payload);
+
+static ssize_t max_read_request_show(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	return sysfs_emit(buf, "%d\n", pcie_get_readrq(to_pci_dev(dev)));
+}
+
+static ssize_t max_read_request_store(struct device *dev,
+				      struct device_attribute *attr,
+				      const char *buf, size_t count)
+{
+	return saa716x_pcie_store(dev, buf, count, 0, saa716x_pcie_set_mrrs);
+}
+static DEVICE_ATTR_RW(max_read_request);
+
+static ssize_t relaxed_ordering_show(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	return sysfs_emit(buf, "%d\n",
+			  saa716x_pcie_flag(dev_get_drvdata(dev),
+					    PCI_EXP_DEVCTL_RELAX_EN));
+}
+
+static ssize_t relaxed_ordering_store(struct device *dev,
+				      struct device_attribute *attr,
+				      const char *buf, size_t count)
+{
+	return saa716x_pcie_store(dev, buf, count,
+				  PCI_EXP_DEVCTL_RELAX_EN, NULL);
+}
+static DEVICE_ATTR_RW(relaxed_ordering);
+
+static ssize_t no_snoop_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	return sysfs_emit(buf, "%d\n",
+			  saa716x_pcie_flag(dev_get_drvdata(dev),
+					    PCI_EXP_DEVCTL_NOSNOOP_EN));
+}
+
+static ssize_t no_snoop_store(struct device *dev,
+			      struct device_attribute *attr,
+			      const char *buf, size_t count)
+{
+	return saa716x_pcie_store(dev, buf, count,
+				  PCI_EXP_DEVCTL_NOSNOOP_EN, NULL);
+}
+static DEVICE_ATTR_RW(no_snoop);
+
+static struct attribute *saa716x_pcie_attrs[] = {
+	&dev_attr_max_payload.attr,
+	&dev_attr_max_read_request.attr,
+	&dev_attr_relaxed_ordering.attr,
+	&dev_attr_no_snoop.attr,
+	NULL
+};
+
+static const struct attribute_group saa716x_pcie_group = {
+	.name	= "pcie_tuning",
+	.attrs	= saa716x_pcie_attrs,
+};
+
+const struct attribute_group *saa716x_pci_groups[] = {
+	&saa716x_pcie_group,
+	NULL
+};
+EXPORT_SYMBOL_GPL(saa716x_pci_groups);
+
 MODULE_DESCRIPTION("SAA716x bridge driver");
 MODULE_AUTHOR("Manu Abraham");
 MODULE_LICENSE("GPL");
@@ -6,4 +6,6 @@
 extern int saa716x_pci_init(struct saa716x_dev *saa716x);
 extern void saa716x_pci_exit(struct saa716x_dev *saa716x);
 
+extern const struct attribute_group *saa716x_pci_groups[];
+
 #endif /* __SAA716x_PCI_H */
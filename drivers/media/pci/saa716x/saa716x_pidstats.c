@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: GPL-2.0+
+
+#include <linux/debugfs.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/seq_file.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+
+#include "saa716x_pidstats.h"
+#include "saa716x_priv.h"
+
+static bool pid_stats = true;
+module_param(pid_stats, bool, 0444);
+MODULE_PARM_DESC(pid_stats,
+	"count packets, CC and TEI errors per PID in the TS path (default on)");
+
+#define TS_SYNC			0x47000000
+#define TS_TEI			0x00800000
+#define TS_PID(h)		(((h) >> 8) & 0x1fff)
+#define TS_TSC(h)		(((h) >> 6) & 0x3)
+#define TS_AF			0x00000020
+#define TS_PAYLOAD		0x00000010
+#define TS_CC(h)		((h) & 0xf)
+#define TS_NULL_PID		0x1fff
+
+/*
+ * One pass over the packet headers of a TS buffer, called from the
+ * tasklet. A packet costs a 32 bit header load and one 16 byte entry;
+ * the adaptation field is only looked at for the discontinuity flag.
+ */
+void saa716x_pidstats_feed(struct saa716x_pidstats *stats, const u8 *buf,
+			   int count)
+{
+	struct saa716x_pid_stats *pid = stats->pid;
+	struct saa716x_pid_stats *entry;
+	u32 hdr;
+	u8 cc;
+
+	if (!pid)
+		return;
+
+	if (READ_ONCE(stats->reset)) {
+		memset(pid, 0, SAA716x_PIDS * sizeof(*pid));
+		stats->sync_errors = 0;
+		stats->start = ktime_get();
+		WRITE_ONCE(stats->reset, 0);
+	}
+
+	for (; count; count--, buf += 188) {
+		/* packets start 4 byte aligned in the page sized buffers */
+		hdr = be32_to_cpup((const __be32 *)buf);
+		if ((hdr & 0xff000000) != TS_SYNC) {
+			stats->sync_errors++;
+			continue;
+		}
+
+		entry = &pid[TS_PID(hdr)];
+		entry->packets++;
+		entry->tsc = TS_TSC(hdr);
+
+		if (unlikely(hdr & TS_TEI)) {
+			entry->tei++;
+			/* the header itself may be wrong, keep the CC */
+			continue;
+		}
+
+		if (!(hdr & TS_PAYLOAD) || TS_PID(hdr) == TS_NULL_PID)
+			continue;
+
+		cc = TS_CC(hdr) | SAA716x_PID_CC_VALID;
+		if (entry->cc & SAA716x_PID_CC_VALID &&
+		    cc != entry->cc &&
+		    cc != (((entry->cc + 1) & 0xf) | SAA716x_PID_CC_VALID)) {
+			/* discontinuity_indicator announces the jump */
+			if (!((hdr & TS_AF) && buf[4] && (buf[5] & 0x80)))
+				entry->cc_errors++;
+		}
+		entry->cc = cc;
+	}
+}
+EXPORT_SYMBOL_GPL(saa716x_pidstats_feed);
+
+static int saa716x_pidstats_show(struct seq_file *s, void *unused)
+{
+	struct saa716x_adapter *saa716x_adap = s->private;
+	struct saa716x_pidstats *stats = &saa716x_adap->pidstats;
+	struct saa716x_pid_stats entry;
+	u64 elapsed_us;
+	int i;
+
+	elapsed_us = ktime_us_delta(ktime_get(), stats->start);
+	seq_printf(s, "# %llu ms, sync errors %u\n",
+		   div_u64(elapsed_us, 1000), READ_ONCE(stats->sync_errors));
+	seq_puts(s, "#  pid     packets  kbit/s  cc_errors         tei  tsc\n");
+	if (!elapsed_us)
+		return 0;
+
+	for (i = 0; i < SAA716x_PIDS; i++) {
+		entry = stats->pid[i];
+		if (!entry.packets)
+			continue;
+
+		seq_printf(s, "0x%04x  %10u  %6llu  %9u  %10u  %3u\n", i,
+			   entry.packets,
+			   div64_u64((u64)entry.packets * 188 * 8000,
+				     elapsed_us),
+			   entry.cc_errors, entry.tei, entry.tsc);
+	}
+
+	return 0;
+}
+
+static int saa716x_pidstats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, saa716x_pidstats_show, inode->i_private);
+}
+
+/* any write clears the counters */
+static ssize_t saa716x_pidstats_write(struct file *file,
+				      const char __user *buf,
+				      size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct saa716x_adapter *saa716x_adap = s->private;
+
+	WRITE_ONCE(saa716x_adap->pidstats.reset, 1);
+
+	return count;
+}
+
+static const struct file_operations saa716x_pidstats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= saa716x_pidstats_open,
+	.read		= seq_read,
+	.write		= saa716x_pidstats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+void saa716x_pidstats_init(struct saa716x_adapter *saa716x_adap)
+{
+	struct saa716x_pidstats *stats = &saa716x_adap->pidstats;
+	struct device *dev = &saa716x_adap->saa716x->pdev->dev;
+
+	stats->start = ktime_get();
+	if (!pid_stats)
+		return;
+
+	stats->pid = vzalloc_node(SAA716x_PIDS * sizeof(*stats->pid),
+				  dev_to_node(dev));
+	if (!stats->pid)
+		return;
+
+	debugfs_create_file("pids", 0644, saa716x_adap->debugfs,
+			    saa716x_adap, &saa716x_pidstats_fops);
+}
+EXPORT_SYMBOL_GPL(saa716x_pidstats_init);
+
+/* after the tasklet is gone */
+void saa716x_pidstats_exit(struct saa716x_adapter *saa716x_adap)
+{
+	vfree(saa716x_adap->pidstats.pid);
+	saa716x_adap->pidstats.pid = NULL;
+}
+EXPORT_SYMBOL_GPL(saa716x_pidstats_exit);
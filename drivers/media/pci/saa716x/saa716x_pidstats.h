@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+
+#ifndef __SAA716x_PIDSTATS_H
+#define __SAA716x_PIDSTATS_H
+
+#include <linux/ktime.h>
+#include <linux/types.h>
+
+#define SAA716x_PIDS		8192
+
+/*
+ * Per PID counters, 16 bytes so that a packet touches one cache line
+ * packets: packets seen
+ * cc_errors: continuity counter discontinuities
+ * tei: packets with the transport error indicator set
+ * cc: last continuity counter, SAA716x_PID_CC_VALID once one was seen
+ * tsc: transport scrambling control of the last packet
+ */
+struct saa716x_pid_stats {
+	u32			packets;
+	u32			cc_errors;
+	u32			tei;
+	u8			cc;
+	u8			tsc;
+	u16			reserved;
+};
+
+#define SAA716x_PID_CC_VALID	0x10
+
+/*
+ * pid: SAA716x_PIDS entries, NULL if disabled
+ * start: time the counters were cleared
+ * sync_errors: packets without sync byte
+ * reset: clear the counters before the next buffer
+ */
+struct saa716x_pidstats {
+	struct saa716x_pid_stats *pid;
+	ktime_t			start;
+	u32			sync_errors;
+	u8			reset;
+};
+
+struct saa716x_adapter;
+
+extern void saa716x_pidstats_init(struct saa716x_adapter *saa716x_adap);
+extern void saa716x_pidstats_exit(struct saa716x_adapter *saa716x_adap);
+extern void saa716x_pidstats_feed(struct saa716x_pidstats *stats,
+				  const u8 *buf, int count);
+
+#endif /* __SAA716x_PIDSTATS_H */
@@ -3,12 +3,26 @@
 #ifndef __SAA716x_PRIV_H
 #define __SAA716x_PRIV_H
 
+#include <linux/gpio/driver.h>
+#include <linux/iopoll.h>
 #include <linux/pci.h>
+#include <linux/workqueue.h>
+#include "saa716x_aip.h"
+#include "saa716x_alsa.h"
+#include "saa716x_bpf.h"
 #include "saa716x_i2c.h"
 #include "saa716x_cgu.h"
 #include "saa716x_dma.h"
+#include "saa716x_festats.h"
 #include "saa716x_fgpi.h"
+#include "saa716x_gpio.h"
+#include "saa716x_m2ts.h"
+#include "saa716x_pidstats.h"
+#include "saa716x_psi.h"
+#include "saa716x_streamer.h"
 #include "saa716x_vip.h"
+#include "saa716x_video.h"
+#include "saa716x_debugfs.h"
 
 #include <media/dvbdev.h>
 #include <media/dvb_demux.h>
@@ -37,6 +51,9 @@
 	writel((__data), (saa716x->mmio + (__offst + __addr)))
 #define SAA716x_EPRD(__offst, __addr)		\
 	readl((saa716x->mmio + (__offst + __addr)))
+#define SAA716x_EPPOLL(__offst, __addr, __val, __cond, __sleep, __tmo)	\
+	readl_poll_timeout((saa716x->mmio + (__offst + __addr)),	\
+			   __val, __cond, __sleep, __tmo)
 
 struct saa716x_dev;
 struct saa716x_adapter;
@@ -44,6 +61,7 @@ struct saa716x_adapter;
 struct saa716x_adap_config {
 	u32				ts_vp;
 	u32				ts_fgpi;
+	u32				i2c_bus;
 };
 
 struct saa716x_config {
@@ -58,6 +76,40 @@ struct saa716x_config {
 	struct saa716x_adap_config	adap_config[SAA716x_MAX_ADAPTERS];
 	enum saa716x_i2c_rate		i2c_rate;
 	enum saa716x_i2c_mode		i2c_mode;
+
+	/* VIP ports with a video input, bit per port */
+	u8				vip_ports;
+	/* AI ports with an I2S audio input, bit per port */
+	u8				aip_ports;
+};
+
+/*
+ * Channel change statistics
+ * hot: feed restarted while the DMA was still running (grace period)
+ * count: zaps measured from the first feed to the first TS buffer
+ */
+struct saa716x_zap_stats {
+	u32				hot;
+	u32				count;
+	u32				last_us;
+	u32				min_us;
+	u32				max_us;
+	u64				total_us;
+};
+
+/*
+ * DMA watchdog statistics
+ * stalls: no TAGACK progress while the frontend reported lock
+ * no_lock: no TAGACK progress without lock, not a hardware problem
+ * recoveries: FGPI/BAM re-inits done, failed ones counted separately
+ */
+struct saa716x_wdog_stats {
+	u32				stalls;
+	u32				no_lock;
+	u32				recoveries;
+	u32				failed;
+	u32				last_us;
+	u32				max_us;
 };
 
 struct saa716x_adapter {
@@ -73,9 +125,100 @@ struct saa716x_adapter {
 
 	u8				feeds;
 	u8				count;
+	u8				dma_active;
+
+	/* set up by dvb_init, dvb_exit leaves the others alone */
+	u8				registered;
+
+	/* stops the DMA once the idle grace period expired */
+	struct delayed_work		idle_work;
+
+	ktime_t				zap_start;
+	u8				zap_pending;
+	struct saa716x_zap_stats	zap;
+
+	/* TS buffers of the port seen at the last watchdog check */
+	u32				wdog_buffers;
+	/* port given up by the watchdog, until the feeds start it again */
+	u8				dma_dead;
+	unsigned long			wdog_stamp;
+	struct delayed_work		wdog_work;
+	struct saa716x_wdog_stats	wdog;
+
+	/* resume to first TS buffer */
+	ktime_t				resume_start;
+	u8				resume_pending;
+	u32				resume_us;
+
+	struct saa716x_m2ts		m2ts;
+	struct saa716x_pidstats		pidstats;
+	struct saa716x_psi		psi;
+	struct saa716x_bpf		bpf;
+	struct saa716x_fe_stats		fe_stats;
+	struct saa716x_streamer		*streamer;
+
+	/* task tuning the frontend, its I2C transfers go first */
+	struct task_struct		*tune_task;
+
+	/* ops of the demod driver as attached, fe->ops has the wrappers */
+	struct dvb_frontend_ops		fe_ops;
 
 	struct i2c_client		*i2c_client_demod;
 	struct i2c_client		*i2c_client_tuner;
+
+	struct dentry			*debugfs;
+};
+
+/*
+ * Power management
+ * greg_*: port routing, lost on power down
+ * resume_us: time the last resume took up to the frontends
+ */
+struct saa716x_pm_state {
+	u32				greg_vi_ctrl;
+	u32				greg_fgpi_ctrl;
+
+	u32				suspends;
+	u32				resumes;
+	u32				resume_us;
+};
+
+/*
+ * PCIe error recovery
+ * start: error detection of the recovery in progress
+ * last_us/max_us: detection to restarted streams
+ */
+struct saa716x_err_stats {
+	u32				errors;
+	u32				recoveries;
+	u32				failed;
+	u32				last_us;
+	u32				max_us;
+	ktime_t				start;
+};
+
+/*
+ * DMA throughput since the last PCIe tuning change
+ * start: time of the change
+ * bytes: TS bytes per adapter at that time
+ */
+struct saa716x_pcie_bench {
+	ktime_t				start;
+	u64				bytes[SAA716x_MAX_ADAPTERS];
+};
+
+/*
+ * Interrupt dispatch, one entry per MSI status bit, built from the
+ * board config at probe and not changed afterwards
+ * tasklet: bottom half scheduled for the bit
+ * tag_time: where the interrupt time is left for the bottom half
+ * fgpi, adapter: stream port and the adapter it feeds
+ */
+struct saa716x_dispatch {
+	struct tasklet_struct		*tasklet;
+	ktime_t				*tag_time;
+	struct saa716x_fgpi_stream_port	*fgpi;
+	struct saa716x_adapter		*adapter;
 };
 
 struct saa716x_dev {
@@ -87,19 +230,40 @@ struct saa716x_dev {
 
 	/* PCI */
 	void __iomem			*mmio;
+	struct mutex			pcie_lock;
+	struct saa716x_pcie_bench	pcie_bench;
 
 	/* I2C */
 	struct saa716x_i2c		i2c[2];
+	struct saa716x_fe_stats_bus	fe_stats_bus[SAA716x_I2C_ADAPTERS];
 	u32				I2C_DEV[2];
 
 	struct saa716x_adapter		saa716x_adap[SAA716x_MAX_ADAPTERS];
 	struct saa716x_cgu		cgu;
 
 	spinlock_t			gpio_lock;
+	struct saa716x_gpio_state	gpio_state;
+	struct gpio_chip		gpio_chip;
+	struct irq_chip			gpio_irqchip;
+
+	/* PM */
+	u8				suspended;
+	struct saa716x_pm_state		pm;
+	struct saa716x_err_stats	err;
+
 	/* DMA */
+	unsigned long			dispatch_l;
+	struct saa716x_dispatch		dispatch[32];
 
 	struct saa716x_fgpi_stream_port	fgpi[4];
 	struct saa716x_vip_stream_port	vip[2];
+	struct saa716x_video		*video[2];
+	struct saa716x_aip_stream_port	aip[2];
+	struct saa716x_alsa		*alsa;
+
+	/* debugfs */
+	struct dentry			*debugfs;
+	struct saa716x_timeline		timeline;
 };
 
 #endif /* __SAA716x_PRIV_H */
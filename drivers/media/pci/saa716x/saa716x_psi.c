@@ -0,0 +1,618 @@
+// SPDX-License-Identifier: GPL-2.0+
+
+#include <linux/crc32.h>
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+
+#include "saa716x_adap.h"
+#include "saa716x_psi.h"
+#include "saa716x_priv.h"
+
+static bool psi_cache;
+module_param(psi_cache, bool, 0444);
+MODULE_PARM_DESC(psi_cache,
+	"keep the PAT, CAT, PMT, NIT and SDT sections of the tuned mux per adapter (default off)");
+
+#define PSI_PID_PAT		0x0000
+#define PSI_PID_CAT		0x0001
+#define PSI_PID_NIT		0x0010
+#define PSI_PID_SDT		0x0011
+
+#define PSI_TID_PAT		0x00
+#define PSI_TID_CAT		0x01
+#define PSI_TID_PMT		0x02
+#define PSI_TID_NIT		0x40
+#define PSI_TID_SDT		0x42
+
+/* order the sections are handed to readers in */
+static const u8 saa716x_psi_tids[] = {
+	PSI_TID_PAT, PSI_TID_CAT, PSI_TID_PMT, PSI_TID_NIT, PSI_TID_SDT,
+};
+
+/*
+ * Reader of the cache
+ * saa716x_adap: adapter the reader is on, NULL once it is gone
+ * list: entry in the readers of the adapter
+ * generation: of the snapshot in data
+ */
+struct saa716x_psi_file {
+	struct saa716x_adapter	*saa716x_adap;
+	struct list_head	list;
+	wait_queue_head_t	wait;
+	u32			generation;
+	size_t			len;
+	u8			*data;
+};
+
+/* serializes the readers against the removal of their adapter */
+static DEFINE_MUTEX(saa716x_psi_mutex);
+
+static void saa716x_psi_add_pid(struct saa716x_psi_cache *cache, u16 pid)
+{
+	struct saa716x_psi_asm *st;
+
+	if (test_bit(pid, cache->filter) || cache->pids == SAA716x_PSI_PIDS)
+		return;
+
+	st = &cache->pid[cache->pids++];
+	st->pid = pid;
+	st->cc = 0;
+	st->len = 0;
+	__set_bit(pid, cache->filter);
+}
+
+static void saa716x_psi_reset(struct saa716x_psi_cache *cache)
+{
+	bitmap_zero(cache->filter, 8192);
+	cache->pids = 0;
+	cache->sections = 0;
+
+	saa716x_psi_add_pid(cache, PSI_PID_PAT);
+	saa716x_psi_add_pid(cache, PSI_PID_CAT);
+	saa716x_psi_add_pid(cache, PSI_PID_NIT);
+	saa716x_psi_add_pid(cache, PSI_PID_SDT);
+}
+
+/* the PMT PIDs follow the PAT, sections of PIDs it dropped go too */
+static void saa716x_psi_pat_update(struct saa716x_psi_cache *cache)
+{
+	struct saa716x_psi_section *sec;
+	int i, j, off;
+	u16 pid;
+
+	for (i = 4; i < cache->pids; i++)
+		__clear_bit(cache->pid[i].pid, cache->filter);
+	cache->pids = 4;
+
+	for (i = 0; i < cache->sections; i++) {
+		sec = &cache->section[i];
+		if (sec->table_id != PSI_TID_PAT)
+			continue;
+
+		/* program loop up to the CRC, program 0 is the NIT PID */
+		for (off = 8; off + 4 <= sec->len - 4; off += 4) {
+			if (!(sec->data[off] | sec->data[off + 1]))
+				continue;
+			pid = (sec->data[off + 2] & 0x1f) << 8 |
+			      sec->data[off + 3];
+			saa716x_psi_add_pid(cache, pid);
+		}
+	}
+
+	for (i = j = 0; i < cache->sections; i++) {
+		sec = &cache->section[i];
+		if (sec->table_id == PSI_TID_PMT &&
+		    !test_bit(sec->pid, cache->filter))
+			continue;
+		if (i != j)
+			cache->section[j] = *sec;
+		j++;
+	}
+	cache->sections = j;
+}
+
+static void saa716x_psi_section(struct saa716x_psi *psi, u16 pid,
+				const u8 *data, int len)
+{
+	struct saa716x_psi_cache *cache = psi->cache;
+	struct saa716x_psi_section *sec = NULL;
+	u8 tid = data[0], version, number;
+	u16 ext;
+	bool ok;
+	int i;
+
+	switch (pid) {
+	case PSI_PID_PAT:
+		ok = tid == PSI_TID_PAT;
+		break;
+	case PSI_PID_CAT:
+		ok = tid == PSI_TID_CAT;
+		break;
+	case PSI_PID_NIT:
+		ok = tid == PSI_TID_NIT;
+		break;
+	case PSI_PID_SDT:
+		ok = tid == PSI_TID_SDT;
+		break;
+	default:
+		ok = tid == PSI_TID_PMT;
+		break;
+	}
+
+	/* long syntax with CRC, and only what is valid now */
+	if (!ok || !(data[1] & 0x80) || len < 12 || !(data[5] & 0x01))
+		return;
+
+	ext = data[3] << 8 | data[4];
+	version = (data[5] >> 1) & 0x1f;
+	number = data[6];
+
+	for (i = 0; i < cache->sections; i++) {
+		sec = &cache->section[i];
+		if (sec->pid == pid && sec->table_id == tid &&
+		    sec->ext == ext && sec->number == number)
+			break;
+		sec = NULL;
+	}
+
+	/* repetitions of a known version are the common case, no CRC */
+	if (sec && sec->version == version && sec->len == len)
+		return;
+
+	if (crc32_be(~0, data, len)) {
+		psi->crc_errors++;
+		return;
+	}
+
+	if (!sec) {
+		if (cache->sections == SAA716x_PSI_SECTIONS) {
+			psi->overflows++;
+			return;
+		}
+		sec = &cache->section[cache->sections++];
+	}
+
+	sec->pid = pid;
+	sec->ext = ext;
+	sec->len = len;
+	sec->table_id = tid;
+	sec->version = version;
+	sec->number = number;
+	memcpy(sec->data, data, len);
+
+	psi->updates++;
+	psi->generation++;
+
+	if (tid == PSI_TID_PAT)
+		saa716x_psi_pat_update(cache);
+}
+
+/* add up to len bytes to the section being collected, returns the used */
+static int saa716x_psi_collect(struct saa716x_psi *psi,
+			       struct saa716x_psi_asm *st,
+			       const u8 *data, int len)
+{
+	int total, used = 0, n;
+
+	if (st->len < 3) {
+		n = min(3 - st->len, len);
+		memcpy(st->buf + st->len, data, n);
+		st->len += n;
+		if (st->len < 3)
+			return n;
+		data += n;
+		len -= n;
+		used = n;
+	}
+
+	total = 3 + ((st->buf[1] & 0x0f) << 8 | st->buf[2]);
+	if (total > SAA716x_PSI_SECTION) {
+		st->len = 0;
+		return used + len;
+	}
+
+	n = min(total - st->len, len);
+	memcpy(st->buf + st->len, data, n);
+	st->len += n;
+
+	if (st->len == total) {
+		saa716x_psi_section(psi, st->pid, st->buf, total);
+		st->len = 0;
+	}
+
+	return used + n;
+}
+
+static void saa716x_psi_packet(struct saa716x_psi *psi,
+			       struct saa716x_psi_asm *st, const u8 *pkt)
+{
+	const u8 *p = pkt + 4, *end = pkt + 188;
+	u8 cc = (pkt[3] & 0x0f) | 0x10;
+	u8 ptr;
+
+	if (pkt[1] & 0x80) {
+		st->len = 0;
+		return;
+	}
+	if (!(pkt[3] & 0x10) || st->cc == cc)
+		return;
+
+	/* a lost packet takes the section it belonged to along */
+	if (st->cc & 0x10 && cc != (((st->cc + 1) & 0x0f) | 0x10))
+		st->len = 0;
+	st->cc = cc;
+
+	if (pkt[3] & 0x20)
+		p += 1 + pkt[4];
+	if (p >= end)
+		return;
+
+	if (!(pkt[1] & 0x40)) {
+		if (st->len)
+			saa716x_psi_collect(psi, st, p, end - p);
+		return;
+	}
+
+	ptr = *p++;
+	if (p + ptr > end) {
+		st->len = 0;
+		return;
+	}
+	if (st->len)
+		saa716x_psi_collect(psi, st, p, ptr);
+	st->len = 0;
+
+	/* more sections may follow, 0xff is stuffing */
+	for (p += ptr; p < end && *p != 0xff; )
+		p += saa716x_psi_collect(psi, st, p, end - p);
+}
+
+/* called with the lock held */
+static void saa716x_psi_wake(struct saa716x_psi *psi)
+{
+	struct saa716x_psi_file *pf;
+
+	list_for_each_entry(pf, &psi->readers, list)
+		wake_up_interruptible(&pf->wait);
+}
+
+/*
+ * Called from the tasklet for a TS buffer. The PID bitmap keeps the
+ * cost for the packets nobody caches at one bit test. After a tune
+ * nothing is taken until the frontend has lock on the new mux, the
+ * buffers in flight still carry the old one.
+ */
+void saa716x_psi_feed(struct saa716x_psi *psi, const u8 *buf, int count)
+{
+	struct saa716x_psi_cache *cache = psi->cache;
+	u32 generation;
+	u16 pid;
+	int i;
+
+	if (!cache || !READ_ONCE(psi->synced))
+		return;
+
+	spin_lock(&psi->lock);
+	if (!psi->synced)
+		goto out;
+
+	generation = psi->generation;
+	for (; count; count--, buf += 188) {
+		if (buf[0] != 0x47)
+			continue;
+
+		pid = (buf[1] & 0x1f) << 8 | buf[2];
+		if (!test_bit(pid, cache->filter))
+			continue;
+
+		for (i = 0; i < cache->pids; i++) {
+			if (cache->pid[i].pid == pid) {
+				saa716x_psi_packet(psi, &cache->pid[i], buf);
+				break;
+			}
+		}
+	}
+	if (generation != psi->generation)
+		saa716x_psi_wake(psi);
+out:
+	spin_unlock(&psi->lock);
+}
+EXPORT_SYMBOL_GPL(saa716x_psi_feed);
+
+/* the frontend is about to tune, nothing cached belongs to the new mux */
+void saa716x_psi_invalidate(struct saa716x_psi *psi)
+{
+	if (!psi->cache)
+		return;
+
+	spin_lock_bh(&psi->lock);
+	saa716x_psi_reset(psi->cache);
+	psi->epoch++;
+	psi->synced = false;
+	psi->generation++;
+	psi->invalidations++;
+	saa716x_psi_wake(psi);
+	spin_unlock_bh(&psi->lock);
+}
+EXPORT_SYMBOL_GPL(saa716x_psi_invalidate);
+
+/*
+ * A frontend status read in epoch. Lock in the current epoch is on the
+ * new mux, a status read before a tune does not count.
+ */
+void saa716x_psi_status(struct saa716x_psi *psi, u32 epoch,
+			enum fe_status status)
+{
+	if (!psi->cache || !(status & FE_HAS_LOCK) || READ_ONCE(psi->synced))
+		return;
+
+	spin_lock_bh(&psi->lock);
+	if (psi->epoch == epoch)
+		psi->synced = true;
+	spin_unlock_bh(&psi->lock);
+}
+EXPORT_SYMBOL_GPL(saa716x_psi_status);
+
+static void saa716x_psi_snapshot(struct saa716x_psi *psi,
+				 struct saa716x_psi_file *pf)
+{
+	struct saa716x_psi_cache *cache = psi->cache;
+	struct saa716x_psi_section *sec;
+	int i, t;
+
+	pf->len = 0;
+
+	spin_lock_bh(&psi->lock);
+	for (t = 0; t < ARRAY_SIZE(saa716x_psi_tids); t++) {
+		for (i = 0; i < cache->sections; i++) {
+			sec = &cache->section[i];
+			if (sec->table_id != saa716x_psi_tids[t])
+				continue;
+			memcpy(pf->data + pf->len, sec->data, sec->len);
+			pf->len += sec->len;
+		}
+	}
+	pf->generation = psi->generation;
+	spin_unlock_bh(&psi->lock);
+}
+
+/*
+ * misc_open() holds the misc lock over this, so the adapter cannot go
+ * away underneath; afterwards the file checks under the mutex.
+ */
+static int saa716x_psi_open(struct inode *inode, struct file *file)
+{
+	struct miscdevice *misc = file->private_data;
+	struct saa716x_adapter *saa716x_adap = container_of(misc,
+					struct saa716x_adapter, psi.misc);
+	struct saa716x_psi *psi = &saa716x_adap->psi;
+	struct saa716x_psi_file *pf;
+	int ret;
+
+	if ((file->f_flags & O_ACCMODE) != O_RDONLY)
+		return -EINVAL;
+
+	pf = kzalloc(sizeof(*pf), GFP_KERNEL);
+	if (!pf)
+		return -ENOMEM;
+
+	pf->data = vmalloc(SAA716x_PSI_SECTIONS * SAA716x_PSI_SECTION);
+	if (!pf->data) {
+		ret = -ENOMEM;
+		goto err;
+	}
+	init_waitqueue_head(&pf->wait);
+
+	/* an open reader keeps the cache fed */
+	ret = saa716x_stream_get(saa716x_adap);
+	if (ret < 0)
+		goto err;
+
+	mutex_lock(&saa716x_psi_mutex);
+	pf->saa716x_adap = saa716x_adap;
+	spin_lock_bh(&psi->lock);
+	list_add_tail(&pf->list, &psi->readers);
+	spin_unlock_bh(&psi->lock);
+	saa716x_psi_snapshot(psi, pf);
+	mutex_unlock(&saa716x_psi_mutex);
+	file->private_data = pf;
+
+	return 0;
+err:
+	vfree(pf->data);
+	kfree(pf);
+	return ret;
+}
+
+/* the caller holds the mutex */
+static void saa716x_psi_detach(struct saa716x_psi_file *pf)
+{
+	struct saa716x_adapter *saa716x_adap = pf->saa716x_adap;
+	struct saa716x_psi *psi = &saa716x_adap->psi;
+
+	spin_lock_bh(&psi->lock);
+	list_del(&pf->list);
+	spin_unlock_bh(&psi->lock);
+
+	saa716x_stream_put(saa716x_adap);
+	pf->saa716x_adap = NULL;
+	wake_up_interruptible(&pf->wait);
+}
+
+static int saa716x_psi_release(struct inode *inode, struct file *file)
+{
+	struct saa716x_psi_file *pf = file->private_data;
+
+	mutex_lock(&saa716x_psi_mutex);
+	if (pf->saa716x_adap)
+		saa716x_psi_detach(pf);
+	mutex_unlock(&saa716x_psi_mutex);
+
+	vfree(pf->data);
+	kfree(pf);
+
+	return 0;
+}
+
+/*
+ * The cached sections back to back, PAT first. Reading from offset 0
+ * takes a fresh snapshot, poll reports a change since the last one.
+ */
+static ssize_t saa716x_psi_read(struct file *file, char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	struct saa716x_psi_file *pf = file->private_data;
+
+	if (!*ppos) {
+		mutex_lock(&saa716x_psi_mutex);
+		if (!pf->saa716x_adap) {
+			mutex_unlock(&saa716x_psi_mutex);
+			return -ENODEV;
+		}
+		saa716x_psi_snapshot(&pf->saa716x_adap->psi, pf);
+		mutex_unlock(&saa716x_psi_mutex);
+	}
+
+	return simple_read_from_buffer(buf, count, ppos, pf->data, pf->len);
+}
+
+static __poll_t saa716x_psi_poll(struct file *file, poll_table *wait)
+{
+	struct saa716x_psi_file *pf = file->private_data;
+	__poll_t mask = 0;
+
+	poll_wait(file, &pf->wait, wait);
+
+	mutex_lock(&saa716x_psi_mutex);
+	if (!pf->saa716x_adap)
+		mask = EPOLLERR | EPOLLHUP;
+	else if (READ_ONCE(pf->saa716x_adap->psi.generation) !=
+		 pf->generation)
+		mask = EPOLLIN | EPOLLRDNORM | EPOLLPRI;
+	mutex_unlock(&saa716x_psi_mutex);
+
+	return mask;
+}
+
+static const struct file_operations saa716x_psi_fops = {
+	.owner		= THIS_MODULE,
+	.open		= saa716x_psi_open,
+	.release	= saa716x_psi_release,
+	.read		= saa716x_psi_read,
+	.poll		= saa716x_psi_poll,
+	.llseek		= default_llseek,
+};
+
+static int saa716x_psi_stats_show(struct seq_file *s, void *unused)
+{
+	struct saa716x_psi *psi = s->private;
+	struct saa716x_psi_section *sec;
+	int i;
+
+	spin_lock_bh(&psi->lock);
+	seq_printf(s, "updates:       %u\n", psi->updates);
+	seq_printf(s, "crc errors:    %u\n", psi->crc_errors);
+	seq_printf(s, "overflows:     %u\n", psi->overflows);
+	seq_printf(s, "invalidations: %u\n", psi->invalidations);
+	seq_printf(s, "synced:        %d\n", psi->synced);
+	seq_puts(s, "#  pid  tid     ext  num  ver   len\n");
+	for (i = 0; i < psi->cache->sections; i++) {
+		sec = &psi->cache->section[i];
+		seq_printf(s, "0x%04x  0x%02x  0x%04x  %3u  %3u  %4u\n",
+			   sec->pid, sec->table_id, sec->ext, sec->number,
+			   sec->version, sec->len);
+	}
+	spin_unlock_bh(&psi->lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(saa716x_psi_stats);
+
+void saa716x_psi_init(struct saa716x_adapter *saa716x_adap)
+{
+	struct saa716x_psi *psi = &saa716x_adap->psi;
+	struct saa716x_dev *saa716x = saa716x_adap->saa716x;
+
+	spin_lock_init(&psi->lock);
+	INIT_LIST_HEAD(&psi->readers);
+	/* nothing tuned yet, what comes in is current */
+	psi->synced = true;
+	if (!psi_cache)
+		return;
+
+	psi->cache = vzalloc_node(sizeof(*psi->cache),
+				  dev_to_node(&saa716x->pdev->dev));
+	if (!psi->cache) {
+		pci_err(saa716x->pdev, "adapter %d: PSI cache not available",
+			saa716x_adap->count);
+		return;
+	}
+	saa716x_psi_reset(psi->cache);
+
+	debugfs_create_file("psi", 0444, saa716x_adap->debugfs, psi,
+			    &saa716x_psi_stats_fops);
+}
+EXPORT_SYMBOL_GPL(saa716x_psi_init);
+
+/* once the ports are set up, a reader starts the DMA */
+void saa716x_psi_register(struct saa716x_adapter *saa716x_adap)
+{
+	struct saa716x_psi *psi = &saa716x_adap->psi;
+	struct saa716x_dev *saa716x = saa716x_adap->saa716x;
+
+	if (!psi->cache)
+		return;
+
+	snprintf(psi->name, sizeof(psi->name), "saa716x-%s-psi%d",
+		 pci_name(saa716x->pdev), saa716x_adap->count);
+	psi->misc.minor = MISC_DYNAMIC_MINOR;
+	psi->misc.name = psi->name;
+	psi->misc.fops = &saa716x_psi_fops;
+	psi->misc.parent = &saa716x->pdev->dev;
+	if (misc_register(&psi->misc) < 0) {
+		psi->misc.fops = NULL;
+		pci_err(saa716x->pdev, "adapter %d: PSI device not available",
+			saa716x_adap->count);
+	}
+}
+EXPORT_SYMBOL_GPL(saa716x_psi_register);
+
+/*
+ * Before the DMA is stopped for good. Readers may keep their files open
+ * past the removal, they are detached here and find the device gone.
+ */
+void saa716x_psi_unregister(struct saa716x_adapter *saa716x_adap)
+{
+	struct saa716x_psi *psi = &saa716x_adap->psi;
+	struct saa716x_psi_file *pf, *tmp;
+
+	/* not registered if init failed */
+	if (!psi->misc.fops)
+		return;
+
+	misc_deregister(&psi->misc);
+	psi->misc.fops = NULL;
+
+	mutex_lock(&saa716x_psi_mutex);
+	list_for_each_entry_safe(pf, tmp, &psi->readers, list)
+		saa716x_psi_detach(pf);
+	mutex_unlock(&saa716x_psi_mutex);
+}
+EXPORT_SYMBOL_GPL(saa716x_psi_unregister);
+
+/* after the tasklet is gone */
+void saa716x_psi_exit(struct saa716x_adapter *saa716x_adap)
+{
+	struct saa716x_psi *psi = &saa716x_adap->psi;
+
+	vfree(psi->cache);
+	psi->cache = NULL;
+}
+EXPORT_SYMBOL_GPL(saa716x_psi_exit);
@@ -0,0 +1,98 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+
+#ifndef __SAA716x_PSI_H
+#define __SAA716x_PSI_H
+
+#include <linux/bitmap.h>
+#include <linux/dvb/frontend.h>
+#include <linux/list.h>
+#include <linux/miscdevice.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+#define SAA716x_PSI_SECTION	1024
+#define SAA716x_PSI_SECTIONS	128
+/* PAT, CAT, NIT, SDT and the PMTs listed in the PAT */
+#define SAA716x_PSI_PMTS	64
+#define SAA716x_PSI_PIDS	(4 + SAA716x_PSI_PMTS)
+
+/*
+ * Cached section, current_next set and CRC checked
+ * ext: table_id_extension
+ */
+struct saa716x_psi_section {
+	u16			pid;
+	u16			ext;
+	u16			len;
+	u8			table_id;
+	u8			version;
+	u8			number;
+	u8			data[SAA716x_PSI_SECTION];
+};
+
+/*
+ * Section assembly for one PID
+ * cc: last continuity counter, 0x10 once one was seen
+ * len: bytes of the section collected so far
+ */
+struct saa716x_psi_asm {
+	u16			pid;
+	u8			cc;
+	u16			len;
+	u8			buf[SAA716x_PSI_SECTION];
+};
+
+struct saa716x_psi_cache {
+	DECLARE_BITMAP(filter, 8192);
+	struct saa716x_psi_asm	pid[SAA716x_PSI_PIDS];
+	int			pids;
+	struct saa716x_psi_section section[SAA716x_PSI_SECTIONS];
+	int			sections;
+};
+
+/*
+ * PSI cache of an adapter
+ * lock: the tasklet holds it for a whole buffer
+ * cache: NULL if disabled
+ * readers: open files, woken on every change
+ * generation: bumped on every change, readers poll for it
+ * epoch: bumped on every tune
+ * synced: the frontend reported lock in this epoch, packets from
+ *	before are from the old mux and are dropped
+ */
+struct saa716x_psi {
+	struct miscdevice	misc;
+	char			name[32];
+
+	spinlock_t		lock;
+	struct saa716x_psi_cache *cache;
+	struct list_head	readers;
+	u32			generation;
+	u32			epoch;
+	bool			synced;
+
+	u32			updates;
+	u32			crc_errors;
+	u32			overflows;
+	u32			invalidations;
+};
+
+struct saa716x_adapter;
+
+/* epoch to pass along with a frontend status read from now on */
+static inline u32 saa716x_psi_epoch(struct saa716x_psi *psi)
+{
+	return READ_ONCE(psi->epoch);
+}
+
+extern void saa716x_psi_init(struct saa716x_adapter *saa716x_adap);
+extern void saa716x_psi_register(struct saa716x_adapter *saa716x_adap);
+extern void saa716x_psi_unregister(struct saa716x_adapter *saa716x_adap);
+extern void saa716x_psi_exit(struct saa716x_adapter *saa716x_adap);
+extern void saa716x_psi_invalidate(struct saa716x_psi *psi);
+extern void saa716x_psi_status(struct saa716x_psi *psi, u32 epoch,
+			       enum fe_status status);
+extern void saa716x_psi_feed(struct saa716x_psi *psi, const u8 *buf,
+			     int count);
+
+#endif /* __SAA716x_PSI_H */
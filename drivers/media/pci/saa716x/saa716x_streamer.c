@@ -0,0 +1,599 @@
+// SPDX-License-Identifier: GPL-2.0+
+
+#include <linux/in.h>
+#include <linux/in6.h>
+#include <linux/inet.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/net.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/sysfs.h>
+#include <linux/udp.h>
+#include <linux/uio.h>
+#include <linux/vmalloc.h>
+
+#include <asm/unaligned.h>
+#include <net/net_namespace.h>
+#include <net/sock.h>
+
+#include "saa716x_adap.h"
+#include "saa716x_priv.h"
+#include "saa716x_streamer.h"
+
+#define TS_PID(p)		((((p)[1] & 0x1f) << 8) | (p)[2])
+
+/* RFC 3551 payload type of MPEG-2 TS */
+#define RTP_PT_MP2T		33
+
+#define SAA716x_STREAMER_LEN	(SAA716x_STREAMER_TS * 188)
+
+static inline struct saa716x_streamer *to_streamer(struct kobject *kobj)
+{
+	return container_of(kobj, struct saa716x_streamer, kobj);
+}
+
+/* RTP header in front of a datagram that is complete */
+static void saa716x_streamer_rtp(struct saa716x_streamer *st,
+				 struct saa716x_streamer_slot *slot)
+{
+	u8 *rtp = slot->rtp;
+
+	rtp[0] = 0x80;
+	rtp[1] = RTP_PT_MP2T;
+	put_unaligned_be16(st->seq++, rtp + 2);
+	/* 90 kHz clock */
+	put_unaligned_be32((u32)div_u64((u64)ktime_to_ns(slot->time) * 9,
+					100000), rtp + 4);
+	put_unaligned_be32(st->ssrc, rtp + 8);
+}
+
+/* the datagram at head is complete, under st->lock */
+static void saa716x_streamer_close(struct saa716x_streamer *st,
+				   struct saa716x_streamer_slot *slot)
+{
+	saa716x_streamer_rtp(st, slot);
+	st->fill = 0;
+	smp_store_release(&st->head, st->head + 1);
+}
+
+/*
+ * Called from the tasklet for count packets that arrived between
+ * start and end, ahead of an XDP program like the PID statistics.
+ * Packets of the selected PIDs are copied into the ring, seven to a
+ * datagram; the socket is written from a work item. A datagram still
+ * partial after SAA716x_STREAMER_FLUSH_MS is flushed by the timer.
+ */
+void saa716x_streamer_feed(struct saa716x_streamer *st, const u8 *buf,
+			   int count, ktime_t start, ktime_t end)
+{
+	s64 span = ktime_to_ns(ktime_sub(end, start));
+	struct saa716x_streamer_slot *slot;
+	bool kick = false;
+	int i;
+
+	if (!st || !READ_ONCE(st->slot))
+		return;
+
+	spin_lock(&st->lock);
+	if (!st->slot)
+		goto out;
+
+	for (i = 0; i < count; i++, buf += 188) {
+		if (buf[0] != 0x47 || !test_bit(TS_PID(buf), st->pids))
+			continue;
+
+		if (st->head - smp_load_acquire(&st->tail) >=
+		    SAA716x_STREAMER_SLOTS) {
+			st->overflows++;
+			continue;
+		}
+
+		slot = &st->slot[st->head % SAA716x_STREAMER_SLOTS];
+		if (!st->fill) {
+			slot->time = ktime_add_ns(start,
+						  div_s64(span * i, count));
+			mod_timer(&st->flush, jiffies +
+				  msecs_to_jiffies(SAA716x_STREAMER_FLUSH_MS));
+		}
+		memcpy(slot->ts + st->fill * 188, buf, 188);
+		st->packets++;
+
+		if (++st->fill < SAA716x_STREAMER_TS)
+			continue;
+
+		saa716x_streamer_close(st, slot);
+		kick = true;
+	}
+
+	if (kick)
+		queue_work(system_unbound_wq, &st->work);
+out:
+	spin_unlock(&st->lock);
+}
+EXPORT_SYMBOL_GPL(saa716x_streamer_feed);
+
+/*
+ * A low rate PID selection may not fill a datagram for long. The rest
+ * of it is padded with null packets, which receivers drop, so every
+ * datagram keeps the size of a slot.
+ */
+static void saa716x_streamer_flush(struct timer_list *t)
+{
+	struct saa716x_streamer *st = from_timer(st, t, flush);
+	struct saa716x_streamer_slot *slot;
+	u8 *pkt;
+
+	spin_lock(&st->lock);
+	if (!st->slot || !st->fill)
+		goto out;
+
+	slot = &st->slot[st->head % SAA716x_STREAMER_SLOTS];
+	for (; st->fill < SAA716x_STREAMER_TS; st->fill++) {
+		pkt = slot->ts + st->fill * 188;
+		pkt[0] = 0x47;
+		pkt[1] = 0x1f;
+		pkt[2] = 0xff;
+		pkt[3] = 0x10;
+		memset(pkt + 4, 0xff, 188 - 4);
+	}
+	saa716x_streamer_close(st, slot);
+	st->flushes++;
+
+	queue_work(system_unbound_wq, &st->work);
+out:
+	spin_unlock(&st->lock);
+}
+
+static int saa716x_streamer_sockopt(struct socket *sock, int level,
+				    int optname, int val)
+{
+	return sock->ops->setsockopt(sock, level, optname,
+				     KERNEL_SOCKPTR(&val), sizeof(val));
+}
+
+/*
+ * UDP_SEGMENT needs checksum offload on the egress device, without it
+ * every send fails with -EIO. The socket drops it for good and the
+ * datagrams go one per send.
+ */
+static void saa716x_streamer_nogso(struct saa716x_streamer *st)
+{
+	struct saa716x_adapter *saa716x_adap = st->saa716x_adap;
+
+	st->gso = false;
+	saa716x_streamer_sockopt(st->sock, SOL_UDP, UDP_SEGMENT, 0);
+
+	pci_info(saa716x_adap->saa716x->pdev,
+		 "streamer%d: no UDP GSO to %pISc, sending datagrams one by one",
+		 saa716x_adap->count, &st->dest);
+}
+
+static void saa716x_streamer_sent(struct saa716x_streamer *st, u32 n,
+				  int ret)
+{
+	st->sends++;
+	if (ret < 0) {
+		st->errors++;
+	} else {
+		st->datagrams += n;
+		st->bytes += ret;
+	}
+}
+
+/*
+ * Sends what the tasklet has filled, up to SAA716x_STREAMER_BATCH
+ * datagrams per sendmsg. UDP_SEGMENT on the socket cuts a send into
+ * datagrams of one slot each, so a batch costs one pass through the
+ * stack instead of one per datagram. Without GSO every datagram is a
+ * send of its own.
+ */
+static void saa716x_streamer_work(struct work_struct *work)
+{
+	struct saa716x_streamer *st = container_of(work,
+						   struct saa716x_streamer,
+						   work);
+	struct saa716x_streamer_slot *slots = READ_ONCE(st->slot);
+	struct saa716x_streamer_slot *slot;
+	struct kvec vec[SAA716x_STREAMER_BATCH];
+	struct msghdr msg = { };
+	size_t len;
+	u32 head, n, i;
+	int ret;
+
+	if (!slots)
+		return;
+
+	len = SAA716x_STREAMER_LEN + (st->rtp ? SAA716x_STREAMER_RTP : 0);
+
+	while (READ_ONCE(st->slot) &&
+	       (head = smp_load_acquire(&st->head)) != st->tail) {
+		n = min_t(u32, head - st->tail, SAA716x_STREAMER_BATCH);
+		for (i = 0; i < n; i++) {
+			slot = &slots[(st->tail + i) % SAA716x_STREAMER_SLOTS];
+			vec[i].iov_base = st->rtp ? slot->rtp : slot->ts;
+			vec[i].iov_len = len;
+		}
+
+		if (st->gso) {
+			ret = kernel_sendmsg(st->sock, &msg, vec, n, n * len);
+			if (ret == -EIO || ret == -EINVAL)
+				saa716x_streamer_nogso(st);
+			else
+				saa716x_streamer_sent(st, n, ret);
+		}
+		if (!st->gso) {
+			for (i = 0; i < n; i++) {
+				ret = kernel_sendmsg(st->sock, &msg, &vec[i], 1,
+						     len);
+				saa716x_streamer_sent(st, 1, ret);
+			}
+		}
+		smp_store_release(&st->tail, st->tail + n);
+	}
+}
+
+static int saa716x_streamer_start(struct saa716x_streamer *st)
+{
+	struct saa716x_adapter *saa716x_adap = st->saa716x_adap;
+	struct saa716x_dev *saa716x = saa716x_adap->saa716x;
+	struct saa716x_streamer_slot *slots;
+	struct socket *sock;
+	int family = st->dest.ss_family;
+	int len, ret;
+
+	if (family != AF_INET && family != AF_INET6)
+		return -EDESTADDRREQ;
+
+	ret = sock_create_kern(&init_net, family, SOCK_DGRAM, IPPROTO_UDP,
+			       &sock);
+	if (ret < 0)
+		return ret;
+
+	/* a kernel without UDP GSO gets one datagram per send */
+	st->gso = !saa716x_streamer_sockopt(sock, SOL_UDP, UDP_SEGMENT,
+			SAA716x_STREAMER_LEN +
+			(st->rtp ? SAA716x_STREAMER_RTP : 0));
+
+	if (family == AF_INET)
+		ret = saa716x_streamer_sockopt(sock, SOL_IP,
+					       IP_MULTICAST_TTL, st->ttl);
+	else
+		ret = saa716x_streamer_sockopt(sock, SOL_IPV6,
+					       IPV6_MULTICAST_HOPS, st->ttl);
+	if (ret < 0)
+		goto err_sock;
+
+	/* a stuck link must not hold up disable forever */
+	sock->sk->sk_sndtimeo = HZ;
+
+	len = family == AF_INET ? sizeof(struct sockaddr_in) :
+				  sizeof(struct sockaddr_in6);
+	ret = kernel_connect(sock, (struct sockaddr *)&st->dest, len, 0);
+	if (ret < 0)
+		goto err_sock;
+
+	slots = vzalloc_node(SAA716x_STREAMER_SLOTS * sizeof(*slots),
+			     dev_to_node(&saa716x->pdev->dev));
+	if (!slots) {
+		ret = -ENOMEM;
+		goto err_sock;
+	}
+
+	ret = saa716x_stream_get(saa716x_adap);
+	if (ret < 0)
+		goto err_slots;
+
+	st->sock = sock;
+	st->head = 0;
+	st->tail = 0;
+	st->fill = 0;
+	st->seq = get_random_u32();
+	st->ssrc = get_random_u32();
+
+	spin_lock_bh(&st->lock);
+	st->slot = slots;
+	spin_unlock_bh(&st->lock);
+
+	return 0;
+
+err_slots:
+	vfree(slots);
+err_sock:
+	sock_release(sock);
+	return ret;
+}
+
+static void saa716x_streamer_stop(struct saa716x_streamer *st)
+{
+	struct saa716x_streamer_slot *slots;
+
+	saa716x_stream_put(st->saa716x_adap);
+
+	spin_lock_bh(&st->lock);
+	slots = st->slot;
+	st->slot = NULL;
+	spin_unlock_bh(&st->lock);
+
+	del_timer_sync(&st->flush);
+	cancel_work_sync(&st->work);
+	vfree(slots);
+
+	sock_release(st->sock);
+	st->sock = NULL;
+}
+
+/* "address port", IPv4 or IPv6, a multicast group or a unicast host */
+static ssize_t dest_show(struct kobject *kobj, struct kobj_attribute *attr,
+			 char *buf)
+{
+	struct saa716x_streamer *st = to_streamer(kobj);
+	struct sockaddr_storage *dest = &st->dest;
+	ssize_t ret;
+
+	mutex_lock(&st->mutex);
+	switch (dest->ss_family) {
+	case AF_INET:
+		ret = sysfs_emit(buf, "%pISc %u\n", dest,
+				 ntohs(((struct sockaddr_in *)dest)->sin_port));
+		break;
+	case AF_INET6:
+		ret = sysfs_emit(buf, "%pISc %u\n", dest,
+				 ntohs(((struct sockaddr_in6 *)dest)->sin6_port));
+		break;
+	default:
+		ret = sysfs_emit(buf, "\n");
+		break;
+	}
+	mutex_unlock(&st->mutex);
+
+	return ret;
+}
+
+static ssize_t dest_store(struct kobject *kobj, struct kobj_attribute *attr,
+			  const char *buf, size_t count)
+{
+	struct saa716x_streamer *st = to_streamer(kobj);
+	struct sockaddr_storage dest;
+	char addr[INET6_ADDRSTRLEN + 16], port[8];
+	int ret;
+
+	if (sscanf(buf, "%63s %7s", addr, port) != 2)
+		return -EINVAL;
+
+	ret = inet_pton_with_scope(&init_net, AF_UNSPEC, addr, port, &dest);
+	if (ret < 0)
+		return ret;
+
+	mutex_lock(&st->mutex);
+	if (st->sock)
+		ret = -EBUSY;
+	else
+		st->dest = dest;
+	mutex_unlock(&st->mutex);
+
+	return ret < 0 ? ret : count;
+}
+static struct kobj_attribute dest_attr = __ATTR_RW(dest);
+
+/* PID list as in "0,17,256-260", all PIDs by default */
+static ssize_t pids_show(struct kobject *kobj, struct kobj_attribute *attr,
+			 char *buf)
+{
+	struct saa716x_streamer *st = to_streamer(kobj);
+	ssize_t ret;
+
+	mutex_lock(&st->mutex);
+	ret = sysfs_emit(buf, "%*pbl\n", SAA716x_PIDS, st->pids);
+	mutex_unlock(&st->mutex);
+
+	return ret;
+}
+
+static ssize_t pids_store(struct kobject *kobj, struct kobj_attribute *attr,
+			  const char *buf, size_t count)
+{
+	struct saa716x_streamer *st = to_streamer(kobj);
+	unsigned long *pids;
+	int ret;
+
+	pids = bitmap_zalloc(SAA716x_PIDS, GFP_KERNEL);
+	if (!pids)
+		return -ENOMEM;
+
+	ret = bitmap_parselist(buf, pids, SAA716x_PIDS);
+	if (ret < 0)
+		goto out;
+
+	mutex_lock(&st->mutex);
+	if (st->sock)
+		ret = -EBUSY;
+	else
+		bitmap_copy(st->pids, pids, SAA716x_PIDS);
+	mutex_unlock(&st->mutex);
+out:
+	bitmap_free(pids);
+
+	return ret < 0 ? ret : count;
+}
+static struct kobj_attribute pids_attr = __ATTR_RW(pids);
+
+/* 12 byte RTP header in front of the packets, plain UDP if off */
+static ssize_t rtp_show(struct kobject *kobj, struct kobj_attribute *attr,
+			char *buf)
+{
+	return sysfs_emit(buf, "%d\n", READ_ONCE(to_streamer(kobj)->rtp));
+}
+
+static ssize_t rtp_store(struct kobject *kobj, struct kobj_attribute *attr,
+			 const char *buf, size_t count)
+{
+	struct saa716x_streamer *st = to_streamer(kobj);
+	bool rtp;
+	int ret;
+
+	ret = kstrtobool(buf, &rtp);
+	if (ret < 0)
+		return ret;
+
+	mutex_lock(&st->mutex);
+	if (st->sock)
+		ret = -EBUSY;
+	else
+		st->rtp = rtp;
+	mutex_unlock(&st->mutex);
+
+	return ret < 0 ? ret : count;
+}
+static struct kobj_attribute rtp_attr = __ATTR_RW(rtp);
+
+/* multicast TTL or hop limit */
+static ssize_t ttl_show(struct kobject *kobj, struct kobj_attribute *attr,
+			char *buf)
+{
+	return sysfs_emit(buf, "%u\n", READ_ONCE(to_streamer(kobj)->ttl));
+}
+
+static ssize_t ttl_store(struct kobject *kobj, struct kobj_attribute *attr,
+			 const char *buf, size_t count)
+{
+	struct saa716x_streamer *st = to_streamer(kobj);
+	u8 ttl;
+	int ret;
+
+	ret = kstrtou8(buf, 0, &ttl);
+	if (ret < 0)
+		return ret;
+
+	mutex_lock(&st->mutex);
+	if (st->sock)
+		ret = -EBUSY;
+	else
+		st->ttl = ttl;
+	mutex_unlock(&st->mutex);
+
+	return ret < 0 ? ret : count;
+}
+static struct kobj_attribute ttl_attr = __ATTR_RW(ttl);
+
+/* starts the TS DMA of the adapter like an open demux feed */
+static ssize_t enable_show(struct kobject *kobj, struct kobj_attribute *attr,
+			   char *buf)
+{
+	return sysfs_emit(buf, "%d\n", !!READ_ONCE(to_streamer(kobj)->sock));
+}
+
+static ssize_t enable_store(struct kobject *kobj, struct kobj_attribute *attr,
+			    const char *buf, size_t count)
+{
+	struct saa716x_streamer *st = to_streamer(kobj);
+	bool enable;
+	int ret;
+
+	ret = kstrtobool(buf, &enable);
+	if (ret < 0)
+		return ret;
+
+	mutex_lock(&st->mutex);
+	if (enable && !st->sock)
+		ret = saa716x_streamer_start(st);
+	else if (!enable && st->sock)
+		saa716x_streamer_stop(st);
+	mutex_unlock(&st->mutex);
+
+	return ret < 0 ? ret : count;
+}
+static struct kobj_attribute enable_attr = __ATTR_RW(enable);
+
+static ssize_t stats_show(struct kobject *kobj, struct kobj_attribute *attr,
+			  char *buf)
+{
+	struct saa716x_streamer *st = to_streamer(kobj);
+
+	return sysfs_emit(buf, "packets %llu overflows %u flushes %u datagrams %llu bytes %llu sends %u errors %u gso %d\n",
+			  st->packets, st->overflows, st->flushes,
+			  st->datagrams, st->bytes, st->sends, st->errors,
+			  READ_ONCE(st->gso));
+}
+static struct kobj_attribute stats_attr = __ATTR_RO(stats);
+
+static struct attribute *saa716x_streamer_attrs[] = {
+	&dest_attr.attr,
+	&pids_attr.attr,
+	&rtp_attr.attr,
+	&ttl_attr.attr,
+	&enable_attr.attr,
+	&stats_attr.attr,
+	NULL
+};
+ATTRIBUTE_GROUPS(saa716x_streamer);
+
+static void saa716x_streamer_release(struct kobject *kobj)
+{
+	struct saa716x_streamer *st = to_streamer(kobj);
+
+	mutex_destroy(&st->mutex);
+	kfree_rcu(st, rcu);
+}
+
+static struct kobj_type saa716x_streamer_ktype = {
+	.release	= saa716x_streamer_release,
+	.sysfs_ops	= &kobj_sysfs_ops,
+	.default_groups	= saa716x_streamer_groups,
+};
+
+int saa716x_streamer_init(struct saa716x_adapter *saa716x_adap)
+{
+	struct saa716x_dev *saa716x = saa716x_adap->saa716x;
+	struct device *dev = &saa716x->pdev->dev;
+	struct saa716x_streamer *st;
+	int ret;
+
+	BUILD_BUG_ON(offsetof(struct saa716x_streamer_slot, ts) !=
+		     offsetof(struct saa716x_streamer_slot, rtp) +
+		     SAA716x_STREAMER_RTP);
+
+	st = kzalloc_node(sizeof(*st), GFP_KERNEL, dev_to_node(dev));
+	if (!st)
+		return -ENOMEM;
+
+	st->saa716x_adap = saa716x_adap;
+	mutex_init(&st->mutex);
+	spin_lock_init(&st->lock);
+	INIT_WORK(&st->work, saa716x_streamer_work);
+	timer_setup(&st->flush, saa716x_streamer_flush, 0);
+	bitmap_fill(st->pids, SAA716x_PIDS);
+	st->ttl = 1;
+
+	ret = kobject_init_and_add(&st->kobj, &saa716x_streamer_ktype,
+				   &dev->kobj, "streamer%d",
+				   saa716x_adap->count);
+	if (ret < 0) {
+		kobject_put(&st->kobj);
+		return ret;
+	}
+
+	saa716x_adap->streamer = st;
+	kobject_uevent(&st->kobj, KOBJ_ADD);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(saa716x_streamer_init);
+
+void saa716x_streamer_exit(struct saa716x_adapter *saa716x_adap)
+{
+	struct saa716x_streamer *st = saa716x_adap->streamer;
+
+	/* not there if init failed */
+	if (!st)
+		return;
+
+	WRITE_ONCE(saa716x_adap->streamer, NULL);
+
+	/* no sysfs access after this, the streamer is ours */
+	kobject_del(&st->kobj);
+	if (st->sock)
+		saa716x_streamer_stop(st);
+	kobject_put(&st->kobj);
+}
+EXPORT_SYMBOL_GPL(saa716x_streamer_exit);
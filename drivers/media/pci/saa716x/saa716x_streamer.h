@@ -0,0 +1,118 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+
+#ifndef __SAA716x_STREAMER_H
+#define __SAA716x_STREAMER_H
+
+#include <linux/ktime.h>
+#include <linux/types.h>
+
+#ifdef CONFIG_VIDEO_SAA716X_STREAMER
+#include <linux/bitmap.h>
+#include <linux/kobject.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/socket.h>
+#include <linux/spinlock.h>
+#include <linux/timer.h>
+#include <linux/workqueue.h>
+
+#include "saa716x_pidstats.h"
+#endif
+
+/* TS packets per datagram, as IPTV receivers expect */
+#define SAA716x_STREAMER_TS	7
+#define SAA716x_STREAMER_RTP	12
+#define SAA716x_STREAMER_SLOTS	1024
+/* datagrams per send, a GSO send stays below 64k */
+#define SAA716x_STREAMER_BATCH	48
+/* a partial datagram goes out padded this long after its first packet */
+#define SAA716x_STREAMER_FLUSH_MS	20
+
+struct saa716x_adapter;
+struct socket;
+
+#ifdef CONFIG_VIDEO_SAA716X_STREAMER
+/*
+ * Datagram in the ring, rtp is sent in front of ts when enabled
+ * time: arrival of the first packet, for the RTP timestamp
+ */
+struct saa716x_streamer_slot {
+	ktime_t			time;
+	u8			rtp[SAA716x_STREAMER_RTP];
+	u8			ts[SAA716x_STREAMER_TS * 188];
+};
+
+/*
+ * TS over UDP or RTP from a kernel socket, configured in sysfs
+ * kobj: streamerN below the PCI device, frees the streamer on release,
+ *	after an RCU grace period as the tasklet may still look at it
+ * mutex: serializes configuration, enable and disable
+ * dest, pids, rtp, ttl: configuration, fixed while enabled
+ * lock: protects slot against the tasklet on enable/disable
+ * slot: ring of datagrams, NULL while disabled
+ * head: datagram the tasklet fills, fill: its packets so far
+ * tail: next datagram the work item sends
+ * flush: pads the datagram at head with null packets and sends it
+ * gso: sends carry SAA716x_STREAMER_BATCH datagrams with UDP_SEGMENT
+ * packets, overflows: packets taken and dropped on a full ring
+ * flushes: datagrams sent padded
+ * datagrams, bytes, sends, errors: what the work item sent
+ */
+struct saa716x_streamer {
+	struct kobject		kobj;
+	struct rcu_head		rcu;
+	struct saa716x_adapter	*saa716x_adap;
+
+	struct mutex		mutex;
+	struct sockaddr_storage	dest;
+	DECLARE_BITMAP(pids, SAA716x_PIDS);
+	bool			rtp;
+	u8			ttl;
+
+	spinlock_t		lock;
+	struct saa716x_streamer_slot *slot;
+	u32			head;
+	u32			tail;
+	u8			fill;
+	u16			seq;
+	u32			ssrc;
+
+	struct timer_list	flush;
+
+	struct socket		*sock;
+	struct work_struct	work;
+	bool			gso;
+
+	u64			packets;
+	u32			overflows;
+	u32			flushes;
+	u64			datagrams;
+	u64			bytes;
+	u32			sends;
+	u32			errors;
+};
+
+extern int saa716x_streamer_init(struct saa716x_adapter *saa716x_adap);
+extern void saa716x_streamer_exit(struct saa716x_adapter *saa716x_adap);
+extern void saa716x_streamer_feed(struct saa716x_streamer *st, const u8 *buf,
+				  int count, ktime_t start, ktime_t end);
+#else
+struct saa716x_streamer;
+
+static inline int saa716x_streamer_init(struct saa716x_adapter *saa716x_adap)
+{
+	return 0;
+}
+
+static inline void saa716x_streamer_exit(struct saa716x_adapter *saa716x_adap)
+{
+}
+
+static inline void saa716x_streamer_feed(struct saa716x_streamer *st,
+					 const u8 *buf, int count,
+					 ktime_t start, ktime_t end)
+{
+}
+#endif
+
+#endif /* __SAA716x_STREAMER_H */
@@ -0,0 +1,782 @@
+// SPDX-License-Identifier: GPL-2.0+
+
+#include <linux/interrupt.h>
+#include <linux/module.h>
+#include <linux/pm_runtime.h>
+#include <linux/slab.h>
+
+#include <media/v4l2-common.h>
+#include <media/v4l2-ioctl.h>
+#include <media/videobuf2-dma-sg.h>
+
+#include "saa716x_video.h"
+#include "saa716x_priv.h"
+
+#define SAA716x_VIDEO_MAX_WIDTH		1920
+#define SAA716x_VIDEO_MAX_HEIGHT	1080
+
+static struct saa716x_video_buffer *to_saa716x_buf(struct vb2_buffer *vb)
+{
+	return container_of(to_vb2_v4l2_buffer(vb),
+			    struct saa716x_video_buffer, vb);
+}
+
+/* packed YUYV, the only format the PSU is set up for */
+static void saa716x_video_try(struct v4l2_pix_format *pix)
+{
+	bool interlaced, alternate;
+
+	if (pix->field != V4L2_FIELD_INTERLACED &&
+	    pix->field != V4L2_FIELD_ALTERNATE)
+		pix->field = V4L2_FIELD_NONE;
+	interlaced = pix->field == V4L2_FIELD_INTERLACED;
+	alternate = pix->field == V4L2_FIELD_ALTERNATE;
+
+	/* with alternate fields a buffer holds one field, height is its lines */
+	v4l_bound_align_image(&pix->width, 48, SAA716x_VIDEO_MAX_WIDTH, 1,
+			      &pix->height, alternate ? 16 : 32,
+			      SAA716x_VIDEO_MAX_HEIGHT >> alternate,
+			      interlaced, 0);
+
+	pix->pixelformat = V4L2_PIX_FMT_YUYV;
+	pix->bytesperline = pix->width * 2;
+	pix->sizeimage = pix->bytesperline * pix->height;
+	pix->colorspace = pix->width > 720 ? V4L2_COLORSPACE_REC709 :
+					     V4L2_COLORSPACE_SMPTE170M;
+	pix->ycbcr_enc = V4L2_YCBCR_ENC_DEFAULT;
+	pix->quantization = V4L2_QUANTIZATION_DEFAULT;
+	pix->xfer_func = V4L2_XFER_FUNC_DEFAULT;
+}
+
+/* set the input and the video path up from the capture format */
+static void saa716x_video_params(struct saa716x_video *video)
+{
+	struct vip_stream_params *params = &video->params;
+	struct v4l2_pix_format *pix = &video->capture.fmt;
+
+	params->bits = 16;
+	params->samples = pix->width;
+	params->lines = pix->height;
+	params->pitch = pix->bytesperline;
+	params->offset_x = 0;
+	params->offset_y = 0;
+	params->stream_flags = 0;
+
+	if (pix->field == V4L2_FIELD_INTERLACED)
+		params->stream_flags |= VIP_INTERLACED | VIP_ODD_FIELD |
+					VIP_EVEN_FIELD;
+	if (pix->field == V4L2_FIELD_ALTERNATE)
+		params->stream_flags |= VIP_INTERLACED | VIP_ODD_FIELD |
+					VIP_EVEN_FIELD | VIP_FIELD_BUFFERS;
+	if (pix->width > 720)
+		params->stream_flags |= VIP_HD;
+}
+
+/*
+ * The decimated preview has no format of its own. It is the capture
+ * format with one field per frame, there is no scaler set up.
+ */
+static void saa716x_video_decimated_fmt(struct saa716x_video *video)
+{
+	struct v4l2_pix_format *pix = &video->decimated.fmt;
+
+	saa716x_video_params(video);
+
+	*pix = video->capture.fmt;
+	pix->pixelformat = V4L2_PIX_FMT_YUYV;
+	pix->height = saa716x_vip_aux_lines(&video->params);
+	pix->field = pix->field == V4L2_FIELD_NONE ? V4L2_FIELD_NONE :
+						     V4L2_FIELD_TOP;
+	pix->bytesperline = pix->width * 2;
+	pix->sizeimage = pix->bytesperline * pix->height;
+}
+
+/* give the slot the next queued buffer, or the scratch buffer */
+static void saa716x_video_refill(struct saa716x_video_stream *stream, int slot)
+{
+	struct saa716x_video *video = stream->video;
+	struct saa716x_video_buffer *buf;
+
+	buf = list_first_entry_or_null(&stream->queued,
+				       struct saa716x_video_buffer, list);
+	if (buf)
+		list_del(&buf->list);
+
+	stream->slot[slot] = buf;
+	if (stream->aux)
+		saa716x_vip_aux_set_slot(video->saa716x, video->port, slot,
+					 buf ? buf->ptab[0].mem_ptab_phys : 0);
+	else
+		saa716x_vip_set_slot(video->saa716x, video->port, slot,
+				     buf ? buf->ptab[0].mem_ptab_phys : 0,
+				     buf ? buf->ptab[1].mem_ptab_phys : 0);
+}
+
+/*
+ * Every slot the BAM moved past holds a complete frame, it is handed
+ * back and refilled before the BAM comes around. The TAGACK times of
+ * several slots done in one go are spread between the last two.
+ *
+ * With a buffer per field, fid is the field the VIP is writing now:
+ * the last slot done holds the other one and the fields alternate
+ * going back from there. It is -1 for whole frames.
+ */
+static void saa716x_video_complete(struct saa716x_video_stream *stream,
+				   u8 *read_index, int write_index,
+				   ktime_t tag_time, int fid)
+{
+	struct saa716x_video_buffer *buf;
+	int count, slot, i;
+	ktime_t step;
+	bool bottom;
+
+	spin_lock(&stream->slock);
+	count = (write_index - *read_index + stream->slots) % stream->slots;
+	if (!count) {
+		spin_unlock(&stream->slock);
+		return;
+	}
+
+	if (stream->last_time)
+		step = ktime_divns(ktime_sub(tag_time, stream->last_time),
+				   count);
+	else
+		step = 0;
+
+	for (i = 0; i < count; i++) {
+		slot = *read_index;
+		buf = stream->slot[slot];
+		if (buf) {
+			buf->vb.vb2_buf.timestamp =
+				ktime_sub(tag_time, (count - 1 - i) * step);
+			buf->vb.sequence = stream->sequence;
+			if (fid < 0) {
+				buf->vb.field = stream->fmt.field;
+			} else {
+				/* both fields of a frame share the number */
+				buf->vb.sequence /= 2;
+				bottom = !fid ^ ((count - 1 - i) & 1);
+				buf->vb.field = bottom ? V4L2_FIELD_BOTTOM :
+							 V4L2_FIELD_TOP;
+			}
+			vb2_set_plane_payload(&buf->vb.vb2_buf, 0,
+					      stream->fmt.sizeimage);
+			vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_DONE);
+		} else {
+			stream->dropped++;
+		}
+		stream->sequence++;
+
+		saa716x_video_refill(stream, slot);
+		*read_index = (slot + 1) % stream->slots;
+	}
+	stream->last_time = tag_time;
+	spin_unlock(&stream->slock);
+}
+
+/* TAGACK bottom half of the video path */
+static void saa716x_video_worker(unsigned long data)
+{
+	struct saa716x_vip_stream_port *vip =
+				(struct saa716x_vip_stream_port *)data;
+	struct saa716x_dev *saa716x = vip->saa716x;
+	struct saa716x_video *video = saa716x->video[vip->port];
+	int fid = -1;
+
+	if (video->capture.fmt.field == V4L2_FIELD_ALTERNATE)
+		fid = saa716x_vip_field_id(saa716x, vip->port);
+
+	saa716x_video_complete(&video->capture, &vip->read_index,
+			       saa716x_vip_get_write_index(saa716x, vip->port) /
+			       vip->fields,
+			       READ_ONCE(vip->tag_time), fid);
+}
+
+/* TAGACK bottom half of the AUX path */
+static void saa716x_video_aux_worker(unsigned long data)
+{
+	struct saa716x_vip_stream_port *vip =
+				(struct saa716x_vip_stream_port *)data;
+	struct saa716x_dev *saa716x = vip->saa716x;
+	struct saa716x_video *video = saa716x->video[vip->port];
+
+	saa716x_video_complete(&video->decimated, &vip->aux_read_index,
+			       saa716x_vip_aux_write_index(saa716x, vip->port),
+			       READ_ONCE(vip->aux_tag_time), -1);
+}
+
+static void saa716x_video_return_buffers(struct saa716x_video_stream *stream,
+					 enum vb2_buffer_state state)
+{
+	struct saa716x_video_buffer *buf, *tmp;
+	LIST_HEAD(done);
+	int i;
+
+	spin_lock_bh(&stream->slock);
+	list_splice_init(&stream->queued, &done);
+	for (i = 0; i < VIP_BUFFERS; i++) {
+		buf = stream->slot[i];
+		if (!buf)
+			continue;
+		list_add_tail(&buf->list, &done);
+		/* nothing is queued anymore, the slot gets the scratch buffer */
+		saa716x_video_refill(stream, i);
+	}
+	list_for_each_entry_safe(buf, tmp, &done, list) {
+		list_del(&buf->list);
+		vb2_buffer_done(&buf->vb.vb2_buf, state);
+	}
+	spin_unlock_bh(&stream->slock);
+}
+
+static int saa716x_video_queue_setup(struct vb2_queue *q,
+				     unsigned int *nbuffers,
+				     unsigned int *nplanes,
+				     unsigned int sizes[],
+				     struct device *alloc_devs[])
+{
+	struct saa716x_video_stream *stream = vb2_get_drv_priv(q);
+
+	if (*nplanes)
+		return sizes[0] < stream->fmt.sizeimage ? -EINVAL : 0;
+
+	*nplanes = 1;
+	sizes[0] = stream->fmt.sizeimage;
+
+	return 0;
+}
+
+static int saa716x_video_buf_init(struct vb2_buffer *vb)
+{
+	struct saa716x_video_stream *stream = vb2_get_drv_priv(vb->vb2_queue);
+	struct saa716x_dev *saa716x = stream->video->saa716x;
+	struct saa716x_video_buffer *buf = to_saa716x_buf(vb);
+	int ret;
+
+	ret = saa716x_dmabuf_ptab_alloc(saa716x, &buf->ptab[0]);
+	if (ret < 0)
+		return ret;
+
+	ret = saa716x_dmabuf_ptab_alloc(saa716x, &buf->ptab[1]);
+	if (ret < 0)
+		saa716x_dmabuf_ptab_free(&buf->ptab[0]);
+
+	return ret;
+}
+
+static int saa716x_video_buf_prepare(struct vb2_buffer *vb)
+{
+	struct saa716x_video_stream *stream = vb2_get_drv_priv(vb->vb2_queue);
+	struct saa716x_video_buffer *buf = to_saa716x_buf(vb);
+	struct sg_table *sgt = vb2_dma_sg_plane_desc(vb, 0);
+
+	if (vb2_plane_size(vb, 0) < stream->fmt.sizeimage)
+		return -EINVAL;
+
+	/* page tables hold whole pages, the image has to start on one */
+	if (sgt->sgl->offset)
+		return -EINVAL;
+
+	vb2_set_plane_payload(vb, 0, stream->fmt.sizeimage);
+
+	/* the second channel takes over after 512 pages */
+	saa716x_dmabuf_ptab_fill(&buf->ptab[0], sgt->sgl, sgt->nents, 0);
+	saa716x_dmabuf_ptab_fill(&buf->ptab[1], sgt->sgl, sgt->nents,
+				 SAA716x_PAGE_SIZE / 8);
+
+	return 0;
+}
+
+static void saa716x_video_buf_cleanup(struct vb2_buffer *vb)
+{
+	struct saa716x_video_buffer *buf = to_saa716x_buf(vb);
+
+	saa716x_dmabuf_ptab_free(&buf->ptab[0]);
+	saa716x_dmabuf_ptab_free(&buf->ptab[1]);
+}
+
+static void saa716x_video_buf_queue(struct vb2_buffer *vb)
+{
+	struct saa716x_video_stream *stream = vb2_get_drv_priv(vb->vb2_queue);
+	struct saa716x_video_buffer *buf = to_saa716x_buf(vb);
+
+	spin_lock_bh(&stream->slock);
+	list_add_tail(&buf->list, &stream->queued);
+	spin_unlock_bh(&stream->slock);
+}
+
+/* fill the slots from the queue and start the path of the node */
+static int saa716x_video_run(struct saa716x_video_stream *stream)
+{
+	struct saa716x_video *video = stream->video;
+	struct saa716x_dev *saa716x = video->saa716x;
+	struct saa716x_vip_stream_port *vip = &saa716x->vip[video->port];
+	int i;
+
+	spin_lock_bh(&stream->slock);
+	for (i = 0; i < stream->slots; i++)
+		saa716x_video_refill(stream, i);
+	if (stream->aux)
+		vip->aux_read_index = 0;
+	else
+		vip->read_index = 0;
+	spin_unlock_bh(&stream->slock);
+
+	if (stream->aux)
+		return saa716x_vip_aux_start(saa716x, video->port,
+					     &video->params);
+
+	return saa716x_vip_start(saa716x, video->port, 0, &video->params);
+}
+
+static int saa716x_video_start_streaming(struct vb2_queue *q,
+					 unsigned int count)
+{
+	struct saa716x_video_stream *stream = vb2_get_drv_priv(q);
+	struct saa716x_video *video = stream->video;
+	struct device *dev = &video->saa716x->pdev->dev;
+	int ret;
+
+	ret = pm_runtime_get_sync(dev);
+	if (ret < 0 && ret != -EACCES) {
+		pm_runtime_put_noidle(dev);
+		saa716x_video_return_buffers(stream, VB2_BUF_STATE_QUEUED);
+		return ret;
+	}
+
+	saa716x_video_params(video);
+	stream->slots = stream->aux ? VIP_BUFFERS :
+				      saa716x_vip_slots(&video->params);
+	stream->sequence = 0;
+	stream->dropped = 0;
+	stream->last_time = 0;
+
+	ret = saa716x_video_run(stream);
+	if (ret < 0) {
+		saa716x_video_return_buffers(stream, VB2_BUF_STATE_QUEUED);
+		pm_runtime_put_autosuspend(dev);
+		return ret;
+	}
+
+	return 0;
+}
+
+static void saa716x_video_stop_streaming(struct vb2_queue *q)
+{
+	struct saa716x_video_stream *stream = vb2_get_drv_priv(q);
+	struct saa716x_video *video = stream->video;
+	struct saa716x_dev *saa716x = video->saa716x;
+	struct saa716x_vip_stream_port *vip = &saa716x->vip[video->port];
+	struct tasklet_struct *tasklet;
+	struct device *dev = &saa716x->pdev->dev;
+
+	if (stream->aux) {
+		saa716x_vip_aux_stop(saa716x, video->port);
+		tasklet = &vip->aux_tasklet;
+	} else {
+		saa716x_vip_stop(saa716x, video->port);
+		tasklet = &vip->tasklet;
+	}
+
+	tasklet_disable(tasklet);
+	saa716x_video_return_buffers(stream, VB2_BUF_STATE_ERROR);
+	tasklet_enable(tasklet);
+
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
+}
+
+static const struct vb2_ops saa716x_video_qops = {
+	.queue_setup		= saa716x_video_queue_setup,
+	.buf_init		= saa716x_video_buf_init,
+	.buf_prepare		= saa716x_video_buf_prepare,
+	.buf_cleanup		= saa716x_video_buf_cleanup,
+	.buf_queue		= saa716x_video_buf_queue,
+	.start_streaming	= saa716x_video_start_streaming,
+	.stop_streaming		= saa716x_video_stop_streaming,
+	.wait_prepare		= vb2_ops_wait_prepare,
+	.wait_finish		= vb2_ops_wait_finish,
+};
+
+static int saa716x_video_querycap(struct file *file, void *priv,
+				  struct v4l2_capability *cap)
+{
+	struct saa716x_video_stream *stream = video_drvdata(file);
+	struct saa716x_video *video = stream->video;
+
+	strscpy(cap->driver, "saa716x", sizeof(cap->driver));
+	strscpy(cap->card, stream->vdev.name, sizeof(cap->card));
+	snprintf(cap->bus_info, sizeof(cap->bus_info), "PCI:%s",
+		 pci_name(video->saa716x->pdev));
+
+	return 0;
+}
+
+static int saa716x_video_enum_fmt(struct file *file, void *priv,
+				  struct v4l2_fmtdesc *f)
+{
+	if (f->index)
+		return -EINVAL;
+
+	f->pixelformat = V4L2_PIX_FMT_YUYV;
+	return 0;
+}
+
+static int saa716x_video_g_fmt(struct file *file, void *priv,
+			       struct v4l2_format *f)
+{
+	struct saa716x_video_stream *stream = video_drvdata(file);
+
+	f->fmt.pix = stream->fmt;
+	return 0;
+}
+
+static int saa716x_video_try_fmt(struct file *file, void *priv,
+				 struct v4l2_format *f)
+{
+	struct saa716x_video_stream *stream = video_drvdata(file);
+
+	if (stream->aux)
+		f->fmt.pix = stream->fmt;
+	else
+		saa716x_video_try(&f->fmt.pix);
+
+	return 0;
+}
+
+static int saa716x_video_s_fmt(struct file *file, void *priv,
+			       struct v4l2_format *f)
+{
+	struct saa716x_video_stream *stream = video_drvdata(file);
+	struct saa716x_video *video = stream->video;
+
+	if (stream->aux) {
+		f->fmt.pix = stream->fmt;
+		return 0;
+	}
+
+	/* the decimated preview is sized from the capture format */
+	if (vb2_is_busy(&video->capture.queue) ||
+	    vb2_is_busy(&video->decimated.queue))
+		return -EBUSY;
+
+	saa716x_video_try(&f->fmt.pix);
+	video->capture.fmt = f->fmt.pix;
+	saa716x_video_decimated_fmt(video);
+
+	return 0;
+}
+
+static int saa716x_video_enum_input(struct file *file, void *priv,
+				    struct v4l2_input *i)
+{
+	struct saa716x_video_stream *stream = video_drvdata(file);
+
+	if (i->index)
+		return -EINVAL;
+
+	i->type = V4L2_INPUT_TYPE_CAMERA;
+	snprintf(i->name, sizeof(i->name), "VIP%u", stream->video->port);
+
+	return 0;
+}
+
+static int saa716x_video_g_input(struct file *file, void *priv,
+				 unsigned int *i)
+{
+	*i = 0;
+	return 0;
+}
+
+static int saa716x_video_s_input(struct file *file, void *priv,
+				 unsigned int i)
+{
+	return i ? -EINVAL : 0;
+}
+
+static int saa716x_video_log_status(struct file *file, void *priv)
+{
+	struct saa716x_video_stream *stream = video_drvdata(file);
+
+	v4l2_info(&stream->video->v4l2_dev, "%s: frames %u, dropped %u\n",
+		  stream->vdev.name, stream->sequence, stream->dropped);
+
+	return 0;
+}
+
+static const struct v4l2_ioctl_ops saa716x_video_ioctl_ops = {
+	.vidioc_querycap		= saa716x_video_querycap,
+	.vidioc_enum_fmt_vid_cap	= saa716x_video_enum_fmt,
+	.vidioc_g_fmt_vid_cap		= saa716x_video_g_fmt,
+	.vidioc_try_fmt_vid_cap		= saa716x_video_try_fmt,
+	.vidioc_s_fmt_vid_cap		= saa716x_video_s_fmt,
+	.vidioc_enum_input		= saa716x_video_enum_input,
+	.vidioc_g_input			= saa716x_video_g_input,
+	.vidioc_s_input			= saa716x_video_s_input,
+	.vidioc_log_status		= saa716x_video_log_status,
+
+	.vidioc_reqbufs			= vb2_ioctl_reqbufs,
+	.vidioc_create_bufs		= vb2_ioctl_create_bufs,
+	.vidioc_prepare_buf		= vb2_ioctl_prepare_buf,
+	.vidioc_querybuf		= vb2_ioctl_querybuf,
+	.vidioc_qbuf			= vb2_ioctl_qbuf,
+	.vidioc_dqbuf			= vb2_ioctl_dqbuf,
+	.vidioc_expbuf			= vb2_ioctl_expbuf,
+	.vidioc_streamon		= vb2_ioctl_streamon,
+	.vidioc_streamoff		= vb2_ioctl_streamoff,
+};
+
+static const struct v4l2_file_operations saa716x_video_fops = {
+	.owner		= THIS_MODULE,
+	.open		= v4l2_fh_open,
+	.release	= vb2_fop_release,
+	.poll		= vb2_fop_poll,
+	.mmap		= vb2_fop_mmap,
+	.unlocked_ioctl	= video_ioctl2,
+};
+
+/* last reference to the v4l2_device is gone, open files included */
+static void saa716x_video_release(struct v4l2_device *v4l2_dev)
+{
+	struct saa716x_video *video = container_of(v4l2_dev,
+					struct saa716x_video, v4l2_dev);
+
+	kfree(video);
+}
+
+static int saa716x_video_stream_init(struct saa716x_video *video,
+				     struct saa716x_video_stream *stream,
+				     bool aux)
+{
+	struct saa716x_dev *saa716x = video->saa716x;
+	struct video_device *vdev = &stream->vdev;
+	struct vb2_queue *q = &stream->queue;
+	int ret;
+
+	stream->video = video;
+	stream->aux = aux;
+	spin_lock_init(&stream->slock);
+	INIT_LIST_HEAD(&stream->queued);
+
+	q->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	q->io_modes = VB2_MMAP | VB2_USERPTR | VB2_DMABUF;
+	q->drv_priv = stream;
+	q->buf_struct_size = sizeof(struct saa716x_video_buffer);
+	q->ops = &saa716x_video_qops;
+	q->mem_ops = &vb2_dma_sg_memops;
+	q->timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC |
+			     V4L2_BUF_FLAG_TSTAMP_SRC_EOF;
+	q->min_buffers_needed = 2;
+	q->lock = &video->lock;
+	q->dev = &saa716x->pdev->dev;
+	ret = vb2_queue_init(q);
+	if (ret < 0)
+		return ret;
+
+	snprintf(vdev->name, sizeof(vdev->name), "SAA716x VIP%d%s",
+		 video->port, aux ? " decimated preview" : "");
+	vdev->fops = &saa716x_video_fops;
+	vdev->ioctl_ops = &saa716x_video_ioctl_ops;
+	vdev->release = video_device_release_empty;
+	vdev->v4l2_dev = &video->v4l2_dev;
+	vdev->queue = q;
+	vdev->lock = &video->lock;
+	vdev->device_caps = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+	video_set_drvdata(vdev, stream);
+
+	return 0;
+}
+
+static int saa716x_video_register(struct saa716x_dev *saa716x, int port)
+{
+	struct saa716x_video *video;
+	int bit, aux_bit, ret;
+
+	video = kzalloc_node(sizeof(*video), GFP_KERNEL,
+			     dev_to_node(&saa716x->pdev->dev));
+	if (!video)
+		return -ENOMEM;
+
+	video->saa716x = saa716x;
+	video->port = port;
+	mutex_init(&video->lock);
+
+	video->capture.fmt.width = SAA716x_VIDEO_MAX_WIDTH;
+	video->capture.fmt.height = SAA716x_VIDEO_MAX_HEIGHT;
+	video->capture.fmt.field = V4L2_FIELD_INTERLACED;
+	saa716x_video_try(&video->capture.fmt);
+	saa716x_video_decimated_fmt(video);
+
+	ret = saa716x_vip_init(saa716x, port, saa716x_video_worker,
+			       saa716x_video_aux_worker);
+	if (ret < 0) {
+		kfree(video);
+		return ret;
+	}
+
+	snprintf(video->v4l2_dev.name, sizeof(video->v4l2_dev.name),
+		 "saa716x-%s-vip%d", pci_name(saa716x->pdev), port);
+	video->v4l2_dev.release = saa716x_video_release;
+	ret = v4l2_device_register(&saa716x->pdev->dev, &video->v4l2_dev);
+	if (ret < 0)
+		goto err0;
+
+	ret = saa716x_video_stream_init(video, &video->capture, false);
+	if (ret < 0)
+		goto err1;
+	ret = saa716x_video_stream_init(video, &video->decimated, true);
+	if (ret < 0)
+		goto err1;
+
+	saa716x->video[port] = video;
+	bit = saa716x_vip_msi_bit(port);
+	saa716x->dispatch[bit].tasklet = &saa716x->vip[port].tasklet;
+	saa716x->dispatch[bit].tag_time = &saa716x->vip[port].tag_time;
+	aux_bit = saa716x_vip_aux_msi_bit(port);
+	saa716x->dispatch[aux_bit].tasklet = &saa716x->vip[port].aux_tasklet;
+	saa716x->dispatch[aux_bit].tag_time = &saa716x->vip[port].aux_tag_time;
+	saa716x->dispatch_l |= BIT(bit) | BIT(aux_bit);
+
+	ret = video_register_device(&video->capture.vdev, VFL_TYPE_VIDEO, -1);
+	if (ret < 0)
+		goto err2;
+	ret = video_register_device(&video->decimated.vdev, VFL_TYPE_VIDEO, -1);
+	if (ret < 0)
+		goto err3;
+
+	return 0;
+
+err3:
+	video_unregister_device(&video->capture.vdev);
+err2:
+	saa716x->dispatch_l &= ~(BIT(bit) | BIT(aux_bit));
+	saa716x->video[port] = NULL;
+err1:
+	v4l2_device_unregister(&video->v4l2_dev);
+	saa716x_vip_exit(saa716x, port);
+	v4l2_device_put(&video->v4l2_dev);
+	return ret;
+err0:
+	saa716x_vip_exit(saa716x, port);
+	kfree(video);
+	return ret;
+}
+
+/* a capture and a decimated preview device for every VIP port in ports */
+int saa716x_video_init(struct saa716x_dev *saa716x, unsigned long ports)
+{
+	int port, ret;
+
+	for_each_set_bit(port, &ports, ARRAY_SIZE(saa716x->vip)) {
+		ret = saa716x_video_register(saa716x, port);
+		if (ret < 0) {
+			pci_err(saa716x->pdev, "VIP%d capture init failed, err=%d",
+				port, ret);
+			saa716x_video_exit(saa716x);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(saa716x_video_init);
+
+void saa716x_video_exit(struct saa716x_dev *saa716x)
+{
+	struct saa716x_video *video;
+	int port;
+
+	for (port = 0; port < ARRAY_SIZE(saa716x->vip); port++) {
+		video = saa716x->video[port];
+		if (!video)
+			continue;
+
+		/* stops streaming, the VIP is idle after this */
+		vb2_video_unregister_device(&video->decimated.vdev);
+		vb2_video_unregister_device(&video->capture.vdev);
+		saa716x->dispatch_l &= ~(BIT(saa716x_vip_msi_bit(port)) |
+					 BIT(saa716x_vip_aux_msi_bit(port)));
+		saa716x_vip_exit(saa716x, port);
+		saa716x->video[port] = NULL;
+
+		v4l2_device_unregister(&video->v4l2_dev);
+		v4l2_device_put(&video->v4l2_dev);
+	}
+}
+EXPORT_SYMBOL_GPL(saa716x_video_exit);
+
+/*
+ * Stop a streaming node for a power down. Its buffers stay with the
+ * driver, those in the slots go back to the front of the queue.
+ */
+static void saa716x_video_halt(struct saa716x_video_stream *stream)
+{
+	struct saa716x_video *video = stream->video;
+	struct saa716x_dev *saa716x = video->saa716x;
+	struct saa716x_vip_stream_port *vip = &saa716x->vip[video->port];
+	struct saa716x_video_buffer *buf;
+	int read_index, i, slot;
+
+	if (stream->aux)
+		saa716x_vip_aux_stop(saa716x, video->port);
+	else
+		saa716x_vip_stop(saa716x, video->port);
+	synchronize_irq(pci_irq_vector(saa716x->pdev, 0));
+	tasklet_kill(stream->aux ? &vip->aux_tasklet : &vip->tasklet);
+
+	spin_lock_bh(&stream->slock);
+	read_index = stream->aux ? vip->aux_read_index : vip->read_index;
+	for (i = stream->slots; i > 0; i--) {
+		slot = (read_index + i - 1) % stream->slots;
+		buf = stream->slot[slot];
+		stream->slot[slot] = NULL;
+		if (buf)
+			list_add(&buf->list, &stream->queued);
+	}
+	spin_unlock_bh(&stream->slock);
+}
+
+void saa716x_video_suspend(struct saa716x_dev *saa716x)
+{
+	struct saa716x_video *video;
+	int port;
+
+	for (port = 0; port < ARRAY_SIZE(saa716x->vip); port++) {
+		video = saa716x->video[port];
+		if (!video)
+			continue;
+
+		mutex_lock(&video->lock);
+		if (vb2_is_streaming(&video->decimated.queue))
+			saa716x_video_halt(&video->decimated);
+		if (vb2_is_streaming(&video->capture.queue))
+			saa716x_video_halt(&video->capture);
+		mutex_unlock(&video->lock);
+	}
+}
+EXPORT_SYMBOL_GPL(saa716x_video_suspend);
+
+void saa716x_video_resume(struct saa716x_dev *saa716x)
+{
+	struct saa716x_video *video;
+	int port;
+
+	for (port = 0; port < ARRAY_SIZE(saa716x->vip); port++) {
+		video = saa716x->video[port];
+		if (!video)
+			continue;
+
+		mutex_lock(&video->lock);
+		/* the video path sets the input up for the AUX path */
+		if (vb2_is_streaming(&video->capture.queue) &&
+		    saa716x_video_run(&video->capture) < 0)
+			pci_err(saa716x->pdev, "VIP%d capture restart failed",
+				port);
+		if (vb2_is_streaming(&video->decimated.queue) &&
+		    saa716x_video_run(&video->decimated) < 0)
+			pci_err(saa716x->pdev, "VIP%d decimated preview restart failed",
+				port);
+		mutex_unlock(&video->lock);
+	}
+}
+EXPORT_SYMBOL_GPL(saa716x_video_resume);
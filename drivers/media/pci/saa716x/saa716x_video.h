@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+
+#ifndef __SAA716x_VIDEO_H
+#define __SAA716x_VIDEO_H
+
+struct saa716x_dev;
+
+#ifdef CONFIG_VIDEO_SAA716X_V4L2
+
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+
+#include <media/v4l2-dev.h>
+#include <media/v4l2-device.h>
+#include <media/videobuf2-v4l2.h>
+
+#include "saa716x_dma.h"
+#include "saa716x_vip.h"
+
+/*
+ * Capture buffer
+ * ptab: page tables of the buffer for the two DMA channels of the port
+ */
+struct saa716x_video_buffer {
+	struct vb2_v4l2_buffer	vb;
+	struct list_head	list;
+	struct saa716x_dmabuf	ptab[2];
+};
+
+/*
+ * Video node of a VIP port, the capture or the decimated preview one
+ * slock: queued list and slots, shared with the tasklet
+ * slot: buffer per BAM frame slot, NULL where the scratch buffer is set
+ * aux: fed by the AUX path instead of the video path
+ * sequence: frames seen, including the dropped ones
+ * dropped: frames that went to the scratch buffer
+ * last_time: TAGACK time of the last slot done
+ */
+struct saa716x_video_stream {
+	struct video_device	vdev;
+	struct vb2_queue	queue;
+
+	spinlock_t		slock;
+	struct list_head	queued;
+	struct saa716x_video_buffer *slot[VIP_BUFFERS];
+	int			slots;
+
+	bool			aux;
+	struct v4l2_pix_format	fmt;
+	u32			sequence;
+	u32			dropped;
+	ktime_t			last_time;
+
+	struct saa716x_video	*video;
+};
+
+/*
+ * V4L2 capture on a VIP port
+ * lock: serializes the ioctls and the vb2 queues of both nodes
+ * capture: full frames from the video path
+ * decimated: one field per frame from the AUX path, not scaled
+ * params: input and video path setup, derived from the capture format
+ */
+struct saa716x_video {
+	struct v4l2_device	v4l2_dev;
+	struct mutex		lock;
+
+	struct saa716x_video_stream capture;
+	struct saa716x_video_stream decimated;
+	struct vip_stream_params params;
+
+	u8			port;
+	struct saa716x_dev	*saa716x;
+};
+
+extern int saa716x_video_init(struct saa716x_dev *saa716x,
+			      unsigned long ports);
+extern void saa716x_video_exit(struct saa716x_dev *saa716x);
+extern void saa716x_video_suspend(struct saa716x_dev *saa716x);
+extern void saa716x_video_resume(struct saa716x_dev *saa716x);
+
+#else
+
+static inline int saa716x_video_init(struct saa716x_dev *saa716x,
+				     unsigned long ports)
+{
+	return 0;
+}
+
+static inline void saa716x_video_exit(struct saa716x_dev *saa716x)
+{
+}
+
+static inline void saa716x_video_suspend(struct saa716x_dev *saa716x)
+{
+}
+
+static inline void saa716x_video_resume(struct saa716x_dev *saa716x)
+{
+}
+
+#endif
+
+#endif /* __SAA716x_VIDEO_H */
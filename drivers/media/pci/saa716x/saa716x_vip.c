@@ -1,5 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0+
 
+#include <linux/delay.h>
+#include <linux/interrupt.h>
 #include <linux/kernel.h>
 
 #include "saa716x_mod.h"
@@ -46,106 +48,197 @@ void saa716x_vip_disable(struct saa716x_dev *saa716x)
 }
 EXPORT_SYMBOL_GPL(saa716x_vip_disable);
 
-int saa716x_vip_get_write_index(struct saa716x_dev *saa716x, int port)
+/* TAGACK of the first DMA channel of a port, the one the BAM counts on */
+int saa716x_vip_msi_bit(int port)
 {
-	u32 buf_mode, val;
+	return __ffs(msi_int_tagack[port * 3]);
+}
+EXPORT_SYMBOL_GPL(saa716x_vip_msi_bit);
 
-	buf_mode = BAM_DMA_BUF_MODE(saa716x->vip[port].dma_channel[0]);
+/* TAGACK of the AUX path */
+int saa716x_vip_aux_msi_bit(int port)
+{
+	return __ffs(msi_int_tagack[port * 3 + 2]);
+}
+EXPORT_SYMBOL_GPL(saa716x_vip_aux_msi_bit);
 
-	val = SAA716x_EPRD(BAM, buf_mode);
+static int __saa716x_vip_write_index(struct saa716x_dev *saa716x,
+				     u8 dma_channel)
+{
+	u32 val;
+
+	val = SAA716x_EPRD(BAM, BAM_DMA_BUF_MODE(dma_channel));
 	return (val >> 3) & 0x7;
 }
+
+int saa716x_vip_get_write_index(struct saa716x_dev *saa716x, int port)
+{
+	return __saa716x_vip_write_index(saa716x,
+					 saa716x->vip[port].dma_channel[0]);
+}
 EXPORT_SYMBOL_GPL(saa716x_vip_get_write_index);
 
-static int saa716x_vip_init_ptables(struct saa716x_dmabuf *dmabuf, int channel,
-				    struct vip_stream_params *stream_params)
+int saa716x_vip_aux_write_index(struct saa716x_dev *saa716x, int port)
 {
-	struct saa716x_dev *saa716x = dmabuf->saa716x;
-	u32 config, i;
-
-	for (i = 0; i < VIP_BUFFERS; i++)
-		BUG_ON((dmabuf[i].mem_ptab_phys == 0));
-
-	config = MMU_DMA_CONFIG(channel); /* DMACONFIGx */
-
-	SAA716x_EPWR(MMU, config, (VIP_BUFFERS - 1));
-
-	if ((stream_params->stream_flags & VIP_INTERLACED) &&
-	    (stream_params->stream_flags & VIP_ODD_FIELD) &&
-	    (stream_params->stream_flags & VIP_EVEN_FIELD)) {
-		/*
-		 * In interlaced mode the same buffer is written twice,
-		 * once the odd field and once the even field
-		 */
-		SAA716x_EPWR(MMU, MMU_PTA0_LSB(channel), PTA_LSB(dmabuf[0].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA0_MSB(channel), PTA_MSB(dmabuf[0].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA1_LSB(channel), PTA_LSB(dmabuf[0].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA1_MSB(channel), PTA_MSB(dmabuf[0].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA2_LSB(channel), PTA_LSB(dmabuf[1].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA2_MSB(channel), PTA_MSB(dmabuf[1].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA3_LSB(channel), PTA_LSB(dmabuf[1].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA3_MSB(channel), PTA_MSB(dmabuf[1].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA4_LSB(channel), PTA_LSB(dmabuf[2].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA4_MSB(channel), PTA_MSB(dmabuf[2].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA5_LSB(channel), PTA_LSB(dmabuf[2].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA5_MSB(channel), PTA_MSB(dmabuf[2].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA6_LSB(channel), PTA_LSB(dmabuf[3].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA6_MSB(channel), PTA_MSB(dmabuf[3].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA7_LSB(channel), PTA_LSB(dmabuf[3].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA7_MSB(channel), PTA_MSB(dmabuf[3].mem_ptab_phys));
-	} else {
-		SAA716x_EPWR(MMU, MMU_PTA0_LSB(channel), PTA_LSB(dmabuf[0].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA0_MSB(channel), PTA_MSB(dmabuf[0].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA1_LSB(channel), PTA_LSB(dmabuf[1].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA1_MSB(channel), PTA_MSB(dmabuf[1].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA2_LSB(channel), PTA_LSB(dmabuf[2].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA2_MSB(channel), PTA_MSB(dmabuf[2].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA3_LSB(channel), PTA_LSB(dmabuf[3].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA3_MSB(channel), PTA_MSB(dmabuf[3].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA4_LSB(channel), PTA_LSB(dmabuf[4].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA4_MSB(channel), PTA_MSB(dmabuf[4].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA5_LSB(channel), PTA_LSB(dmabuf[5].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA5_MSB(channel), PTA_MSB(dmabuf[5].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA6_LSB(channel), PTA_LSB(dmabuf[6].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA6_MSB(channel), PTA_MSB(dmabuf[6].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA7_LSB(channel), PTA_LSB(dmabuf[7].mem_ptab_phys));
-		SAA716x_EPWR(MMU, MMU_PTA7_MSB(channel), PTA_MSB(dmabuf[7].mem_ptab_phys));
+	return __saa716x_vip_write_index(saa716x,
+					 saa716x->vip[port].dma_channel[VIP_AUX]);
+}
+EXPORT_SYMBOL_GPL(saa716x_vip_aux_write_index);
+
+/*
+ * Field the video path is writing now, 1 for the even field. The field
+ * before it is the one the last TAGACK was for.
+ */
+int saa716x_vip_field_id(struct saa716x_dev *saa716x, int port)
+{
+	return !!(SAA716x_EPRD(vi_ch[port], INT_STATUS) & VI_STAT_FID_VID);
+}
+EXPORT_SYMBOL_GPL(saa716x_vip_field_id);
+
+/* both fields of a frame go into one buffer, one TAGACK per field */
+static bool saa716x_vip_both_fields(struct vip_stream_params *stream_params)
+{
+	return (stream_params->stream_flags & VIP_INTERLACED) &&
+	       (stream_params->stream_flags & VIP_ODD_FIELD) &&
+	       (stream_params->stream_flags & VIP_EVEN_FIELD) &&
+	       !(stream_params->stream_flags & VIP_FIELD_BUFFERS);
+}
+
+/* bytes of a frame in memory */
+u32 saa716x_vip_frame_size(struct vip_stream_params *stream_params)
+{
+	return stream_params->pitch * stream_params->lines;
+}
+EXPORT_SYMBOL_GPL(saa716x_vip_frame_size);
+
+/* frame slots of the BAM ring for these parameters */
+int saa716x_vip_slots(struct vip_stream_params *stream_params)
+{
+	return saa716x_vip_both_fields(stream_params) ? VIP_BUFFERS / 2 :
+							VIP_BUFFERS;
+}
+EXPORT_SYMBOL_GPL(saa716x_vip_slots);
+
+static void saa716x_vip_write_pta(struct saa716x_dev *saa716x, int port,
+				  int n, int slot)
+{
+	struct saa716x_vip_stream_port *vip = &saa716x->vip[port];
+	dma_addr_t addr = vip->pta[n][slot];
+	u8 channel = vip->dma_channel[n];
+	int fields = n == VIP_AUX ? 1 : vip->fields;
+	int i;
+
+	for (i = slot * fields; i < (slot + 1) * fields; i++) {
+		SAA716x_EPWR(MMU, MMU_PTA_LSB(channel, i), PTA_LSB(addr));
+		SAA716x_EPWR(MMU, MMU_PTA_MSB(channel, i), PTA_MSB(addr));
+	}
+}
+
+static void saa716x_vip_init_ptables(struct saa716x_dev *saa716x, int port,
+				     int n)
+{
+	struct saa716x_vip_stream_port *vip = &saa716x->vip[port];
+	int fields = n == VIP_AUX ? 1 : vip->fields;
+	int slot;
+
+	SAA716x_EPWR(MMU, MMU_DMA_CONFIG(vip->dma_channel[n]),
+		     (VIP_BUFFERS - 1));
+
+	/*
+	 * In interlaced mode the same buffer is written twice, once the
+	 * odd field and once the even field
+	 */
+	for (slot = 0; slot < VIP_BUFFERS / fields; slot++)
+		saa716x_vip_write_pta(saa716x, port, n, slot);
+}
+
+/*
+ * Point a frame slot at the page tables of another buffer, 0 selects
+ * the scratch buffer. Takes effect the next time the BAM gets there.
+ */
+void saa716x_vip_set_slot(struct saa716x_dev *saa716x, int port, int slot,
+			  dma_addr_t pta0, dma_addr_t pta1)
+{
+	struct saa716x_vip_stream_port *vip = &saa716x->vip[port];
+
+	vip->pta[0][slot] = pta0 ?: vip->scratch[0].mem_ptab_phys;
+	vip->pta[1][slot] = pta1 ?: vip->scratch[1].mem_ptab_phys;
+
+	saa716x_vip_write_pta(saa716x, port, 0, slot);
+	if (vip->dual_channel)
+		saa716x_vip_write_pta(saa716x, port, 1, slot);
+}
+EXPORT_SYMBOL_GPL(saa716x_vip_set_slot);
+
+void saa716x_vip_aux_set_slot(struct saa716x_dev *saa716x, int port, int slot,
+			      dma_addr_t pta)
+{
+	struct saa716x_vip_stream_port *vip = &saa716x->vip[port];
+
+	vip->pta[VIP_AUX][slot] = pta ?: vip->scratch[VIP_AUX].mem_ptab_phys;
+	saa716x_vip_write_pta(saa716x, port, VIP_AUX, slot);
+}
+EXPORT_SYMBOL_GPL(saa716x_vip_aux_set_slot);
+
+/* reset the BAM of a channel and give it the full ring of buffers */
+static int saa716x_vip_bam_setup(struct saa716x_dev *saa716x, u8 dma_channel,
+				 bool reset)
+{
+	u32 buf_mode = BAM_DMA_BUF_MODE(dma_channel);
+	u32 val;
+
+	/* monitor BAM reset */
+	if (reset &&
+	    SAA716x_EPPOLL(BAM, buf_mode, val, !val, 20, 3000000)) {
+		pci_err(saa716x->pdev, "Error: BAM VIP Reset failed!");
+		return -EIO;
 	}
+
+	/* set buffer count */
+	SAA716x_EPWR(BAM, buf_mode, VIP_BUFFERS - 1);
+	/* initialize all available address offsets to 0 */
+	SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_0(dma_channel), 0x0);
+	SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_1(dma_channel), 0x0);
+	SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_2(dma_channel), 0x0);
+	SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_3(dma_channel), 0x0);
+	SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_4(dma_channel), 0x0);
+	SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_5(dma_channel), 0x0);
+	SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_6(dma_channel), 0x0);
+	SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_7(dma_channel), 0x0);
+
 	return 0;
 }
 
-static int saa716x_vip_setparams(struct saa716x_dev *saa716x, int port,
-				 struct vip_stream_params *stream_params)
+/* have the MMU fetch the page tables of a channel */
+static int saa716x_vip_mmu_prefetch(struct saa716x_dev *saa716x,
+				    u8 dma_channel)
 {
-	u32 vi_port, buf_mode, mid, val, i;
-	u8 dma_channel;
-	u32 num_pages;
-	u32 start_x, start_line, end_line, num_lines;
-	u32 base_address, base_offset, pitch;
-	u32 vin_format;
+	u32 config = MMU_DMA_CONFIG(dma_channel);
+	u32 val;
 
-	vi_port = vi_ch[port];
-	buf_mode = BAM_DMA_BUF_MODE(saa716x->vip[port].dma_channel[0]);
-	dma_channel = saa716x->vip[port].dma_channel[0];
+	val = SAA716x_EPRD(MMU, config);
+	SAA716x_EPWR(MMU, config, val & ~0x40);
+	SAA716x_EPWR(MMU, config, val | 0x40);
 
-	/* number of pages needed for a buffer */
-	num_pages = (stream_params->bits / 8 * stream_params->samples
-		     * stream_params->lines) / SAA716x_PAGE_SIZE;
-	/* check if these will fit into one page table */
-	if (num_pages > (SAA716x_PAGE_SIZE / 8))
-		saa716x->vip[port].dual_channel = 1;
-	else
-		saa716x->vip[port].dual_channel = 0;
+	if (SAA716x_EPPOLL(MMU, config, val, val & 0x80, 20, 5000000)) {
+		pci_err(saa716x->pdev, "PTE pre-fetch failed!");
+		return -EIO;
+	}
 
-	/* Reset DMA channel */
-	SAA716x_EPWR(BAM, buf_mode, 0x00000040);
-	saa716x_vip_init_ptables(saa716x->vip[port].dma_buf[0],
-				 saa716x->vip[port].dma_channel[0],
-				 stream_params);
-	if (saa716x->vip[port].dual_channel)
-		saa716x_vip_init_ptables(saa716x->vip[port].dma_buf[1],
-					 saa716x->vip[port].dma_channel[1],
-					 stream_params);
+	return 0;
+}
+
+/*
+ * Input side of the port, shared by the video and the AUX path. Both
+ * program it from the same parameters, so it does not matter which
+ * one comes first.
+ */
+static int saa716x_vip_set_input(struct saa716x_dev *saa716x, int port,
+				 struct vip_stream_params *stream_params)
+{
+	u32 vi_port = vi_ch[port];
+	u32 mid, start_x, start_line, end_line, num_lines;
+	u32 vin_format;
 
 	/* get module ID */
 	mid = SAA716x_EPRD(vi_port, VI_MODULE_ID);
@@ -156,20 +249,11 @@ static int saa716x_vip_setparams(struct saa716x_dev *saa716x, int port,
 
 	start_x = stream_params->offset_x;
 	start_line = stream_params->offset_y + 1;
-	end_line = 0;
 	num_lines = stream_params->lines;
-	pitch = stream_params->pitch;
-	base_address = saa716x->vip[port].dma_channel[0] << 21;
-	base_offset = 0;
 	vin_format = 0x00004000;
 
-	if ((stream_params->stream_flags & VIP_INTERLACED) &&
-	    (stream_params->stream_flags & VIP_ODD_FIELD) &&
-	    (stream_params->stream_flags & VIP_EVEN_FIELD)) {
+	if (saa716x_vip_both_fields(stream_params))
 		num_lines /= 2;
-		pitch *= 2;
-		base_offset = stream_params->pitch;
-	}
 	if (stream_params->stream_flags & VIP_HD) {
 		if (stream_params->stream_flags & VIP_INTERLACED) {
 			vin_format |= 0x01000000;
@@ -204,12 +288,80 @@ static int saa716x_vip_setparams(struct saa716x_dev *saa716x, int port,
 	SAA716x_EPWR(vi_port, WIN_XYEND,
 		     ((start_x + stream_params->samples - 1) << 16) + end_line);
 
+	return 0;
+}
+
+/* the port clock runs from the input while either path captures */
+static void saa716x_vip_run(struct saa716x_dev *saa716x, int port, int path,
+			    bool on)
+{
+	struct saa716x_vip_stream_port *vip = &saa716x->vip[port];
+	u8 running = vip->running;
+
+	if (on)
+		vip->running |= BIT(path);
+	else
+		vip->running &= ~BIT(path);
+
+	if (!running && vip->running)
+		saa716x_set_clk_external(saa716x, vip->dma_channel[0]);
+	else if (running && !vip->running)
+		saa716x_set_clk_internal(saa716x, vip->dma_channel[0]);
+}
+
+static int saa716x_vip_setparams(struct saa716x_dev *saa716x, int port,
+				 struct vip_stream_params *stream_params)
+{
+	u32 vi_port, buf_mode;
+	u8 dma_channel;
+	u32 num_pages, num_lines;
+	u32 base_address, base_offset, pitch;
+	int ret;
+
+	vi_port = vi_ch[port];
+	buf_mode = BAM_DMA_BUF_MODE(saa716x->vip[port].dma_channel[0]);
+	dma_channel = saa716x->vip[port].dma_channel[0];
+
+	/* number of pages needed for a buffer */
+	num_pages = DIV_ROUND_UP(saa716x_vip_frame_size(stream_params),
+				 SAA716x_PAGE_SIZE);
+	/* check if these will fit into one page table */
+	if (num_pages > (SAA716x_PAGE_SIZE / 8))
+		saa716x->vip[port].dual_channel = 1;
+	else
+		saa716x->vip[port].dual_channel = 0;
+
+	saa716x->vip[port].fields =
+		saa716x_vip_both_fields(stream_params) ? 2 : 1;
+
+	/* Reset DMA channel */
+	SAA716x_EPWR(BAM, buf_mode, 0x00000040);
+	saa716x_vip_init_ptables(saa716x, port, 0);
+	if (saa716x->vip[port].dual_channel)
+		saa716x_vip_init_ptables(saa716x, port, 1);
+
+	ret = saa716x_vip_set_input(saa716x, port, stream_params);
+	if (ret)
+		return ret;
+
+	num_lines = stream_params->lines;
+	pitch = stream_params->pitch;
+	base_address = saa716x->vip[port].dma_channel[0] << 21;
+	base_offset = 0;
+
+	if (saa716x_vip_both_fields(stream_params)) {
+		num_lines /= 2;
+		pitch *= 2;
+		base_offset = stream_params->pitch;
+	}
+
 	/* enable cropping to assure not exceed buffer boundaries */
 	SAA716x_EPWR(vi_port, PSU_WINDOW,
 		     (stream_params->samples << 16) + num_lines);
 	/* set packet YUY2 output format */
-	SAA716x_EPWR(vi_port, PSU_FORMAT, 0x800000A1);
+	SAA716x_EPWR(vi_port, PSU_FORMAT, PSU_FMT_YUY2);
 
+	/* plane 1 takes the first field, plane 4 the second one */
 	SAA716x_EPWR(vi_port, PSU_BASE1, base_address);
 	SAA716x_EPWR(vi_port, PSU_PITCH1, pitch);
 	SAA716x_EPWR(vi_port, PSU_PITCH2, 0);
@@ -219,47 +371,13 @@ static int saa716x_vip_setparams(struct saa716x_dev *saa716x, int port,
 	SAA716x_EPWR(vi_port, PSU_BASE5, 0);
 	SAA716x_EPWR(vi_port, PSU_BASE6, 0);
 
-	/* monitor BAM reset */
-	i = 0;
-	val = SAA716x_EPRD(BAM, buf_mode);
-	while (val && (i < 100)) {
-		msleep(30);
-		val = SAA716x_EPRD(BAM, buf_mode);
-		i++;
-	}
-	if (val) {
-		pci_err(saa716x->pdev, "Error: BAM VIP Reset failed!");
-		return -EIO;
-	}
-
-	/* set buffer count */
-	SAA716x_EPWR(BAM, buf_mode, VIP_BUFFERS - 1);
-	/* initialize all available address offsets to 0 */
-	SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_0(dma_channel), 0x0);
-	SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_1(dma_channel), 0x0);
-	SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_2(dma_channel), 0x0);
-	SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_3(dma_channel), 0x0);
-	SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_4(dma_channel), 0x0);
-	SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_5(dma_channel), 0x0);
-	SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_6(dma_channel), 0x0);
-	SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_7(dma_channel), 0x0);
+	ret = saa716x_vip_bam_setup(saa716x, dma_channel, true);
+	if (ret)
+		return ret;
 
-	if (saa716x->vip[port].dual_channel) {
-		buf_mode = BAM_DMA_BUF_MODE(saa716x->vip[port].dma_channel[1]);
-		dma_channel = saa716x->vip[port].dma_channel[1];
-
-		/* set buffer count */
-		SAA716x_EPWR(BAM, buf_mode, VIP_BUFFERS - 1);
-		/* initialize all available address offsets to 0 */
-		SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_0(dma_channel), 0x0);
-		SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_1(dma_channel), 0x0);
-		SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_2(dma_channel), 0x0);
-		SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_3(dma_channel), 0x0);
-		SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_4(dma_channel), 0x0);
-		SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_5(dma_channel), 0x0);
-		SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_6(dma_channel), 0x0);
-		SAA716x_EPWR(BAM, BAM_ADDR_OFFSET_7(dma_channel), 0x0);
-	}
+	if (saa716x->vip[port].dual_channel)
+		saa716x_vip_bam_setup(saa716x,
+				      saa716x->vip[port].dma_channel[1], false);
 
 	return 0;
 }
@@ -268,52 +386,28 @@ int saa716x_vip_start(struct saa716x_dev *saa716x, int port, int one_shot,
 		      struct vip_stream_params *stream_params)
 {
 	u32 vi_port;
-	u32 config1;
-	u32 config2;
 	u32 val;
-	u32 i;
 
 	vi_port = vi_ch[port];
-	config1 = MMU_DMA_CONFIG(saa716x->vip[port].dma_channel[0]);
-	config2 = MMU_DMA_CONFIG(saa716x->vip[port].dma_channel[1]);
 
 	if (saa716x_vip_setparams(saa716x, port, stream_params) != 0)
 		return -EIO;
 
-	val = SAA716x_EPRD(MMU, config1);
-	SAA716x_EPWR(MMU, config1, val & ~0x40);
-	SAA716x_EPWR(MMU, config1, val | 0x40);
-	if (saa716x->vip[port].dual_channel) {
-		val = SAA716x_EPRD(MMU, config2);
-		SAA716x_EPWR(MMU, config2, val & ~0x40);
-		SAA716x_EPWR(MMU, config2, val | 0x40);
-	}
-
 	SAA716x_EPWR(vi_port, INT_ENABLE, 0x33F);
 
-	i = 0;
-	while (i < 500) {
-		val = SAA716x_EPRD(MMU, config1);
-		if (saa716x->vip[port].dual_channel)
-			val &= SAA716x_EPRD(MMU, config2);
-		if (val & 0x80)
-			break;
-		msleep(10);
-		i++;
-	}
-
-	if (!(val & 0x80)) {
-		pci_err(saa716x->pdev, "PTE pre-fetch failed!");
+	if (saa716x_vip_mmu_prefetch(saa716x,
+				     saa716x->vip[port].dma_channel[0]) ||
+	    (saa716x->vip[port].dual_channel &&
+	     saa716x_vip_mmu_prefetch(saa716x,
+				      saa716x->vip[port].dma_channel[1])))
 		return -EIO;
-	}
 
 	/* enable video capture path */
 	val = SAA716x_EPRD(vi_port, VI_MODE);
 	val &= ~(VID_CFEN | VID_FSEQ | VID_OSM);
 
-	if ((stream_params->stream_flags & VIP_INTERLACED) &&
-	    (stream_params->stream_flags & VIP_ODD_FIELD) &&
-	    (stream_params->stream_flags & VIP_EVEN_FIELD)) {
+	if (saa716x_vip_both_fields(stream_params) ||
+	    (stream_params->stream_flags & VIP_FIELD_BUFFERS)) {
 		val |= VID_CFEN_BOTH; /* capture both fields */
 		val |= VID_FSEQ; /* start capture with odd field */
 	} else {
@@ -323,11 +417,11 @@ int saa716x_vip_start(struct saa716x_dev *saa716x, int port, int one_shot,
 	if (one_shot)
 		val |= VID_OSM; /* stop capture after receiving one frame */
 
-	saa716x_set_clk_external(saa716x, saa716x->vip[port].dma_channel[0]);
+	saa716x_vip_run(saa716x, port, 0, true);
 
 	SAA716x_EPWR(vi_port, VI_MODE, val);
 
-	SAA716x_EPWR(MSI, MSI_INT_ENA_SET_L, msi_int_tagack[port]);
+	SAA716x_EPWR(MSI, MSI_INT_ENA_SET_L, msi_int_tagack[port * 3]);
 
 	return 0;
 }
@@ -337,22 +431,124 @@ int saa716x_vip_stop(struct saa716x_dev *saa716x, int port)
 {
 	u32 val;
 
-	SAA716x_EPWR(MSI, MSI_INT_ENA_CLR_L, msi_int_tagack[port]);
+	SAA716x_EPWR(MSI, MSI_INT_ENA_CLR_L, msi_int_tagack[port * 3]);
 
 	/* disable capture */
 	val = SAA716x_EPRD(vi_ch[port], VI_MODE);
 	val &= ~VID_CFEN;
 	SAA716x_EPWR(vi_ch[port], VI_MODE, val);
 
-	saa716x_set_clk_internal(saa716x, saa716x->vip[port].dma_channel[0]);
+	saa716x_vip_run(saa716x, port, 0, false);
 
 	return 0;
 }
 EXPORT_SYMBOL_GPL(saa716x_vip_stop);
 
+/*
+ * Lines a frame of the AUX path has for these input parameters, the
+ * odd field of interlaced input. The path has a single DMA channel and
+ * no scaler set up, aux_start refuses frames that do not fit it, e.g.
+ * progressive 1080 lines.
+ */
+u32 saa716x_vip_aux_lines(struct vip_stream_params *stream_params)
+{
+	u32 lines = stream_params->lines;
+
+	if (saa716x_vip_both_fields(stream_params))
+		lines /= 2;
+
+	return lines;
+}
+EXPORT_SYMBOL_GPL(saa716x_vip_aux_lines);
+
+/*
+ * Start the AUX path of a port on its third DMA channel. It captures
+ * packed YUY2 of the input window described by stream_params, the
+ * same parameters the video path gets. Only the odd field is taken,
+ * which halves the lines and the bandwidth of interlaced input.
+ */
+int saa716x_vip_aux_start(struct saa716x_dev *saa716x, int port,
+			  struct vip_stream_params *stream_params)
+{
+	struct saa716x_vip_stream_port *vip = &saa716x->vip[port];
+	u8 dma_channel = vip->dma_channel[VIP_AUX];
+	u32 vi_port = vi_ch[port];
+	u32 start_x, start_line, lines, pitch;
+	u32 val;
+	int ret;
+
+	start_x = stream_params->offset_x;
+	start_line = stream_params->offset_y + 1;
+	lines = saa716x_vip_aux_lines(stream_params);
+	pitch = stream_params->samples * 2;
+
+	/* a frame has to stay within the window of the channel */
+	if (!lines || pitch * lines > VIP_CHANNEL_SIZE)
+		return -EINVAL;
+
+	SAA716x_EPWR(BAM, BAM_DMA_BUF_MODE(dma_channel), 0x00000040);
+	saa716x_vip_init_ptables(saa716x, port, VIP_AUX);
+
+	/* the video path has set up the input already */
+	if (!vip->running) {
+		ret = saa716x_vip_set_input(saa716x, port, stream_params);
+		if (ret)
+			return -EIO;
+	}
+
+	SAA716x_EPWR(vi_port, AUX_XYSTART, (start_x << 16) + start_line);
+	SAA716x_EPWR(vi_port, AUX_XYEND,
+		     ((start_x + stream_params->samples - 1) << 16) +
+		     stream_params->offset_y + lines);
+	SAA716x_EPWR(vi_port, AUX_FORMAT, PSU_FMT_YUY2);
+	SAA716x_EPWR(vi_port, AUX_BASE, dma_channel << 21);
+	SAA716x_EPWR(vi_port, AUX_PITCH, pitch);
+
+	ret = saa716x_vip_bam_setup(saa716x, dma_channel, true);
+	if (ret)
+		return ret;
+
+	SAA716x_EPWR(vi_port, INT_ENABLE, 0x33F);
+
+	ret = saa716x_vip_mmu_prefetch(saa716x, dma_channel);
+	if (ret)
+		return ret;
+
+	saa716x_vip_run(saa716x, port, VIP_AUX, true);
+
+	/* odd fields only, one BAM buffer per frame */
+	val = SAA716x_EPRD(vi_port, VI_MODE);
+	val &= ~(AUX_CFEN | AUX_FSEQ | AUX_OSM);
+	val |= AUX_CFEN_ODD;
+	SAA716x_EPWR(vi_port, VI_MODE, val);
+
+	SAA716x_EPWR(MSI, MSI_INT_ENA_SET_L, msi_int_tagack[port * 3 + 2]);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(saa716x_vip_aux_start);
+
+int saa716x_vip_aux_stop(struct saa716x_dev *saa716x, int port)
+{
+	u32 val;
+
+	SAA716x_EPWR(MSI, MSI_INT_ENA_CLR_L, msi_int_tagack[port * 3 + 2]);
+
+	val = SAA716x_EPRD(vi_ch[port], VI_MODE);
+	val &= ~AUX_CFEN;
+	SAA716x_EPWR(vi_ch[port], VI_MODE, val);
+
+	saa716x_vip_run(saa716x, port, VIP_AUX, false);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(saa716x_vip_aux_stop);
+
 int saa716x_vip_init(struct saa716x_dev *saa716x, int port,
-		     void (*worker)(unsigned long))
+		     void (*worker)(unsigned long),
+		     void (*aux_worker)(unsigned long))
 {
+	struct saa716x_vip_stream_port *vip = &saa716x->vip[port];
 	int n;
 	int i;
 	int ret;
@@ -360,36 +556,44 @@ int saa716x_vip_init(struct saa716x_dev *saa716x, int port,
 	/* reset VI */
 	SAA716x_EPWR(vi_ch[port], VI_MODE, SOFT_RESET);
 
-	for (n = 0; n < 2; n++) {
-		saa716x->vip[port].dma_channel[n] = port * 3 + n;
-		for (i = 0; i < VIP_BUFFERS; i++) {
-			ret = saa716x_dmabuf_alloc(
-					saa716x,
-					&saa716x->vip[port].dma_buf[n][i],
-					512 * SAA716x_PAGE_SIZE);
-			if (ret < 0)
-				return ret;
-		}
+	vip->port = port;
+	vip->fields = 1;
+	for (n = 0; n < ARRAY_SIZE(vip->scratch); n++) {
+		vip->dma_channel[n] = port * 3 + n;
+		ret = saa716x_dmabuf_alloc(saa716x, &vip->scratch[n],
+					   512 * SAA716x_PAGE_SIZE);
+		if (ret < 0)
+			goto err;
+		for (i = 0; i < VIP_BUFFERS; i++)
+			vip->pta[n][i] = vip->scratch[n].mem_ptab_phys;
 	}
-	saa716x->vip[port].saa716x = saa716x;
-	tasklet_init(&saa716x->vip[port].tasklet, worker,
-		     (unsigned long)&saa716x->vip[port]);
-	saa716x->vip[port].read_index = 0;
+	vip->saa716x = saa716x;
+	tasklet_init(&vip->tasklet, worker, (unsigned long)vip);
+	tasklet_init(&vip->aux_tasklet, aux_worker, (unsigned long)vip);
+	vip->read_index = 0;
+	vip->aux_read_index = 0;
+	vip->running = 0;
 
 	return 0;
+err:
+	while (n--)
+		saa716x_dmabuf_free(saa716x, &vip->scratch[n]);
+	return ret;
 }
 EXPORT_SYMBOL_GPL(saa716x_vip_init);
 
 int saa716x_vip_exit(struct saa716x_dev *saa716x, int port)
 {
 	int n;
-	int i;
 
+	/* no TAGACK may schedule the tasklets once they are killed */
+	SAA716x_EPWR(MSI, MSI_INT_ENA_CLR_L, msi_int_tagack[port * 3] |
+		     msi_int_tagack[port * 3 + 2]);
+	synchronize_irq(pci_irq_vector(saa716x->pdev, 0));
 	tasklet_kill(&saa716x->vip[port].tasklet);
-	for (n = 0; n < 2; n++)
-		for (i = 0; i < VIP_BUFFERS; i++)
-			saa716x_dmabuf_free(
-				saa716x, &saa716x->vip[port].dma_buf[n][i]);
+	tasklet_kill(&saa716x->vip[port].aux_tasklet);
+	for (n = 0; n < ARRAY_SIZE(saa716x->vip[port].scratch); n++)
+		saa716x_dmabuf_free(saa716x, &saa716x->vip[port].scratch[n]);
 
 	return 0;
 }
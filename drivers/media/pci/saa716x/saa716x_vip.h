@@ -3,18 +3,30 @@
 #ifndef __SAA716x_VIP_H
 #define __SAA716x_VIP_H
 
+#include <linux/interrupt.h>
+#include <linux/ktime.h>
+
 #include "saa716x_dma.h"
 
 #define VIP_BUFFERS	8
 
+/* index of the AUX path in the per channel arrays of a port */
+#define VIP_AUX		2
+
+/* a DMA channel addresses 2 MB, 512 page table entries */
+#define VIP_CHANNEL_SIZE	(512 * SAA716x_PAGE_SIZE)
+
 /*
  * Stream port flags
+ * VIP_FIELD_BUFFERS: with VIP_INTERLACED, every field goes into a buffer
+ * of its own, lines is the number of lines of a field
  */
 enum vip_stream_flags {
 	VIP_ODD_FIELD		= 0x0001,
 	VIP_EVEN_FIELD		= 0x0002,
 	VIP_INTERLACED		= 0x0004,
 	VIP_HD			= 0x0010,
+	VIP_FIELD_BUFFERS	= 0x0020,
 	VIP_NO_SCALER		= 0x0100
 };
 
@@ -37,24 +49,56 @@ struct vip_stream_params {
 	enum vip_stream_flags	stream_flags;
 };
 
+/*
+ * VIP stream port
+ * fields: BAM buffers per frame, 2 when both fields share a buffer
+ * running: bit 0 video path, bit VIP_AUX AUX path
+ * tag_time, aux_tag_time: time of the last TAGACK of either path
+ * dma_channel: two for the video path, the last one for the AUX path
+ * scratch: written whenever no buffer of the consumer is at hand
+ * pta: page table per frame slot and DMA channel
+ */
 struct saa716x_vip_stream_port {
+	u8			port;
 	u8			dual_channel;
+	u8			fields;
 	u8			read_index;
-	u8			dma_channel[2];
-	struct saa716x_dmabuf	dma_buf[2][VIP_BUFFERS];
+	u8			aux_read_index;
+	u8			running;
+	ktime_t			tag_time;
+	ktime_t			aux_tag_time;
+	u8			dma_channel[3];
+	struct saa716x_dmabuf	scratch[3];
+	dma_addr_t		pta[3][VIP_BUFFERS];
 	struct saa716x_dev	*saa716x;
 	struct tasklet_struct	tasklet;
+	struct tasklet_struct	aux_tasklet;
 };
 
 extern void saa716x_vipint_disable(struct saa716x_dev *saa716x);
 extern void saa716x_vip_disable(struct saa716x_dev *saa716x);
+extern int saa716x_vip_msi_bit(int port);
+extern int saa716x_vip_aux_msi_bit(int port);
 extern int saa716x_vip_get_write_index(struct saa716x_dev *saa716x, int port);
+extern int saa716x_vip_aux_write_index(struct saa716x_dev *saa716x, int port);
+extern int saa716x_vip_field_id(struct saa716x_dev *saa716x, int port);
+extern u32 saa716x_vip_frame_size(struct vip_stream_params *stream_params);
+extern int saa716x_vip_slots(struct vip_stream_params *stream_params);
+extern void saa716x_vip_set_slot(struct saa716x_dev *saa716x, int port,
+				 int slot, dma_addr_t pta0, dma_addr_t pta1);
+extern void saa716x_vip_aux_set_slot(struct saa716x_dev *saa716x, int port,
+				     int slot, dma_addr_t pta);
 extern int saa716x_vip_start(struct saa716x_dev *saa716x, int port,
 			     int one_shot,
 			     struct vip_stream_params *stream_params);
 extern int saa716x_vip_stop(struct saa716x_dev *saa716x, int port);
+extern u32 saa716x_vip_aux_lines(struct vip_stream_params *stream_params);
+extern int saa716x_vip_aux_start(struct saa716x_dev *saa716x, int port,
+				 struct vip_stream_params *stream_params);
+extern int saa716x_vip_aux_stop(struct saa716x_dev *saa716x, int port);
 extern int saa716x_vip_init(struct saa716x_dev *saa716x, int port,
-			    void (*worker)(unsigned long));
+			    void (*worker)(unsigned long),
+			    void (*aux_worker)(unsigned long));
 extern int saa716x_vip_exit(struct saa716x_dev *saa716x, int port);
 
 #endif /* __SAA716x_VIP_H */
@@ -13,6 +13,9 @@
 #define VID_OSM				(0x00000001 << 29)
 #define VID_FSEQ			(0x00000001 << 28)
 #define AUX_CFEN			(0x00000003 << 26)
+#define AUX_CFEN_ODD			(0x00000001 << 26)
+#define AUX_CFEN_EVEN			(0x00000002 << 26)
+#define AUX_CFEN_BOTH			(0x00000003 << 26)
 #define AUX_OSM				(0x00000001 << 25)
 #define AUX_FSEQ			(0x00000001 << 24)
 #define AUX_ANC_DATA			(0x00000003 << 22)
@@ -68,6 +71,7 @@
 #define CSM_CKEY			0x284
 
 #define PSU_FORMAT			0x300
+#define PSU_FMT_YUY2			0x800000A1
 #define PSU_WINDOW			0x304
 #define PSU_BASE1			0x340
 #define PSU_PITCH1			0x344